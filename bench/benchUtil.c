@@ -0,0 +1,81 @@
+#include <signal.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "benchUtil.h"
+
+#define LINE_SIZE 128
+#define SETTLE_MILLIS 100
+#define SETTLE_TRIES 600
+
+long now_nanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOSECONDS + now.tv_nsec;
+}
+
+void sleep_nanos(long nanos) {
+    struct timespec delay = {nanos / NANOSECONDS, nanos % NANOSECONDS};
+    nanosleep(&delay, NULL);
+}
+
+int compare_longs(const void* a, const void* b) {
+    long x = *(const long*) a;
+    long y = *(const long*) b;
+    return (x > y) - (x < y);
+}
+
+bool start_server(char** args, Server* server) {
+    int fds[2];
+    if (pipe(fds)) {
+        return false;
+    }
+    server->pid = fork();
+    if (!server->pid) {
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(args[0], args);
+        _exit(1);
+    }
+    close(fds[1]);
+    server->err = fdopen(fds[0], "r");
+    char line[LINE_SIZE];
+    if (!fgets(line, LINE_SIZE, server->err)) {
+        return false;
+    }
+    server->port = atoi(line);
+
+    //The port is printed before the server starts waiting for SIGHUP
+    sleep_nanos(SETTLE_MILLIS * NANOS_PER_MILLI);
+    return server->port > 0;
+}
+
+void stop_server(Server* server) {
+    kill(server->pid, SIGKILL);
+    waitpid(server->pid, NULL, 0);
+    fclose(server->err);
+}
+
+int read_sub_count(Server* server) {
+    kill(server->pid, SIGHUP);
+    char line[LINE_SIZE];
+    int subs = -1;
+    while (fgets(line, LINE_SIZE, server->err)) {
+        if (sscanf(line, "sub operations:%d", &subs) == 1) {
+            break;
+        }
+    }
+    return subs;
+}
+
+bool wait_for_subs(Server* server, int expected) {
+    for (int i = 0; i < SETTLE_TRIES; i++) {
+        if (read_sub_count(server) >= expected) {
+            return true;
+        }
+        sleep_nanos(SETTLE_MILLIS * NANOS_PER_MILLI);
+    }
+    return false;
+}
@@ -0,0 +1,80 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#define NANOSECONDS 1000000000L
+#define NANOS_PER_MILLI 1000000L
+
+//A psserver started by a benchmark, with its stderr read to learn its port
+//and its statistics
+typedef struct {
+    pid_t pid;
+    FILE* err;
+    int port;
+} Server;
+
+/* now_nanos()
+ * -----------
+ * Returns: the current monotonic time in nanoseconds
+ */
+long now_nanos(void);
+
+/* sleep_nanos()
+ * -------------
+ * Sleeps for the given number of nanoseconds
+ */
+void sleep_nanos(long nanos);
+
+/* compare_longs()
+ * ---------------
+ * qsort() comparison function for longs
+ */
+int compare_longs(const void* a, const void* b);
+
+/* start_server()
+ * --------------
+ * Starts psserver with its stderr read by this process, and waits for it to
+ * print its port
+ *
+ * args: the psserver executable followed by its arguments, ending with NULL
+ *
+ * server: set up with the running server
+ *
+ * Returns: true if the server started and false otherwise
+ */
+bool start_server(char** args, Server* server);
+
+/* stop_server()
+ * -------------
+ * Kills a server started by start_server() and waits for it to exit
+ *
+ * server: the server to stop
+ */
+void stop_server(Server* server);
+
+/* read_sub_count()
+ * ----------------
+ * Asks the server for its statistics with SIGHUP
+ *
+ * server: the server to ask
+ *
+ * Returns: the number of sub operations the server has handled, or -1 if
+ * its statistics could not be read
+ */
+int read_sub_count(Server* server);
+
+/* wait_for_subs()
+ * ---------------
+ * Waits until the server has handled the given number of sub commands
+ *
+ * server: the server to wait for
+ *
+ * expected: the number of sub commands
+ *
+ * Returns: true if every sub was handled in time and false otherwise
+ */
+bool wait_for_subs(Server* server, int expected);
+#endif
@@ -0,0 +1,371 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../deliveryPool.h"
+#include "../epoch.h"
+#include "../fairLock.h"
+#include "../outQueue.h"
+#include "../topic.h"
+#include "../topicTable.h"
+#include "benchUtil.h"
+
+#define TOPIC_COUNT 8
+#define TOPIC_NAME_SIZE 16
+#define PUBLISHERS 4
+#define CHURNERS 2
+#define STEADY_SUBSCRIBERS 64
+#define WIDE_SUBSCRIBERS 2048
+#define WIDE_TOPIC 0
+#define CHURN_TOPICS 3
+#define PHASE_SECONDS 2
+#define MAX_SAMPLES (1 << 20)
+#define MICROSECONDS 1000.0
+#define PERCENTILE 99
+#define FREED_BYTE 0xdd
+#define MAX_QUEUE_LENGTH 64
+#define SUBSCRIPTION_KINDS 3
+#define STRESS_VALUE "value"
+
+//The shared state every stress thread works on
+typedef struct {
+    TopicTable topics;
+    EpochDomain epoch;
+    FairLock lock;
+    DeliveryPool pool;
+    char names[TOPIC_COUNT][TOPIC_NAME_SIZE];
+    bool stop;
+    long churned;
+} Stress;
+
+//Stores the data required for one publisher thread
+typedef struct {
+    Stress* stress;
+    long* samples;
+    int sampleCount;
+    long published;
+    unsigned int seed;
+} Publisher;
+
+/* deliver_payload()
+ * -----------------
+ * Adds the payload to a subscriber's queue, as the server does. If the
+ * subscriber had already been freed, the address sanitizer reports it here.
+ *
+ * client: the subscriber
+ *
+ * arg: the payload being published
+ */
+void deliver_payload(Client* client, void* arg) {
+    if (client->hasName != true) {
+        fprintf(stderr, "churn_stress: delivered to a freed client\n");
+        abort();
+    }
+    enqueue(&client->queue, arg, false);
+
+    //Nothing sends the messages, so keep the queues short
+    pthread_mutex_lock(&client->queue.lock);
+    while (client->queue.length > MAX_QUEUE_LENGTH) {
+        pop_entry(&client->queue);
+    }
+    pthread_mutex_unlock(&client->queue.lock);
+}
+
+/* init_fake_client()
+ * ------------------
+ * Returns: a new client with an empty queue
+ */
+Client* init_fake_client(void) {
+    Client* client = calloc(1, sizeof(Client));
+    client->hasName = true;
+    init_queue(&client->queue);
+    return client;
+}
+
+/* subscribe_fake_client()
+ * -----------------------
+ * Subscribes a client to a topic, sometimes as a member of a group and 
+ * sometimes with a filter. The fair lock must be held.
+ *
+ * stress: the shared state
+ *
+ * client: the client subscribing
+ *
+ * topic: the index of the topic
+ */
+void subscribe_fake_client(Stress* stress, Client* client, int topic) {
+    char* name = stress->names[topic];
+    Topic* topicInfo = find_topic(&stress->topics, name);
+    if (!topicInfo) {
+        topicInfo = init_topic(&stress->epoch, 0);
+        add_topic(&stress->topics, name, topicInfo);
+    }
+    int kind = rand() % SUBSCRIPTION_KINDS;
+    if (kind == 0) {
+        join_group(topicInfo, "workers", client, false);
+    } else if (kind == 1) {
+        add_subscriber(topicInfo, client, rand() % 2);
+    } else {
+        Filter filter = {FILTER_CONTAINS, STRESS_VALUE, strlen(STRESS_VALUE),
+                NULL, 0};
+        add_filtered_subscriber(topicInfo, client, &filter, rand() % 2);
+    }
+}
+
+/* remove_fake_client()
+ * --------------------
+ * Removes a client from every topic and group, as clean_up_client() does,
+ * then frees it once no publisher can still be using it
+ *
+ * stress: the shared state
+ *
+ * client: the client to remove
+ */
+void remove_fake_client(Stress* stress, Client* client) {
+    fair_lock(&stress->lock);
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+        Topic* topic = find_topic(&stress->topics, stress->names[i]);
+        if (!topic) {
+            continue;
+        }
+        Group* group = topic->groups;
+        while (group) {
+            Group* next = group->next;
+            leave_group(topic, group, client);
+            group = next;
+        }
+        remove_subscriber(topic, client);
+        if (is_empty_topic(topic)) {
+            remove_topic(&stress->topics, stress->names[i]);
+            retire_topic(topic);
+        }
+    }
+    fair_unlock(&stress->lock);
+
+    synchronize_epoch(&stress->epoch);
+    free_queue(&client->queue);
+    memset(client, FREED_BYTE, sizeof(Client));
+    free(client);
+}
+
+/* churn_thread()
+ * --------------
+ * Subscribes short lived clients to a few topics and removes them again as
+ * fast as it can, creating and deleting topics, groups and filters along the
+ * way
+ *
+ * arg: a pointer to the Stress struct
+ */
+void* churn_thread(void* arg) {
+    Stress* stress = arg;
+    while (!__atomic_load_n(&stress->stop, __ATOMIC_RELAXED)) {
+        Client* client = init_fake_client();
+        fair_lock(&stress->lock);
+        for (int i = 0; i < CHURN_TOPICS; i++) {
+            subscribe_fake_client(stress, client, rand() % TOPIC_COUNT);
+        }
+        fair_unlock(&stress->lock);
+        remove_fake_client(stress, client);
+        __atomic_add_fetch(&stress->churned, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+/* publisher_thread()
+ * ------------------
+ * Publishes to random topics the way publish_message() does, recording how
+ * long each publish takes
+ *
+ * arg: a pointer to the Publisher struct
+ */
+void* publisher_thread(void* arg) {
+    Publisher* publisher = arg;
+    Stress* stress = publisher->stress;
+    EpochRecord* reader = register_reader(&stress->epoch);
+    char* data = strdup("stress:topic:" STRESS_VALUE "\n");
+    Payload* payload = init_payload("topic", data, strlen(data));
+
+    while (!__atomic_load_n(&stress->stop, __ATOMIC_RELAXED)) {
+        char* name = stress->names[rand_r(&publisher->seed) % TOPIC_COUNT];
+        long start = now_nanos();
+        epoch_enter(&stress->epoch, reader);
+        Topic* topic = find_topic(&stress->topics, name);
+        if (topic) {
+            Subscribers* subscribers = get_subscribers(topic);
+            fan_out(&stress->pool, subscribers->clients,
+                    subscribers->clientCount, deliver_payload, payload);
+            fan_out(&stress->pool, subscribers->conflated,
+                    subscribers->conflatedCount, deliver_payload, payload);
+            for (int i = 0; i < subscribers->groupCount; i++) {
+                deliver_payload(next_group_member(&subscribers->groups[i]),
+                        payload);
+            }
+            for (int i = 0; i < subscribers->filteredCount; i++) {
+                FilteredView* filtered = &subscribers->filtered[i];
+                if (match_filter(filtered->filter, STRESS_VALUE,
+                        strlen(STRESS_VALUE))) {
+                    fan_out(&stress->pool, filtered->clients,
+                            filtered->clientCount, deliver_payload, payload);
+                    fan_out(&stress->pool, filtered->conflated,
+                            filtered->conflatedCount, deliver_payload,
+                            payload);
+                }
+            }
+        }
+        epoch_exit(reader);
+        if (publisher->sampleCount < MAX_SAMPLES) {
+            publisher->samples[publisher->sampleCount++] = now_nanos() -
+                    start;
+        }
+        publisher->published++;
+    }
+
+    unregister_reader(&stress->epoch, reader);
+    release_payload(payload);
+    return NULL;
+}
+
+/* run_phase()
+ * -----------
+ * Runs the publishers, and optionally the churn threads, for PHASE_SECONDS
+ * and prints the publish latency
+ *
+ * stress: the shared state
+ *
+ * churners: the number of churn threads to run alongside the publishers
+ */
+void run_phase(Stress* stress, int churners) {
+    Publisher publishers[PUBLISHERS];
+    pthread_t publisherIds[PUBLISHERS];
+    pthread_t churnIds[CHURNERS];
+    stress->stop = false;
+    stress->churned = 0;
+
+    for (int i = 0; i < PUBLISHERS; i++) {
+        publishers[i].stress = stress;
+        publishers[i].samples = malloc(sizeof(long) * MAX_SAMPLES);
+        publishers[i].sampleCount = 0;
+        publishers[i].published = 0;
+        publishers[i].seed = i + 1;
+        pthread_create(&publisherIds[i], NULL, publisher_thread,
+                &publishers[i]);
+    }
+    for (int i = 0; i < churners; i++) {
+        pthread_create(&churnIds[i], NULL, churn_thread, stress);
+    }
+    sleep(PHASE_SECONDS);
+    __atomic_store_n(&stress->stop, true, __ATOMIC_RELAXED);
+    for (int i = 0; i < churners; i++) {
+        pthread_join(churnIds[i], NULL);
+    }
+
+    //Merge the samples of every publisher
+    long published = 0;
+    int total = 0;
+    long* samples = malloc(sizeof(long) * MAX_SAMPLES * PUBLISHERS);
+    for (int i = 0; i < PUBLISHERS; i++) {
+        pthread_join(publisherIds[i], NULL);
+        memcpy(samples + total, publishers[i].samples,
+                sizeof(long) * publishers[i].sampleCount);
+        total += publishers[i].sampleCount;
+        published += publishers[i].published;
+        free(publishers[i].samples);
+    }
+    qsort(samples, total, sizeof(long), compare_longs);
+    printf("%-8d %12ld %12ld %10.1f %10.1f %10.1f\n", churners, published,
+            stress->churned, samples[total / 2] / MICROSECONDS,
+            samples[(long) total * PERCENTILE / 100] / MICROSECONDS,
+            samples[total - 1] / MICROSECONDS);
+    free(samples);
+}
+
+/* run_stress()
+ * ------------
+ * Publishes from several threads while other threads subscribe and
+ * unsubscribe short lived clients as fast as they can. Publish latency is
+ * printed with and without the churn, and any delivery to a client that has
+ * been freed aborts the run. Build with the address sanitizer to also catch
+ * topics, snapshots, groups and filters being freed too early.
+ *
+ * Returns: 0 once the run is over
+ */
+int run_stress(void) {
+    Stress stress;
+    init_epoch_domain(&stress.epoch);
+    init_topic_table(&stress.topics, &stress.epoch);
+    fair_lock_init(&stress.lock);
+    init_delivery_pool(&stress.pool, 2);
+    for (int i = 0; i < TOPIC_COUNT; i++) {
+        snprintf(stress.names[i], TOPIC_NAME_SIZE, "topic%d", i);
+    }
+
+    //Steady subscribers that stay for the whole run, with enough plain ones
+    //on one topic that its fan-outs are split across the delivery workers
+    Client* steady[STEADY_SUBSCRIBERS];
+    Client** wide = malloc(sizeof(Client*) * WIDE_SUBSCRIBERS);
+    fair_lock(&stress.lock);
+    for (int i = 0; i < STEADY_SUBSCRIBERS; i++) {
+        steady[i] = init_fake_client();
+        subscribe_fake_client(&stress, steady[i], i % TOPIC_COUNT);
+    }
+    Topic* wideTopic = find_topic(&stress.topics, stress.names[WIDE_TOPIC]);
+    for (int i = 0; i < WIDE_SUBSCRIBERS; i++) {
+        wide[i] = init_fake_client();
+        add_subscriber(wideTopic, wide[i], false);
+    }
+    fair_unlock(&stress.lock);
+
+    printf("%-8s %12s %12s %10s %10s %10s\n", "churners", "publishes",
+            "churned", "p50(us)", "p99(us)", "max(us)");
+    run_phase(&stress, 0);
+    run_phase(&stress, CHURNERS);
+
+    for (int i = 0; i < STEADY_SUBSCRIBERS; i++) {
+        remove_fake_client(&stress, steady[i]);
+    }
+    for (int i = 0; i < WIDE_SUBSCRIBERS; i++) {
+        remove_fake_client(&stress, wide[i]);
+    }
+    free(wide);
+    free(stress.topics.buckets->buckets);
+    free(stress.topics.buckets);
+    fflush(stdout);
+    return 0;
+}
+
+/* main()
+ * ------
+ * Runs the stress test in a child process so that it only passes if the
+ * child exits cleanly. A crash, an abort or an address sanitizer report in
+ * any thread fails the run, even if the sanitizer lets the child carry on
+ * or exit with status 0.
+ *
+ * Returns: 0 if no fault was detected and 1 otherwise
+ */
+int main(void) {
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        exit(run_stress());
+    }
+    int status;
+    if (child < 0 || waitpid(child, &status, 0) < 0) {
+        perror("churn_stress");
+        return 1;
+    }
+    if (WIFSIGNALED(status)) {
+        fprintf(stderr, "churn_stress: fault detected (signal %d)\n",
+                WTERMSIG(status));
+        return 1;
+    }
+    if (WEXITSTATUS(status)) {
+        fprintf(stderr, "churn_stress: fault detected (status %d)\n",
+                WEXITSTATUS(status));
+        return 1;
+    }
+    printf("no use after free detected\n");
+    return 0;
+}
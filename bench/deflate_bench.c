@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../deflateFrame.h"
+#include "benchUtil.h"
+
+#define MIN_SIZE 64
+#define MAX_SIZE 65536
+#define TARGET_BYTES (64L * 1024 * 1024)
+#define MIN_ROUNDS 16
+#define SUBSCRIBERS 1000
+#define RECORD_SIZE 96
+
+/* make_message()
+ * --------------
+ * Builds a message line of JSON-like records, which is the kind of value
+ * large enough to be worth compressing. Values cannot contain colons, so
+ * fields are written as name=value.
+ *
+ * size: the number of bytes in the message, including its newline
+ *
+ * Returns: the message, which the caller must free
+ */
+char* make_message(int size) {
+    char* message = malloc(size + RECORD_SIZE);
+    int len = snprintf(message, RECORD_SIZE, "bench:prices:");
+    for (int i = 0; len < size - 1; i++) {
+        len += snprintf(message + len, RECORD_SIZE,
+                "{\"id\"=%d,\"symbol\"=\"SYM%d\",\"bid\"=%d.%02d,"
+                "\"ask\"=%d.%02d,\"venue\"=\"main\"}", i, i % 50,
+                100 + i % 7, i % 100, 101 + i % 7, (i * 3) % 100);
+    }
+    message[size - 1] = '\n';
+    message[size] = '\0';
+    return message;
+}
+
+/* run_size()
+ * ----------
+ * Compresses and inflates a message of one size over and over, then prints
+ * the time taken for each, the bytes sent with and without compression and
+ * the cost of compressing spread over SUBSCRIBERS subscribers, as the server
+ * compresses each message once for every subscriber that asked for it
+ *
+ * size: the number of bytes in the message
+ */
+void run_size(int size) {
+    char* message = make_message(size);
+    long rounds = TARGET_BYTES / size;
+    rounds = rounds < MIN_ROUNDS ? MIN_ROUNDS : rounds;
+
+    size_t frameLen = size;
+    long start = now_nanos();
+    for (long i = 0; i < rounds; i++) {
+        char* frame = deflate_frame(message, size, &frameLen);
+        if (!frame) {
+            frameLen = size;
+            continue;
+        }
+        free(frame);
+    }
+    double deflateNanos = (double) (now_nanos() - start) / rounds;
+
+    //Time inflating the frame the client receives
+    double inflateNanos = 0;
+    char* frame = deflate_frame(message, size, &frameLen);
+    if (frame) {
+        size_t compressedLen;
+        size_t len;
+        char* data = strchr(frame, '\n') + 1;
+        *(data - 1) = '\0';
+        parse_frame_header(frame, &compressedLen, &len);
+        start = now_nanos();
+        for (long i = 0; i < rounds; i++) {
+            free(inflate_frame(data, compressedLen, len));
+        }
+        inflateNanos = (double) (now_nanos() - start) / rounds;
+        free(frame);
+    } else {
+        frameLen = size;
+    }
+
+    printf("%8d %10zu %8.2f %12.0f %12.0f %14.1f\n", size, frameLen,
+            (double) size / frameLen, deflateNanos, inflateNanos,
+            deflateNanos / SUBSCRIBERS);
+    free(message);
+}
+
+/* main()
+ * ------
+ * Measures deflate frames for messages from MIN_SIZE to MAX_SIZE bytes.
+ * Messages shorter than DEFLATE_MIN_SIZE are sent as they are, so they show
+ * no saving and only the cost of deciding not to compress.
+ */
+int main(void) {
+    printf("%8s %10s %8s %12s %12s %14s\n", "bytes", "wire", "ratio",
+            "deflate(ns)", "inflate(ns)", "ns/subscriber");
+    for (int size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+        run_size(size);
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../deliveryPool.h"
+#include "../outQueue.h"
+#include "benchUtil.h"
+
+#define ITERATIONS 50
+#define MICROSECONDS 1000.0
+
+//The subscriber counts and worker counts measured
+int subscriberCounts[] = {1000, 10000, 50000};
+int workerCounts[] = {0, 1, 2, 4, 8};
+
+/* deliver_payload()
+ * -----------------
+ * Adds the payload to a fake client's queue, as the server does for a
+ * subscriber, without waking a sender
+ *
+ * client: the fake client
+ *
+ * arg: the payload being fanned out
+ */
+void deliver_payload(Client* client, void* arg) {
+    enqueue(&client->queue, arg, false);
+}
+
+/* drain_clients()
+ * ---------------
+ * Empties the queue of every fake client between iterations
+ *
+ * clients: the array of fake clients
+ *
+ * count: the number of fake clients
+ */
+void drain_clients(Client** clients, int count) {
+    for (int i = 0; i < count; i++) {
+        OutQueue* queue = &clients[i]->queue;
+        while (queue->length) {
+            pop_entry(queue);
+        }
+    }
+}
+
+/* main()
+ * ------
+ * Measures the time taken by fan_out() to queue one message for every
+ * subscriber of a topic, for a range of subscriber counts and worker counts,
+ * and prints the median and worst latency in microseconds
+ */
+int main(void) {
+    int maxSubscribers = subscriberCounts[sizeof(subscriberCounts) / 
+            sizeof(int) - 1];
+    Client** clients = malloc(sizeof(Client*) * maxSubscribers);
+    for (int i = 0; i < maxSubscribers; i++) {
+        clients[i] = malloc(sizeof(Client));
+        init_queue(&clients[i]->queue);
+    }
+    char* data = strdup("bench:topic:value\n");
+    Payload* payload = init_payload("topic", data, strlen(data));
+
+    printf("%-12s %-8s %12s %12s\n", "subscribers", "workers", "median(us)",
+            "max(us)");
+    for (int w = 0; w < sizeof(workerCounts) / sizeof(int); w++) {
+        //Workers never exit, so each pool is left to its workers rather
+        //than set up again where they are still waiting
+        DeliveryPool* pool = malloc(sizeof(DeliveryPool));
+        init_delivery_pool(pool, workerCounts[w]);
+        for (int s = 0; s < sizeof(subscriberCounts) / sizeof(int); s++) {
+            int count = subscriberCounts[s];
+            long times[ITERATIONS];
+            for (int i = 0; i < ITERATIONS; i++) {
+                long start = now_nanos();
+                fan_out(pool, clients, count, deliver_payload, payload);
+                times[i] = now_nanos() - start;
+                drain_clients(clients, count);
+            }
+            qsort(times, ITERATIONS, sizeof(long), compare_longs);
+            printf("%-12d %-8d %12.1f %12.1f\n", count, workerCounts[w],
+                    times[ITERATIONS / 2] / MICROSECONDS, 
+                    times[ITERATIONS - 1] / MICROSECONDS);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../filter.h"
+#include "../outQueue.h"
+#include "benchUtil.h"
+
+#define MIN_SIZE 64
+#define MAX_SIZE 16384
+#define TARGET_BYTES (256L * 1024 * 1024)
+#define MIN_ROUNDS 1024
+#define DELIVER_ROUNDS 1000000
+#define FIELD_SIZE 32
+#define MISSING_TEXT "status=halted"
+#define MISSING_FIELD "venue"
+#define MISSING_VALUE "dark"
+
+/* make_value()
+ * ------------
+ * Builds a value of comma separated fields that none of the benchmark's
+ * filters match, so every filter has to look at the whole value
+ *
+ * size: the number of bytes in the value
+ *
+ * Returns: the value, which the caller must free
+ */
+char* make_value(int size) {
+    char* value = malloc(size + FIELD_SIZE);
+    int len = 0;
+    for (int i = 0; len < size; i++) {
+        len += snprintf(value + len, FIELD_SIZE, "sym%d=%d.%02d,", i % 50,
+                100 + i % 7, i % 100);
+    }
+    value[size] = '\0';
+    return value;
+}
+
+/* time_search()
+ * -------------
+ * Times one way of searching a value for text it does not contain
+ *
+ * find: the search function
+ *
+ * value: the value
+ *
+ * size: the length of the value
+ *
+ * rounds: the number of times to search
+ *
+ * Returns: the average nanoseconds per search
+ */
+double time_search(const char* (*find)(const char*, size_t, const char*,
+        size_t), char* value, int size, long rounds) {
+    long found = 0;
+    long start = now_nanos();
+    for (long i = 0; i < rounds; i++) {
+        found += find(value, size, MISSING_TEXT, strlen(MISSING_TEXT)) != NULL;
+    }
+    double nanos = (double) (now_nanos() - start) / rounds;
+    if (found) {
+        fprintf(stderr, "filter_bench: text unexpectedly found\n");
+    }
+    return nanos;
+}
+
+/* time_field()
+ * ------------
+ * Times a field filter on a value without the field
+ *
+ * value: the value
+ *
+ * size: the length of the value
+ *
+ * rounds: the number of times to test the value
+ *
+ * Returns: the average nanoseconds per test
+ */
+double time_field(char* value, int size, long rounds) {
+    Filter filter = {FILTER_FIELD, MISSING_VALUE, strlen(MISSING_VALUE),
+            MISSING_FIELD, strlen(MISSING_FIELD)};
+    long matched = 0;
+    long start = now_nanos();
+    for (long i = 0; i < rounds; i++) {
+        matched += match_filter(&filter, value, size);
+    }
+    double nanos = (double) (now_nanos() - start) / rounds;
+    if (matched) {
+        fprintf(stderr, "filter_bench: field unexpectedly matched\n");
+    }
+    return nanos;
+}
+
+/* time_delivery()
+ * ---------------
+ * Times adding a message to a subscriber's queue and taking it off again,
+ * which is the least a delivery costs before anything is written
+ *
+ * Returns: the average nanoseconds per delivery
+ */
+double time_delivery(void) {
+    OutQueue queue;
+    init_queue(&queue);
+    Payload* payload = init_payload("bench", strdup("bench:bench:x\n"),
+            strlen("bench:bench:x\n"));
+    long start = now_nanos();
+    for (long i = 0; i < DELIVER_ROUNDS; i++) {
+        enqueue(&queue, payload, false);
+        pop_entry(&queue);
+    }
+    double nanos = (double) (now_nanos() - start) / DELIVER_ROUNDS;
+    release_payload(payload);
+    free_queue(&queue);
+    return nanos;
+}
+
+/* main()
+ * ------
+ * Measures the cost of testing a value against a filter that does not match
+ * it, for values from MIN_SIZE to MAX_SIZE bytes, with the SSE2 and scalar
+ * substring searches and with a field filter. A filter is tested once per
+ * message for every subscriber sharing it, so it only has to cost less than
+ * the deliveries it saves, which are shown for comparison.
+ */
+int main(void) {
+    double deliver = time_delivery();
+    printf("deliver(ns) %.1f\n", deliver);
+    printf("%8s %12s %12s %12s %10s\n", "bytes", "sse2(ns)", "scalar(ns)",
+            "field(ns)", "speedup");
+    for (int size = MIN_SIZE; size <= MAX_SIZE; size *= 4) {
+        char* value = make_value(size);
+        long rounds = TARGET_BYTES / size;
+        rounds = rounds < MIN_ROUNDS ? MIN_ROUNDS : rounds;
+        double simd = time_search(find_text, value, size, rounds);
+        double scalar = time_search(find_text_scalar, value, size, rounds);
+        double field = time_field(value, size, rounds);
+        printf("%8d %12.1f %12.1f %12.1f %10.2f\n", size, simd, scalar,
+                field, scalar / simd);
+        free(value);
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "benchUtil.h"
+
+#define DEFAULT_SERVER "./psserver"
+#define MAX_STEPS 16
+#define TOPIC_COUNT 1000
+#define LINE_SIZE 128
+#define PATH_SIZE 64
+#define SPARE_FDS 64
+#define CONNECTIONS_PER_ADDRESS 20000
+#define KILOBYTE 1024
+#define MEGABYTE (1024.0 * 1024.0)
+
+/* read_rss()
+ * ----------
+ * Returns: the resident set size of a process in bytes, or 0 if it cannot
+ * be read
+ */
+long read_rss(pid_t pid) {
+    char path[PATH_SIZE];
+    snprintf(path, PATH_SIZE, "/proc/%d/status", (int) pid);
+    FILE* status = fopen(path, "r");
+    if (!status) {
+        return 0;
+    }
+    char line[LINE_SIZE];
+    long rss = 0;
+    while (fgets(line, LINE_SIZE, status)) {
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1) {
+            break;
+        }
+    }
+    fclose(status);
+    return rss * KILOBYTE;
+}
+
+/* open_connection()
+ * -----------------
+ * Connects an idle subscriber to the server. Each loopback source address
+ * is used for at most CONNECTIONS_PER_ADDRESS connections so the ephemeral
+ * ports do not run out.
+ *
+ * port: the server's port
+ *
+ * index: the number of the connection, used for its name and topic
+ *
+ * Returns: the connected socket, or -1 if it could not be opened
+ */
+int open_connection(int port, int index) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    struct sockaddr_in source;
+    memset(&source, 0, sizeof(source));
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 +
+            index / CONNECTIONS_PER_ADDRESS);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr*) &source, sizeof(source)) ||
+            connect(sock, (struct sockaddr*) &address, sizeof(address))) {
+        close(sock);
+        return -1;
+    }
+
+    char line[LINE_SIZE];
+    int len = snprintf(line, LINE_SIZE, "name idle%d\nsub topic%d\n", index,
+            index % TOPIC_COUNT);
+    if (write(sock, line, len) != len) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* run_mode()
+ * ----------
+ * Opens idle subscribers in steps and prints the server's resident memory
+ * per connection at each step. Steps that need more file descriptors than
+ * this process may open are skipped.
+ *
+ * path: the psserver executable
+ *
+ * readers: the value of --readers, where 0 gives every client a thread
+ *
+ * steps: the number of connections to measure at, in increasing order
+ *
+ * stepCount: the number of steps
+ *
+ * fdLimit: the number of file descriptors each process may open
+ */
+void run_mode(char* path, int readers, int* steps, int stepCount,
+        long fdLimit) {
+    char connectionsArg[PATH_SIZE];
+    char readersArg[PATH_SIZE];
+    snprintf(connectionsArg, PATH_SIZE, "%d",
+            steps[stepCount - 1] + SPARE_FDS);
+    snprintf(readersArg, PATH_SIZE, "%d", readers);
+    char* args[] = {path, connectionsArg, "--readers", readersArg, NULL};
+    Server server;
+    if (!start_server(args, &server)) {
+        fprintf(stderr, "idle_bench: unable to start %s\n", path);
+        exit(1);
+    }
+    read_sub_count(&server);
+    long baseline = read_rss(server.pid);
+    int* socks = malloc(sizeof(int) * steps[stepCount - 1]);
+    int open = 0;
+
+    for (int i = 0; i < stepCount; i++) {
+        if (steps[i] + SPARE_FDS > fdLimit) {
+            printf("%-8d %12d %12s %12s  skipped, file descriptor limit is "
+                    "%ld\n", readers, steps[i], "-", "-", fdLimit);
+            continue;
+        }
+        while (open < steps[i] &&
+                (socks[open] = open_connection(server.port, open)) >= 0) {
+            open++;
+        }
+        if (open < steps[i] || !wait_for_subs(&server, open)) {
+            printf("%-8d %12d %12s %12s  stopped after %d connections\n",
+                    readers, steps[i], "-", "-", open);
+            break;
+        }
+        long rss = read_rss(server.pid);
+        printf("%-8d %12d %12.1f %12ld\n", readers, open, rss / MEGABYTE,
+                (rss - baseline) / open);
+        fflush(stdout);
+    }
+
+    stop_server(&server);
+    for (int i = 0; i < open; i++) {
+        close(socks[i]);
+    }
+    free(socks);
+}
+
+/* compare_ints()
+ * --------------
+ * qsort() comparison function for ints
+ */
+int compare_ints(const void* a, const void* b) {
+    int x = *(const int*) a;
+    int y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+/* main()
+ * ------
+ * Measures how much resident memory psserver needs for each idle subscriber,
+ * first with a thread per client and then with a single reader loop. Each
+ * connection names itself and subscribes to one of TOPIC_COUNT topics.
+ *
+ * Usage: idle_bench [psserver] [connections...]
+ *
+ * The connection counts default to 10000, 50000 and 100000. The file
+ * descriptor limit is raised as far as the hard limit allows, and counts
+ * beyond it are skipped.
+ */
+int main(int argc, char** argv) {
+    char* path = argc > 1 ? argv[1] : DEFAULT_SERVER;
+    int steps[MAX_STEPS] = {10000, 50000, 100000};
+    int stepCount = 3;
+    if (argc > 2) {
+        stepCount = 0;
+        for (int i = 2; i < argc && stepCount < MAX_STEPS; i++) {
+            steps[stepCount++] = atoi(argv[i]);
+        }
+        qsort(steps, stepCount, sizeof(int), compare_ints);
+    }
+
+    //The server inherits the raised limit
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-8s %12s %12s %12s\n", "readers", "connections", "rss(MB)",
+            "bytes/conn");
+    run_mode(path, 0, steps, stepCount, limit.rlim_cur);
+    run_mode(path, 1, steps, stepCount, limit.rlim_cur);
+    return 0;
+}
@@ -0,0 +1,308 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "benchUtil.h"
+
+#define DEFAULT_SERVER "./psserver"
+#define SUBSCRIBERS 32
+#define LATENCY_MESSAGES 1000
+#define LATENCY_GAP_MICROS 1000
+#define THROUGHPUT_MESSAGES 200000
+#define PUBLISH_BATCH 256
+#define LINE_SIZE 128
+#define ARG_SIZE 32
+#define READ_SIZE 65536
+#define NANOS_PER_MICRO 1000L
+#define MICROSECONDS 1000.0
+#define PERCENTILE 99
+
+//One subscriber's connection and what it has received. The first
+//subscriber also records the latency of each message, whose value is the
+//time it was published.
+typedef struct {
+    int sock;
+    long lines;
+    long reads;
+    long bytes;
+    bool timed;
+    long* latencies;
+    int latencyCount;
+    char partial[LINE_SIZE];
+    int partialLen;
+} Subscriber;
+
+/* connect_client()
+ * ----------------
+ * Connects to the server and sends the first commands
+ *
+ * port: the server's port
+ *
+ * commands: the commands to send
+ *
+ * Returns: the connected socket, or -1 if it could not be opened
+ */
+int connect_client(int port, char* commands) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (struct sockaddr*) &address, sizeof(address)) ||
+            write(sock, commands, strlen(commands)) !=
+            (ssize_t) strlen(commands)) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* read_out_segments()
+ * -------------------
+ * Returns: the number of TCP segments this host has sent, from
+ * /proc/net/snmp, or 0 if it cannot be read
+ */
+long read_out_segments(void) {
+    FILE* snmp = fopen("/proc/net/snmp", "r");
+    if (!snmp) {
+        return 0;
+    }
+    char names[READ_SIZE / 16];
+    char values[READ_SIZE / 16];
+    long segments = 0;
+    while (fgets(names, sizeof(names), snmp) &&
+            fgets(values, sizeof(values), snmp)) {
+        if (strncmp(names, "Tcp:", strlen("Tcp:"))) {
+            continue;
+        }
+        //Find the column of OutSegs in the header line
+        char* nameSave;
+        char* valueSave;
+        char* name = strtok_r(names, " \n", &nameSave);
+        char* value = strtok_r(values, " \n", &valueSave);
+        while (name && value) {
+            if (!strcmp(name, "OutSegs")) {
+                segments = atol(value);
+            }
+            name = strtok_r(NULL, " \n", &nameSave);
+            value = strtok_r(NULL, " \n", &valueSave);
+        }
+    }
+    fclose(snmp);
+    return segments;
+}
+
+/* record_lines()
+ * --------------
+ * Records the latency of each whole line received by the timed subscriber.
+ * A line is "name:topic:<publish time>".
+ *
+ * subscriber: the subscriber
+ *
+ * data: the bytes received
+ *
+ * len: the number of bytes received
+ */
+void record_lines(Subscriber* subscriber, char* data, ssize_t len) {
+    long now = now_nanos();
+    for (ssize_t i = 0; i < len; i++) {
+        if (data[i] != '\n') {
+            if (subscriber->partialLen < LINE_SIZE - 1) {
+                subscriber->partial[subscriber->partialLen++] = data[i];
+            }
+            continue;
+        }
+        subscriber->partial[subscriber->partialLen] = '\0';
+        char* value = strrchr(subscriber->partial, ':');
+        if (value && subscriber->latencyCount < LATENCY_MESSAGES) {
+            subscriber->latencies[subscriber->latencyCount++] = now -
+                    atol(value + 1);
+        }
+        subscriber->partialLen = 0;
+    }
+}
+
+/* subscriber_thread()
+ * -------------------
+ * Reads everything sent to a subscriber until the connection is closed
+ *
+ * arg: a pointer to the Subscriber struct
+ */
+void* subscriber_thread(void* arg) {
+    Subscriber* subscriber = arg;
+    char* data = malloc(READ_SIZE);
+    ssize_t len;
+    while ((len = read(subscriber->sock, data, READ_SIZE)) > 0) {
+        long lines = 0;
+        for (ssize_t i = 0; i < len; i++) {
+            lines += data[i] == '\n';
+        }
+        if (subscriber->timed) {
+            record_lines(subscriber, data, len);
+        }
+        subscriber->reads++;
+        subscriber->bytes += len;
+        __atomic_add_fetch(&subscriber->lines, lines, __ATOMIC_RELEASE);
+    }
+    free(data);
+    return NULL;
+}
+
+/* wait_for_lines()
+ * ----------------
+ * Waits until every subscriber has received the given number of lines
+ */
+void wait_for_lines(Subscriber* subscribers, long expected) {
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        while (__atomic_load_n(&subscribers[i].lines, __ATOMIC_ACQUIRE) <
+                expected) {
+            sleep_nanos(NANOS_PER_MICRO * 100);
+        }
+    }
+}
+
+/* publish_timed()
+ * ---------------
+ * Publishes messages whose value is the time they are published
+ *
+ * sock: the publisher's socket
+ *
+ * count: the number of messages to publish
+ *
+ * batch: the number of messages written at once
+ *
+ * gap: the time to wait between writes, in nanoseconds
+ */
+void publish_timed(int sock, int count, int batch, long gap) {
+    char* buffer = malloc(LINE_SIZE * batch);
+    for (int sent = 0; sent < count; sent += batch) {
+        int len = 0;
+        long now = now_nanos();
+        for (int i = 0; i < batch && sent + i < count; i++) {
+            len += snprintf(buffer + len, LINE_SIZE, "pub bench %ld\n", now);
+        }
+        if (write(sock, buffer, len) != len) {
+            break;
+        }
+        if (gap) {
+            sleep_nanos(gap);
+        }
+    }
+    free(buffer);
+}
+
+/* run_profile()
+ * -------------
+ * Measures one profile. The latency of single messages published one at a
+ * time is measured first, then a burst of messages is published as fast as
+ * the publisher can write them and the rate they reach every subscriber is
+ * measured along with the TCP segments sent for them.
+ *
+ * path: the psserver executable
+ *
+ * profile: the value of --profile
+ *
+ * flushDelay: the value of --flushdelay, or NULL to use the profile's
+ */
+void run_profile(char* path, char* profile, char* flushDelay) {
+    char* args[] = {path, "0", "--profile", profile,
+            flushDelay ? "--flushdelay" : NULL, flushDelay, NULL};
+    Server server;
+    if (!start_server(args, &server)) {
+        fprintf(stderr, "profile_bench: unable to start %s\n", path);
+        exit(1);
+    }
+    Subscriber subscribers[SUBSCRIBERS];
+    pthread_t threadIds[SUBSCRIBERS];
+    memset(subscribers, 0, sizeof(subscribers));
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        char commands[LINE_SIZE];
+        snprintf(commands, LINE_SIZE, "name sub%d\nsub bench\n", i);
+        subscribers[i].sock = connect_client(server.port, commands);
+        subscribers[i].timed = i == 0;
+        subscribers[i].latencies = i == 0 ?
+                malloc(sizeof(long) * LATENCY_MESSAGES) : NULL;
+        pthread_create(&threadIds[i], NULL, subscriber_thread,
+                &subscribers[i]);
+    }
+    int publisher = connect_client(server.port, "name pubber\n");
+    if (publisher < 0 || !wait_for_subs(&server, SUBSCRIBERS)) {
+        fprintf(stderr, "profile_bench: subscribers did not connect\n");
+        exit(1);
+    }
+
+    publish_timed(publisher, LATENCY_MESSAGES, 1,
+            LATENCY_GAP_MICROS * NANOS_PER_MICRO);
+    wait_for_lines(subscribers, LATENCY_MESSAGES);
+    long* latencies = subscribers[0].latencies;
+    qsort(latencies, LATENCY_MESSAGES, sizeof(long), compare_longs);
+
+    long reads = 0;
+    long bytes = 0;
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        reads -= subscribers[i].reads;
+        bytes -= subscribers[i].bytes;
+    }
+    long segments = read_out_segments();
+    long start = now_nanos();
+    publish_timed(publisher, THROUGHPUT_MESSAGES, PUBLISH_BATCH, 0);
+    wait_for_lines(subscribers, LATENCY_MESSAGES + THROUGHPUT_MESSAGES);
+    double seconds = (double) (now_nanos() - start) / NANOSECONDS;
+    segments = read_out_segments() - segments;
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        reads += subscribers[i].reads;
+        bytes += subscribers[i].bytes;
+    }
+
+    printf("%-12s %8s %10.1f %10.1f %12.0f %12.2f %12.0f\n", profile,
+            flushDelay ? flushDelay : "default",
+            latencies[LATENCY_MESSAGES / 2] / MICROSECONDS,
+            latencies[LATENCY_MESSAGES * PERCENTILE / 100] / MICROSECONDS,
+            (double) THROUGHPUT_MESSAGES * SUBSCRIBERS / seconds,
+            (double) segments * 1000 /
+            ((double) THROUGHPUT_MESSAGES * SUBSCRIBERS),
+            (double) bytes / reads);
+    fflush(stdout);
+
+    stop_server(&server);
+    close(publisher);
+    for (int i = 0; i < SUBSCRIBERS; i++) {
+        pthread_join(threadIds[i], NULL);
+        close(subscribers[i].sock);
+    }
+    free(subscribers[0].latencies);
+}
+
+/* main()
+ * ------
+ * Compares psserver's latency and throughput profiles with SUBSCRIBERS
+ * subscribers on one topic. For each profile it prints the median and 99th
+ * percentile latency of messages published one at a time, the rate messages
+ * reach subscribers during a burst, the TCP segments sent per thousand
+ * messages delivered in the burst and the bytes each read by a subscriber
+ * returned. Segments are counted for the whole host, so other traffic adds
+ * to them.
+ *
+ * Usage: profile_bench [psserver] [flushdelay...]
+ *
+ * Each flush delay given is also measured with the throughput profile.
+ */
+int main(int argc, char** argv) {
+    char* path = argc > 1 ? argv[1] : DEFAULT_SERVER;
+    signal(SIGPIPE, SIG_IGN);
+    printf("%-12s %8s %10s %10s %12s %12s %12s\n", "profile", "delay(us)",
+            "p50(us)", "p99(us)", "msgs/s", "segs/1k", "bytes/read");
+    run_profile(path, "latency", NULL);
+    run_profile(path, "throughput", NULL);
+    for (int i = 2; i < argc; i++) {
+        run_profile(path, "throughput", argv[i]);
+    }
+    return 0;
+}
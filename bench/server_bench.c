@@ -0,0 +1,928 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "stringmap.h"
+
+//The benchmark is built with server.c itself so that its commands can be run
+//on fake clients from this thread, without connections or client threads
+#define main psserver_main
+#include "../server.c"
+#undef main
+
+#define BENCH_NANOS 20000000L
+#define REPEATS 5
+#define ATTEMPTS 3
+#define MIN_ROUNDS 16
+#define MAX_ROUNDS (1L << 24)
+#define MAX_QUEUED_BYTES (64L * 1024 * 1024)
+#define MESSAGE_OVERHEAD 64
+#define NS_TOLERANCE 2.0
+#define NS_SLACK 10
+#define ALLOC_TOLERANCE 0.5
+#define CASE_NAME_SIZE 64
+#define KEY_SIZE 32
+#define LINE_SIZE 128
+#define DRAIN_SIZE 65536
+#define DRAIN_EVENTS 64
+#define SETTLE_MICROS 100
+#define SAVE_OPTION "--save"
+#define BENCH_TOPIC "bench/0"
+#define BASELINE_HEADER "# case ns/op allocs/op, rewritten by make " \
+        "benchbaseline\n"
+
+//Allocations made by each thread, counted by the malloc below so that the
+//sender's and the drain thread's are left out
+__thread long allocationCount;
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+    allocationCount++;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocationCount++;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocationCount++;
+    return __libc_realloc(ptr, size);
+}
+
+//CPU time and allocations spent on the operation being measured. An
+//operation that needs setup for each round only measures part of each round.
+typedef struct {
+    uint64_t nanos;
+    long allocations;
+    uint64_t startedAt;
+    long startAllocations;
+} Cost;
+
+//One operation to measure, given the state set up for it. maxRounds keeps
+//the messages a publish leaves queued for the sender within bounds.
+typedef struct {
+    char name[CASE_NAME_SIZE];
+    void (*run)(void* state, long rounds, Cost* cost);
+    void* state;
+    long maxRounds;
+} Case;
+
+//The cost of one operation, as measured or as read from the baseline
+typedef struct {
+    char name[CASE_NAME_SIZE];
+    double nanos;
+    double allocations;
+} Result;
+
+//Every result measured so far
+typedef struct {
+    Result* results;
+    int count;
+    int size;
+} Results;
+
+//The server commands are run on and the epoll instance the drain thread
+//reads the other end of every fake client's socket from
+typedef struct {
+    Server* server;
+    int drainFd;
+} Bench;
+
+//A string map holding count keys
+typedef struct {
+    StringMap* map;
+    char (*keys)[KEY_SIZE];
+    int count;
+} MapState;
+
+//A client list holding count clients, and one more client to add and remove
+typedef struct {
+    Node* list;
+    Client* clients;
+    int count;
+    Client extra;
+} ListState;
+
+//Fake clients subscribed to a server's topics. actor runs the commands,
+//subscribers are subscribed to BENCH_TOPIC and idle is subscribed to the
+//other topics so that they stay in the table.
+typedef struct {
+    Bench* bench;
+    ClientThreadInfo* actor;
+    ClientThreadInfo** subscribers;
+    int subscriberCount;
+    ClientThreadInfo* idle;
+    int topicCount;
+    char* line;
+    char* buffer;
+} ServerState;
+
+/* thread_nanos()
+ * --------------
+ * Returns: the CPU time used by the calling thread in nanoseconds. Time the
+ * sender and the drain thread spend running on the same CPU is left out.
+ */
+uint64_t thread_nanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (uint64_t) now.tv_sec * NANOSECONDS + now.tv_nsec;
+}
+
+/* begin_cost()
+ * ------------
+ * Starts measuring part of a round
+ *
+ * cost: the cost of the rounds so far
+ */
+void begin_cost(Cost* cost) {
+    cost->startAllocations = allocationCount;
+    cost->startedAt = thread_nanos();
+}
+
+/* end_cost()
+ * ----------
+ * Adds the time and allocations since begin_cost() to a cost
+ *
+ * cost: the cost of the rounds so far
+ */
+void end_cost(Cost* cost) {
+    cost->nanos += thread_nanos() - cost->startedAt;
+    cost->allocations += allocationCount - cost->startAllocations;
+}
+
+/* drain_clients()
+ * ---------------
+ * Reads and throws away everything the sender writes to the fake clients,
+ * closing each client's end once the server has closed its own
+ *
+ * arg: the epoll file descriptor watching the clients' ends
+ *
+ * Returns: never returns
+ */
+void* drain_clients(void* arg) {
+    int epollFd = *(int*) arg;
+    char* buffer = malloc(DRAIN_SIZE);
+    struct epoll_event events[DRAIN_EVENTS];
+    while (true) {
+        int ready = epoll_wait(epollFd, events, DRAIN_EVENTS, -1);
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (read(fd, buffer, DRAIN_SIZE) <= 0) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* start_server()
+ * --------------
+ * Sets up a server the way main() does, apart from listening for
+ * connections, with no delivery workers so that a publish does all of its
+ * work on the thread that is measuring it
+ *
+ * Returns: the server
+ */
+Server* start_server(void) {
+    char* argv[] = {"psserver", "0", NULL};
+    Params* params = malloc(sizeof(Params));
+    validate_commands(2, argv, params);
+    params->workers = 0;
+
+    Server* server = malloc(sizeof(Server));
+    memset(server, 0, sizeof(Server));
+    server->params = params;
+    server->lock = malloc(sizeof(FairLock));
+    fair_lock_init(server->lock);
+    server->epoch = malloc(sizeof(EpochDomain));
+    init_epoch_domain(server->epoch);
+    server->topics = malloc(sizeof(TopicTable));
+    init_topic_table(server->topics, server->epoch);
+    server->timerReader = register_reader(server->epoch);
+
+    Stats* stats = malloc(sizeof(Stats));
+    init_stats(stats, params->connections);
+    stats->topics = server->topics;
+    stats->epoch = server->epoch;
+    stats->hot = malloc(sizeof(HotTopics));
+    init_hot_topics(stats->hot);
+    stats->lockStat = malloc(sizeof(pthread_mutex_t));
+    pthread_mutex_init(stats->lockStat, NULL);
+    server->stats = stats;
+
+    server->trace = malloc(sizeof(TraceLog));
+    init_trace_log(server->trace);
+    stats->trace = server->trace;
+    server->sender = malloc(sizeof(Sender));
+    init_sender(server->sender, server->trace, params->profile,
+            params->flushDelay, &params->priorities.policy);
+    stats->sender = server->sender;
+    server->wheel = malloc(sizeof(TimerWheel));
+    init_timer_wheel(server->wheel);
+    stats->wheel = server->wheel;
+    server->pool = malloc(sizeof(DeliveryPool));
+    init_delivery_pool(server->pool, params->workers);
+
+    HandoffState* handoff = malloc(sizeof(HandoffState));
+    handoff->frozen = false;
+    handoff->threads = 1;
+    handoff->parked = 0;
+    pthread_mutex_init(&handoff->lock, NULL);
+    pthread_cond_init(&handoff->changed, NULL);
+    handoff->acceptThread = pthread_self();
+    handoff->listenFd = -1;
+    server->handoff = handoff;
+    return server;
+}
+
+/* fake_client()
+ * -------------
+ * Connects a named client to the server through a socket pair, set up as
+ * start_client() would set up a client with a thread of its own
+ *
+ * bench: the benchmark
+ *
+ * name: the client's name
+ *
+ * Returns: the client
+ */
+ClientThreadInfo* fake_client(Bench* bench, char* name) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("server_bench: socketpair");
+        exit(1);
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fds[1];
+    epoll_ctl(bench->drainFd, EPOLL_CTL_ADD, fds[1], &event);
+
+    Server* server = bench->server;
+    ClientThreadInfo* cti = init_client(server, fds[0]);
+    cti->tracer = register_tracer(server->trace, "bench");
+    name_client(cti, name);
+    pthread_mutex_lock(&server->handoff->lock);
+    server->handoff->threads++;
+    pthread_mutex_unlock(&server->handoff->lock);
+    Stats* stats = server->stats;
+    pthread_mutex_lock(stats->lockStat);
+    stats->currentClientCount++;
+    if (!stats->clients) {
+        stats->clients = init_client_list(cti->client);
+    } else {
+        add_client(stats->clients, cti->client);
+    }
+    pthread_mutex_unlock(stats->lockStat);
+    return cti;
+}
+
+/* topic_name()
+ * ------------
+ * Names one of the benchmark's topics, where topic 0 is BENCH_TOPIC
+ *
+ * name: where to put the name, which has room for KEY_SIZE characters
+ *
+ * index: the topic's number
+ */
+void topic_name(char* name, int index) {
+    snprintf(name, KEY_SIZE, "bench/%d", index);
+}
+
+/* wait_for_sender()
+ * -----------------
+ * Waits until the sender has written every message queued for a client
+ *
+ * cti: the client
+ */
+void wait_for_sender(ClientThreadInfo* cti) {
+    while (__atomic_load_n(&cti->client->queue.length, __ATOMIC_ACQUIRE)) {
+        usleep(SETTLE_MICROS);
+    }
+}
+
+/* init_server_state()
+ * -------------------
+ * Connects the fake clients for a case and subscribes them. The actor is not
+ * subscribed to anything.
+ *
+ * state: the state to set up
+ *
+ * bench: the benchmark
+ *
+ * topicCount: the number of topics in the table, at least one
+ *
+ * subscriberCount: the number of clients subscribed to BENCH_TOPIC
+ */
+void init_server_state(ServerState* state, Bench* bench, int topicCount,
+        int subscriberCount) {
+    memset(state, 0, sizeof(ServerState));
+    state->bench = bench;
+    state->topicCount = topicCount;
+    state->subscriberCount = subscriberCount;
+    state->actor = fake_client(bench, "actor");
+    state->idle = fake_client(bench, "idle");
+    char topic[KEY_SIZE];
+    for (int i = 1; i < topicCount; i++) {
+        topic_name(topic, i);
+        subscribe(state->idle, topic, false);
+    }
+    state->subscribers = malloc(sizeof(ClientThreadInfo*) *
+            (subscriberCount + 1));
+    for (int i = 0; i < subscriberCount; i++) {
+        state->subscribers[i] = fake_client(bench, "subscriber");
+        subscribe(state->subscribers[i], BENCH_TOPIC, false);
+    }
+}
+
+/* free_server_state()
+ * -------------------
+ * Disconnects a case's fake clients, which leaves the topic table empty
+ *
+ * state: the state
+ */
+void free_server_state(ServerState* state) {
+    for (int i = 0; i < state->subscriberCount; i++) {
+        wait_for_sender(state->subscribers[i]);
+        clean_up_client(state->subscribers[i]);
+    }
+    clean_up_client(state->idle);
+    clean_up_client(state->actor);
+    free(state->subscribers);
+    free(state->line);
+    free(state->buffer);
+}
+
+/* run_map_search()
+ * ----------------
+ * Looks up each key of a string map in turn
+ */
+void run_map_search(void* arg, long rounds, Cost* cost) {
+    MapState* state = arg;
+    long missing = 0;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        missing += !stringmap_search(state->map, state->keys[i %
+                state->count]);
+    }
+    end_cost(cost);
+    if (missing) {
+        fprintf(stderr, "server_bench: stringmap lost a key\n");
+    }
+}
+
+/* run_map_add()
+ * -------------
+ * Adds a new key to a string map and removes it again
+ */
+void run_map_add(void* arg, long rounds, Cost* cost) {
+    MapState* state = arg;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        stringmap_add(state->map, "bench/new", state);
+        stringmap_remove(state->map, "bench/new");
+    }
+    end_cost(cost);
+}
+
+/* run_list_search()
+ * -----------------
+ * Looks for each client of a client list in turn
+ */
+void run_list_search(void* arg, long rounds, Cost* cost) {
+    ListState* state = arg;
+    long missing = 0;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        missing += !in_list(state->list, &state->clients[i % state->count]);
+    }
+    end_cost(cost);
+    if (missing) {
+        fprintf(stderr, "server_bench: client list lost a client\n");
+    }
+}
+
+/* run_list_add()
+ * --------------
+ * Adds a client to the end of a client list and removes it again
+ */
+void run_list_add(void* arg, long rounds, Cost* cost) {
+    ListState* state = arg;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        add_client(state->list, &state->extra);
+        state->list = remove_from_list(state->list, &state->extra);
+    }
+    end_cost(cost);
+}
+
+/* run_validate()
+ * --------------
+ * Validates the case's command line
+ */
+void run_validate(void* arg, long rounds, Cost* cost) {
+    ServerState* state = arg;
+    long invalid = 0;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        invalid += validate_cmd(state->line) == INVALID_COMMAND;
+    }
+    end_cost(cost);
+    if (invalid) {
+        fprintf(stderr, "server_bench: %s was invalid\n", state->line);
+    }
+}
+
+/* run_subscribe()
+ * ---------------
+ * Subscribes the actor to BENCH_TOPIC and unsubscribes it again, taking the
+ * subscription lock as handle_command() does
+ */
+void run_subscribe(void* arg, long rounds, Cost* cost) {
+    ServerState* state = arg;
+    char topic[KEY_SIZE] = BENCH_TOPIC;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        lock_subscriptions(state->actor);
+        subscribe(state->actor, topic, false);
+        unlock_subscriptions(state->actor);
+        lock_subscriptions(state->actor);
+        unsubscribe(state->actor, topic);
+        unlock_subscriptions(state->actor);
+    }
+    end_cost(cost);
+}
+
+/* run_publish()
+ * -------------
+ * Publishes the case's command line from the actor, then waits outside the
+ * measurement for the sender to write out what was queued
+ */
+void run_publish(void* arg, long rounds, Cost* cost) {
+    ServerState* state = arg;
+    size_t len = strlen(state->line) + 1;
+    begin_cost(cost);
+    for (long i = 0; i < rounds; i++) {
+        memcpy(state->buffer, state->line, len);
+        publish(state->actor, state->buffer);
+    }
+    end_cost(cost);
+    for (int i = 0; i < state->subscriberCount; i++) {
+        wait_for_sender(state->subscribers[i]);
+    }
+}
+
+/* run_clean_up()
+ * --------------
+ * Connects a client subscribed to every topic, then measures only
+ * clean_up_client() disconnecting it
+ */
+void run_clean_up(void* arg, long rounds, Cost* cost) {
+    ServerState* state = arg;
+    char topic[KEY_SIZE];
+    for (long i = 0; i < rounds; i++) {
+        ClientThreadInfo* cti = fake_client(state->bench, "leaving");
+        for (int j = 0; j < state->topicCount; j++) {
+            topic_name(topic, j);
+            subscribe(cti, topic, false);
+        }
+        begin_cost(cost);
+        clean_up_client(cti);
+        end_cost(cost);
+    }
+}
+
+/* measure()
+ * ---------
+ * Measures a case. The number of rounds is doubled until they take a
+ * worthwhile time, then the fastest of REPEATS runs is kept.
+ *
+ * test: the case
+ *
+ * Returns: the case's cost per operation
+ */
+Result measure(Case* test) {
+    long rounds = MIN_ROUNDS;
+    Cost cost = {0, 0, 0, 0};
+    test->run(test->state, rounds, &cost);
+    while (cost.nanos < BENCH_NANOS / REPEATS && rounds * 2 <=
+            test->maxRounds) {
+        rounds *= 2;
+        memset(&cost, 0, sizeof(Cost));
+        test->run(test->state, rounds, &cost);
+    }
+
+    Result result;
+    strcpy(result.name, test->name);
+    result.nanos = -1;
+    result.allocations = -1;
+    for (int i = 0; i < REPEATS; i++) {
+        memset(&cost, 0, sizeof(Cost));
+        test->run(test->state, rounds, &cost);
+        double nanos = (double) cost.nanos / rounds;
+        double allocations = (double) cost.allocations / rounds;
+        if (result.nanos < 0 || nanos < result.nanos) {
+            result.nanos = nanos;
+        }
+        if (result.allocations < 0 || allocations < result.allocations) {
+            result.allocations = allocations;
+        }
+    }
+    return result;
+}
+
+/* find_result()
+ * -------------
+ * Finds a case's result by name
+ *
+ * results: the results
+ *
+ * name: the case's name
+ *
+ * Returns: the result, or NULL if there is none
+ */
+Result* find_result(Results* results, char* name) {
+    for (int i = 0; results && i < results->count; i++) {
+        if (!strcmp(results->results[i].name, name)) {
+            return &results->results[i];
+        }
+    }
+    return NULL;
+}
+
+/* add_result()
+ * ------------
+ * Adds a result to a list of results
+ *
+ * results: the results
+ *
+ * result: the result to add
+ */
+void add_result(Results* results, Result result) {
+    if (results->count == results->size) {
+        results->size = results->size ? results->size * 2 : MIN_ROUNDS;
+        results->results = realloc(results->results,
+                sizeof(Result) * results->size);
+    }
+    results->results[results->count++] = result;
+}
+
+/* is_regressed()
+ * --------------
+ * Compares a result with its baseline
+ *
+ * result: the result
+ *
+ * base: the baseline result for the same case
+ *
+ * Returns: true if the case is slower than NS_TOLERANCE times its baseline
+ * plus NS_SLACK, which allows for the few nanoseconds the shortest
+ * operations vary by between runs, or makes more than ALLOC_TOLERANCE more
+ * allocations per operation
+ */
+bool is_regressed(Result* result, Result* base) {
+    return result->nanos > base->nanos * NS_TOLERANCE + NS_SLACK ||
+            result->allocations > base->allocations + ALLOC_TOLERANCE;
+}
+
+/* report()
+ * --------
+ * Measures a case, prints its cost next to its baseline and records it. A
+ * case that looks to have regressed is measured up to ATTEMPTS times in all
+ * and its best result kept, so that one slow measurement on a busy machine
+ * does not fail the run.
+ *
+ * test: the case
+ *
+ * results: the results measured so far
+ *
+ * baseline: the results to compare with, or NULL when saving a baseline
+ *
+ * Returns: true if the case has regressed
+ */
+bool report(Case* test, Results* results, Results* baseline) {
+    if (!test->maxRounds) {
+        test->maxRounds = MAX_ROUNDS;
+    }
+    Result result = measure(test);
+    Result* base = find_result(baseline, result.name);
+    for (int i = 1; base && i < ATTEMPTS && is_regressed(&result, base);
+            i++) {
+        Result retry = measure(test);
+        result.nanos = retry.nanos < result.nanos ? retry.nanos :
+                result.nanos;
+        result.allocations = retry.allocations < result.allocations ?
+                retry.allocations : result.allocations;
+    }
+    add_result(results, result);
+    if (!base) {
+        printf("%-36s %10.1f %10.2f %10s %10s %s\n", result.name,
+                result.nanos, result.allocations, "-", "-",
+                baseline ? "new" : "");
+        fflush(stdout);
+        return false;
+    }
+    bool regressed = is_regressed(&result, base);
+    printf("%-36s %10.1f %10.2f %10.1f %10.2f %s\n", result.name,
+            result.nanos, result.allocations, base->nanos,
+            base->allocations, regressed ? "REGRESSED" : "ok");
+    fflush(stdout);
+    return regressed;
+}
+
+/* bench_stringmap()
+ * -----------------
+ * Measures looking up keys in, and adding keys to, string maps of 16, 256
+ * and 4096 keys
+ *
+ * Returns: the number of cases that regressed
+ */
+int bench_stringmap(Results* results, Results* baseline) {
+    int regressed = 0;
+    for (int count = 16; count <= 4096; count *= 16) {
+        MapState state;
+        state.map = stringmap_init();
+        state.count = count;
+        state.keys = malloc(KEY_SIZE * count);
+        for (int i = 0; i < count; i++) {
+            topic_name(state.keys[i], i);
+            stringmap_add(state.map, state.keys[i], &state);
+        }
+        Case search = {"", run_map_search, &state, 0};
+        snprintf(search.name, CASE_NAME_SIZE, "stringmap/search/keys=%d",
+                count);
+        regressed += report(&search, results, baseline);
+        Case add = {"", run_map_add, &state, 0};
+        snprintf(add.name, CASE_NAME_SIZE, "stringmap/add+remove/keys=%d",
+                count);
+        regressed += report(&add, results, baseline);
+        stringmap_free(state.map);
+        free(state.keys);
+    }
+    return regressed;
+}
+
+/* bench_client_list()
+ * -------------------
+ * Measures finding clients in, and adding clients to, client lists of 16,
+ * 256 and 4096 clients
+ *
+ * Returns: the number of cases that regressed
+ */
+int bench_client_list(Results* results, Results* baseline) {
+    int regressed = 0;
+    for (int count = 16; count <= 4096; count *= 16) {
+        ListState state;
+        state.count = count;
+        state.clients = calloc(count, sizeof(Client));
+        state.list = init_client_list(&state.clients[0]);
+        for (int i = 1; i < count; i++) {
+            add_client(state.list, &state.clients[i]);
+        }
+        Case search = {"", run_list_search, &state, 0};
+        snprintf(search.name, CASE_NAME_SIZE, "clientlist/in_list/"
+                "clients=%d", count);
+        regressed += report(&search, results, baseline);
+        Case add = {"", run_list_add, &state, 0};
+        snprintf(add.name, CASE_NAME_SIZE, "clientlist/add+remove/"
+                "clients=%d", count);
+        regressed += report(&add, results, baseline);
+        while (state.list) {
+            state.list = remove_from_list(state.list, state.list->client);
+        }
+        free(state.clients);
+    }
+    return regressed;
+}
+
+/* bench_validate()
+ * ----------------
+ * Measures validating subscribes, an unsubscribe and publishes of 16, 1024
+ * and 65536 byte values
+ *
+ * Returns: the number of cases that regressed
+ */
+int bench_validate(Results* results, Results* baseline) {
+    char* lines[][2] = {{"sub", "sub bench/0"},
+            {"sub-where", "sub bench/0 where field sym AAPL"},
+            {"unsub", "unsub bench/0"}};
+    int regressed = 0;
+    ServerState state;
+    for (int i = 0; i < (int) (sizeof(lines) / sizeof(lines[0])); i++) {
+        state.line = lines[i][1];
+        Case test = {"", run_validate, &state, 0};
+        snprintf(test.name, CASE_NAME_SIZE, "validate_cmd/%s", lines[i][0]);
+        regressed += report(&test, results, baseline);
+    }
+    for (int size = 16; size <= 65536; size *= 64) {
+        state.line = malloc(LINE_SIZE + size);
+        int len = sprintf(state.line, "pub %s ", BENCH_TOPIC);
+        memset(state.line + len, 'v', size);
+        state.line[len + size] = '\0';
+        Case test = {"", run_validate, &state, 0};
+        snprintf(test.name, CASE_NAME_SIZE, "validate_cmd/pub/value=%d",
+                size);
+        regressed += report(&test, results, baseline);
+        free(state.line);
+    }
+    return regressed;
+}
+
+/* bench_subscribe()
+ * -----------------
+ * Measures subscribing to and unsubscribing from a topic with 0, 100 and
+ * 1000 other subscribers, in tables of 1 and 1000 topics. With no other
+ * subscribers the topic is added and removed each time.
+ *
+ * Returns: the number of cases that regressed
+ */
+int bench_subscribe(Bench* bench, Results* results, Results* baseline) {
+    int topicCounts[] = {1, 1000};
+    int subscriberCounts[] = {0, 100, 1000};
+    int regressed = 0;
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 3; j++) {
+            ServerState state;
+            init_server_state(&state, bench, topicCounts[i],
+                    subscriberCounts[j]);
+            Case test = {"", run_subscribe, &state, 0};
+            snprintf(test.name, CASE_NAME_SIZE, "sub+unsub/topics=%d/"
+                    "subs=%d", topicCounts[i], subscriberCounts[j]);
+            regressed += report(&test, results, baseline);
+            free_server_state(&state);
+        }
+    }
+    return regressed;
+}
+
+/* bench_publish()
+ * ---------------
+ * Measures publishing 16 and 1024 byte values to 1, 100 and 1000
+ * subscribers, and a 65536 byte value to one subscriber, in a table of 1000
+ * topics
+ *
+ * Returns: the number of cases that regressed
+ */
+int bench_publish(Bench* bench, Results* results, Results* baseline) {
+    int shapes[][2] = {{1, 16}, {1, 1024}, {1, 65536}, {100, 16},
+            {100, 1024}, {1000, 16}, {1000, 1024}};
+    int regressed = 0;
+    for (int i = 0; i < (int) (sizeof(shapes) / sizeof(shapes[0])); i++) {
+        int subscribers = shapes[i][0];
+        int size = shapes[i][1];
+        ServerState state;
+        init_server_state(&state, bench, 1000, subscribers);
+        state.line = malloc(LINE_SIZE + size);
+        state.buffer = malloc(LINE_SIZE + size);
+        int len = sprintf(state.line, "pub %s ", BENCH_TOPIC);
+        memset(state.line + len, 'v', size);
+        state.line[len + size] = '\0';
+        Case test = {"", run_publish, &state,
+                MAX_QUEUED_BYTES / ((long) subscribers *
+                (size + MESSAGE_OVERHEAD))};
+        snprintf(test.name, CASE_NAME_SIZE, "publish/subs=%d/value=%d",
+                subscribers, size);
+        regressed += report(&test, results, baseline);
+        free_server_state(&state);
+    }
+    return regressed;
+}
+
+/* bench_clean_up()
+ * ----------------
+ * Measures disconnecting a client subscribed to every topic of a table of
+ * 1, 100 and 1000 topics
+ *
+ * Returns: the number of cases that regressed
+ */
+int bench_clean_up(Bench* bench, Results* results, Results* baseline) {
+    int topicCounts[] = {1, 100, 1000};
+    int regressed = 0;
+    for (int i = 0; i < 3; i++) {
+        ServerState state;
+        init_server_state(&state, bench, topicCounts[i], 0);
+        Case test = {"", run_clean_up, &state, 0};
+        snprintf(test.name, CASE_NAME_SIZE, "clean_up_client/topics=%d",
+                topicCounts[i]);
+        regressed += report(&test, results, baseline);
+        free_server_state(&state);
+    }
+    return regressed;
+}
+
+/* load_baseline()
+ * ---------------
+ * Reads the results a run is compared with
+ *
+ * path: the baseline file, with a case name, ns/op and allocs/op on each
+ * line and lines starting with # ignored
+ *
+ * baseline: where to put the results
+ *
+ * Returns: true if the file was read and false otherwise
+ */
+bool load_baseline(char* path, Results* baseline) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[LINE_SIZE];
+    while (fgets(line, LINE_SIZE, file)) {
+        Result result;
+        if (line[0] != '#' && sscanf(line, "%63s %lf %lf", result.name,
+                &result.nanos, &result.allocations) == 3) {
+            add_result(baseline, result);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+/* save_baseline()
+ * ---------------
+ * Writes a run's results as the baseline for later runs
+ *
+ * path: the baseline file
+ *
+ * results: the results
+ *
+ * Returns: true if the file was written and false otherwise
+ */
+bool save_baseline(char* path, Results* results) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    fputs(BASELINE_HEADER, file);
+    for (int i = 0; i < results->count; i++) {
+        fprintf(file, "%s %.1f %.2f\n", results->results[i].name,
+                results->results[i].nanos, results->results[i].allocations);
+    }
+    return !fclose(file);
+}
+
+/* main()
+ * ------
+ * Measures the nanoseconds and allocations per operation of the string map,
+ * the client list and the server's command pipeline, and compares them with
+ * a baseline file. Exits with status 1 if any case has regressed, which
+ * fails make bench. With --save the baseline file is rewritten instead.
+ */
+int main(int argc, char** argv) {
+    bool save = argc == 3 && !strcmp(argv[1], SAVE_OPTION);
+    if (argc != 2 && !save) {
+        fprintf(stderr, "Usage: server_bench [--save] baseline\n");
+        return 2;
+    }
+    char* path = argv[argc - 1];
+    Results baseline = {NULL, 0, 0};
+    if (!save && !load_baseline(path, &baseline)) {
+        fprintf(stderr, "server_bench: unable to read baseline %s\n", path);
+        return 2;
+    }
+
+    //Each fake client holds two file descriptors
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    signal(SIGPIPE, SIG_IGN);
+
+    Bench bench;
+    bench.server = start_server();
+    bench.drainFd = epoll_create1(0);
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, drain_clients, &bench.drainFd);
+    pthread_detach(threadId);
+
+    printf("%-36s %10s %10s %10s %10s\n", "case", "ns/op", "allocs/op",
+            "base ns", "base allocs");
+    Results results = {NULL, 0, 0};
+    Results* compare = save ? NULL : &baseline;
+    int regressed = bench_stringmap(&results, compare);
+    regressed += bench_client_list(&results, compare);
+    regressed += bench_validate(&results, compare);
+    regressed += bench_subscribe(&bench, &results, compare);
+    regressed += bench_publish(&bench, &results, compare);
+    regressed += bench_clean_up(&bench, &results, compare);
+
+    if (save) {
+        if (!save_baseline(path, &results)) {
+            fprintf(stderr, "server_bench: unable to write %s\n", path);
+            return 2;
+        }
+        printf("Saved %d cases to %s\n", results.count, path);
+        return 0;
+    }
+    if (regressed) {
+        fprintf(stderr, "server_bench: %d of %d cases regressed against "
+                "%s\n", regressed, results.count, path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../trace.h"
+
+#define EVENTS 10000000
+#define MAX_THREADS 4
+#define NANOSECONDS 1000000000L
+
+//The thread counts measured
+int threadCounts[] = {1, 2, 4};
+
+/* clock_nanos()
+ * -------------
+ * Returns: the current time of the given clock in nanoseconds
+ */
+long clock_nanos(clockid_t clock) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return now.tv_sec * NANOSECONDS + now.tv_nsec;
+}
+
+/* record_thread()
+ * ---------------
+ * Records EVENTS events in a ring of its own, as a server thread does
+ *
+ * arg: a pointer to the TraceLog struct
+ *
+ * Returns: the CPU time the thread spent recording, in nanoseconds
+ */
+void* record_thread(void* arg) {
+    TraceRing* ring = register_tracer(arg, "bench");
+    long start = clock_nanos(CLOCK_THREAD_CPUTIME_ID);
+    for (int i = 0; i < EVENTS; i++) {
+        trace_event(ring, TRACE_WRITE_BEGIN, i, i);
+    }
+    long spent = clock_nanos(CLOCK_THREAD_CPUTIME_ID) - start;
+    unregister_tracer(ring);
+    return (void*) spent;
+}
+
+/* main()
+ * ------
+ * Measures the CPU time taken to record a trace event with one or more 
+ * threads recording at once, and the time taken to dump every ring to a file
+ */
+int main(void) {
+    TraceLog log;
+    init_trace_log(&log);
+    printf("%-8s %12s\n", "threads", "ns/event");
+    for (int i = 0; i < sizeof(threadCounts) / sizeof(int); i++) {
+        pthread_t threads[MAX_THREADS];
+        for (int j = 0; j < threadCounts[i]; j++) {
+            pthread_create(&threads[j], NULL, record_thread, &log);
+        }
+        long spent = 0;
+        for (int j = 0; j < threadCounts[i]; j++) {
+            void* threadSpent;
+            pthread_join(threads[j], &threadSpent);
+            spent += (long) threadSpent;
+        }
+        printf("%-8d %12.1f\n", threadCounts[i], 
+                (double) spent / ((long) EVENTS * threadCounts[i]));
+    }
+
+    char path[TRACE_NAME_SIZE * 4];
+    long start = clock_nanos(CLOCK_MONOTONIC);
+    if (!dump_traces(&log, path, sizeof(path))) {
+        fprintf(stderr, "trace_bench: unable to write %s\n", path);
+        return 1;
+    }
+    printf("dumped %s in %.1fus\n", path,
+            (clock_nanos(CLOCK_MONOTONIC) - start) / 1000.0);
+    remove(path);
+    return 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -8,7 +9,15 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <time.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <csse2310a3.h>  
+#include "deflateFrame.h"
 
 #define NOT_ENOUGH_ARGS_EXIT 1
 #define NAME_POSITION 2
@@ -22,40 +31,109 @@
 #define DEFAULT_PROTOCOL 0
 #define SUCCESSFUL_EXIT 0    
 #define CONNECTION_CLOSED_EXIT 4
+#define RECONNECT_OPTION "--reconnect"
+#define DEFLATE_OPTION "--deflate"
+#define PUMP_OPTION "--pump"
+#define PUMP_BUFFER_SIZE (256 * 1024)
+#define FIRST_RETRY_MILLIS 100
+#define MAX_RETRY_MILLIS 5000
+#define NANOS_PER_MILLI 1000000
+#define MILLIS_PER_SECOND 1000
 
-//Struct holds IO file streams that connect it with server
+//A topic the client is subscribed to. options holds the sub options other
+//than seq and after, and lastSeq is the number of the last message received
+//on the topic, or 0 if none has been.
+typedef struct {
+    char* topic;
+    char* options;
+    uint64_t lastSeq;
+} Subscription;
+
+//Struct holds IO file streams that connect it with server. With reconnect
+//set, the subscriptions are tracked so they can be resumed on a new
+//connection, and lock is held while the streams are in use or replaced. With
+//deflate set the server is asked to compress large messages. With pump set
+//input and output are moved in large blocks and only flushed when idle.
 typedef struct {
     FILE* out;
     FILE* in;
+    bool reconnect;
+    bool deflate;
+    bool pump;
+    char* port;
+    char* name;
+    Subscription* subs;
+    int subCount;
+    pthread_mutex_t lock;
 } InOut;
 
 void validate_args(int argc, char** argv);
 bool is_invalid_name_topic(char* name);
-void initial_communication(int argc, char** argv, FILE* out);
+void initial_communication(int argc, char** argv, InOut* inOut);
 void setup_connection(char* port, InOut* inOut);
+bool open_connection(char* port, InOut* inOut);
 void* handle_out(void* arg);
-void setup_connection(char* port, InOut* inOut);
+void send_command(InOut* inOut, char* line);
+void pump_commands(InOut* inOut);
+void send_commands(InOut* inOut, char* data, size_t len);
+void read_messages(InOut* inOut);
+void pump_messages(InOut* inOut);
+bool splice_messages(int fd);
+void write_all(int fd, char* data, size_t len);
+bool is_idle(int fd);
 void connection_error(char* port);
+void send_sub(InOut* inOut, char* line);
+Subscription* find_subscription(InOut* inOut, char* topic);
+Subscription* track_sub(InOut* inOut, char* line);
+void track_unsub(InOut* inOut, char* line);
+void resume_sub(InOut* inOut, Subscription* sub);
+void handle_message(InOut* inOut, char* line);
+bool handle_frame(InOut* inOut, char* line);
+void send_name(InOut* inOut);
+void reconnect(InOut* inOut);
  
 int main(int argc, char** argv) {
     InOut inOut;
+    inOut.reconnect = false;
+    inOut.deflate = false;
+    inOut.pump = false;
+    while (argc > 1 && (!strcmp(argv[1], RECONNECT_OPTION) || 
+            !strcmp(argv[1], DEFLATE_OPTION) || 
+            !strcmp(argv[1], PUMP_OPTION))) {
+        if (!strcmp(argv[1], RECONNECT_OPTION)) {
+            inOut.reconnect = true;
+            signal(SIGPIPE, SIG_IGN);
+        } else if (!strcmp(argv[1], DEFLATE_OPTION)) {
+            inOut.deflate = true;
+        } else {
+            inOut.pump = true;
+        }
+        //Drop the option so the other arguments are where they are expected
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    inOut.port = argv[PORT_POSITION];
+    inOut.name = argv[NAME_POSITION];
+    inOut.subs = NULL;
+    inOut.subCount = 0;
+    pthread_mutex_init(&inOut.lock, NULL);
     validate_args(argc, argv);
-    setup_connection(argv[PORT_POSITION], &inOut);
-    initial_communication(argc, argv, inOut.out);
+    setup_connection(inOut.port, &inOut);
+    initial_communication(argc, argv, &inOut);
 
     //Listen on stdin and send to server
     pthread_t tid;
     pthread_create(&tid, NULL, handle_out, &inOut);  
     pthread_detach(tid);
     
-    //Listen to socket and send to stdin 
-    char* buffer;
-    while ((buffer = read_line(inOut.in)) != NULL) {
-        printf(buffer);
-        printf("\n");
-        fflush(stdout);
-        free(buffer);
-    } 
+    //Listen to socket and send to stdout. Messages that are printed as they
+    //arrive can be copied across without looking at them.
+    if (inOut.pump && !inOut.reconnect && !inOut.deflate) {
+        pump_messages(&inOut);
+    } else {
+        read_messages(&inOut);
+    }
 
     fprintf(stderr, "psclient: server connection terminated\n");
     fclose(inOut.in);
@@ -76,7 +154,8 @@ int main(int argc, char** argv) {
 void validate_args(int argc, char** argv) {
     //Validate arg count
     if (argc < MIN_ARGS) {
-        fprintf(stderr, "Usage: psclient portnum name [topic] ...\n");
+        fprintf(stderr, "Usage: psclient [--reconnect] [--deflate] [--pump] "
+                "portnum name [topic] ...\n");
         exit(NOT_ENOUGH_ARGS_EXIT);
     }
 
@@ -104,35 +183,58 @@ void validate_args(int argc, char** argv) {
  * inOurt: a pointer to the InOut struct that will be populated
  *
  * Errors: exits with INVALID_PORT_EXIT (3) if the connection fails.
- * References: CSSE2310 week 10 lecture code - net2.c
  */
 void setup_connection(char* port, InOut* inOut) {
+    if (!open_connection(port, inOut)) {
+        connection_error(port);
+    }
+}
+
+/* open_connection()
+ * -----------------
+ * Connects to the server and opens the streams used to talk to it
+ *
+ * port: the port that the server is listening on
+ *
+ * inOut: a pointer to the InOut struct whose streams are set
+ *
+ * Returns: true if the connection was made and false otherwise
+ * References: CSSE2310 week 10 lecture code - net2.c
+ */
+bool open_connection(char* port, InOut* inOut) {
     struct addrinfo* results = 0;
     struct addrinfo hints;
     memset(&hints, 0, sizeof(struct addrinfo));
     hints.ai_family = AF_INET;
     hints.ai_socktype = SOCK_STREAM;
     
-    int err;
-    if ((err = getaddrinfo("localhost", port, &hints, &results))) {
+    if (getaddrinfo("localhost", port, &hints, &results)) {
         freeaddrinfo(results);
-        connection_error(port);
+        return false;
     }
 
     int fd;
     if ((fd = socket(AF_INET, SOCK_STREAM, DEFAULT_PROTOCOL)) < 0) {
-        connection_error(port);
+        freeaddrinfo(results);
+        return false;
     }
     
     if (connect(fd, (struct sockaddr*) results->ai_addr, 
             sizeof(struct sockaddr))) {
-        connection_error(port);
+        freeaddrinfo(results);
+        close(fd);
+        return false;
     }
+    freeaddrinfo(results);
     
     //Seperate into one read and one write FILE*
     int fdCopy = dup(fd);
     inOut->out = fdopen(fd, "w");
     inOut->in = fdopen(fdCopy, "r");
+    if (inOut->pump) {
+        setvbuf(inOut->out, NULL, _IOFBF, PUMP_BUFFER_SIZE);
+    }
+    return true;
 }
 
 /* connection_error()
@@ -169,15 +271,18 @@ bool is_invalid_name_topic(char* line) {
  * argc: the number of command line arguments
  *
  * argv: the command line arguements
+ *
+ * inOut: a pointer to the InOut struct connected to the server
  */
-void initial_communication(int argc, char** argv, FILE* out) {
-    fprintf(out, "name %s\n", argv[NAME_POSITION]);
-    fflush(out);
+void initial_communication(int argc, char** argv, InOut* inOut) {
+    send_name(inOut);
+    fflush(inOut->out);
 
     //Subscribe to prelisted topics
     for (int i = FIRST_TOPIC_POSITION; i < argc; i++) {
-        fprintf(out, "sub %s\n", argv[i]);
-        fflush(out);
+        char line[BUFFER_SIZE];
+        snprintf(line, BUFFER_SIZE, "sub %s", argv[i]);
+        send_sub(inOut, line);
     }
 }
 
@@ -189,15 +294,521 @@ void initial_communication(int argc, char** argv, FILE* out) {
  */
 void* handle_out(void* arg) {
     InOut* inOut = (InOut*) arg;
-    FILE* out = inOut->out;
     char* buffer;
 
-    while((buffer = read_line(stdin)) != NULL) {
-        fprintf(out, buffer);
-        fprintf(out, "\n");
-        fflush(out);
-        free(buffer);
+    if (inOut->pump) {
+        pump_commands(inOut);
+    } else {
+        while ((buffer = read_line(stdin)) != NULL) {
+            pthread_mutex_lock(&inOut->lock);
+            send_command(inOut, buffer);
+            fflush(inOut->out);
+            pthread_mutex_unlock(&inOut->lock);
+            free(buffer);
+        }
     }
-    fclose(out);
+    fclose(inOut->out);
     exit(SUCCESSFUL_EXIT);
 }
+
+/* send_command()
+ * --------------
+ * Sends a line read from stdin to the server. With reconnect set, sub and 
+ * unsub commands are tracked. The stream is only flushed for a sub command.
+ * The lock must be held.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ *
+ * line: the line, without its newline
+ */
+void send_command(InOut* inOut, char* line) {
+    if (inOut->reconnect && !strncmp(line, "sub ", strlen("sub "))) {
+        send_sub(inOut, line);
+        return;
+    }
+    if (inOut->reconnect && !strncmp(line, "unsub ", strlen("unsub "))) {
+        track_unsub(inOut, line);
+    }
+    fprintf(inOut->out, "%s\n", line);
+}
+
+/* pump_commands()
+ * ---------------
+ * Reads stdin in large blocks and sends every complete line in a block to 
+ * the server at once. The stream to the server is only flushed when its 
+ * buffer fills or stdin has nothing more to read, so lines arriving together
+ * leave in as few writes as possible. A last line without a newline is sent
+ * once stdin is closed.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ */
+void pump_commands(InOut* inOut) {
+    size_t size = PUMP_BUFFER_SIZE;
+    char* buffer = malloc(size + 1);
+    size_t used = 0;
+    ssize_t got;
+    while ((got = read(STDIN_FILENO, buffer + used, size - used)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        used += got;
+        size_t end = used;
+        while (end && buffer[end - 1] != '\n') {
+            end--;
+        }
+
+        pthread_mutex_lock(&inOut->lock);
+        send_commands(inOut, buffer, end);
+        if (is_idle(STDIN_FILENO)) {
+            fflush(inOut->out);
+        }
+        pthread_mutex_unlock(&inOut->lock);
+
+        //Keep the start of a line that has not fully arrived, making room
+        //for lines longer than the buffer
+        memmove(buffer, buffer + end, used - end);
+        used -= end;
+        if (used == size) {
+            size *= 2;
+            buffer = realloc(buffer, size + 1);
+        }
+    }
+    if (used) {
+        buffer[used] = '\0';
+        pthread_mutex_lock(&inOut->lock);
+        send_command(inOut, buffer);
+        pthread_mutex_unlock(&inOut->lock);
+    }
+    free(buffer);
+}
+
+/* send_commands()
+ * ---------------
+ * Sends a block of complete lines to the server without flushing. Without
+ * reconnect set the block is sent as it is, and otherwise each line is sent
+ * with send_command() so that subscriptions are tracked. The lock must be
+ * held.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ *
+ * data: the lines, each ending with a newline
+ *
+ * len: the number of bytes in the lines
+ */
+void send_commands(InOut* inOut, char* data, size_t len) {
+    if (!inOut->reconnect) {
+        fwrite(data, 1, len, inOut->out);
+        return;
+    }
+    char* end = data + len;
+    while (data < end) {
+        char* newline = memchr(data, '\n', end - data);
+        *newline = '\0';
+        send_command(inOut, data);
+        *newline = '\n';
+        data = newline + 1;
+    }
+}
+
+/* is_idle()
+ * ---------
+ * Determines if a file descriptor has nothing ready to be read
+ *
+ * fd: the file descriptor
+ *
+ * Returns: true if a read would block and false otherwise
+ */
+bool is_idle(int fd) {
+    struct pollfd poller = {fd, POLLIN, 0};
+    return poll(&poller, 1, 0) == 0;
+}
+
+/* read_messages()
+ * ---------------
+ * Reads lines from the server and prints them until the connection is lost,
+ * reconnecting if reconnect is set. With pump set, stdout is only flushed 
+ * when nothing more has arrived from the server.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ */
+void read_messages(InOut* inOut) {
+    char* buffer;
+    if (inOut->pump) {
+        setvbuf(stdout, NULL, _IOFBF, PUMP_BUFFER_SIZE);
+    }
+    while (true) {
+        while (true) {
+            if (inOut->pump && is_idle(fileno(inOut->in))) {
+                fflush(stdout);
+            }
+            if ((buffer = read_line(inOut->in)) == NULL) {
+                break;
+            }
+            bool handled = handle_frame(inOut, buffer);
+            free(buffer);
+            if (!handled) {
+                break;
+            }
+        } 
+        if (!inOut->reconnect) {
+            break;
+        }
+        reconnect(inOut);
+    }
+}
+
+/* pump_messages()
+ * ---------------
+ * Copies everything the server sends straight to stdout in large blocks 
+ * until the connection is lost. Only used when messages are printed exactly
+ * as they arrive. The data is spliced across when stdout is a pipe, and
+ * read and written otherwise.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ */
+void pump_messages(InOut* inOut) {
+    int fd = fileno(inOut->in);
+    if (splice_messages(fd)) {
+        return;
+    }
+    char* buffer = malloc(PUMP_BUFFER_SIZE);
+    ssize_t got;
+    while ((got = read(fd, buffer, PUMP_BUFFER_SIZE)) != 0) {
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        write_all(STDOUT_FILENO, buffer, got);
+    }
+    free(buffer);
+}
+
+/* splice_messages()
+ * -----------------
+ * Moves everything the server sends into stdout with splice() until the 
+ * connection is lost, so the data never passes through this process. Only
+ * used when stdout is a pipe, as splicing into a file has to go through a
+ * pipe of its own and saved nothing over read() and write().
+ *
+ * fd: the socket connected to the server
+ *
+ * Returns: true once the connection is lost, or false if stdout is not a 
+ * pipe or cannot be spliced to. Nothing is taken from the socket that has 
+ * not reached stdout.
+ */
+bool splice_messages(int fd) {
+    struct stat info;
+    if (fstat(STDOUT_FILENO, &info) || !S_ISFIFO(info.st_mode)) {
+        return false;
+    }
+    struct pollfd ready = {.fd = fd, .events = POLLIN};
+    ssize_t got = 1;
+    do {
+        //splice() only wakes the reader once it returns, so it is asked for 
+        //no more than has arrived rather than left waiting on the socket
+        int waiting = 0;
+        if (poll(&ready, 1, -1) < 0 || ioctl(fd, FIONREAD, &waiting)) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return true;
+        }
+        size_t len = waiting > 0 && waiting < PUMP_BUFFER_SIZE ? 
+                (size_t) waiting : PUMP_BUFFER_SIZE;
+        got = splice(fd, NULL, STDOUT_FILENO, NULL, len, SPLICE_F_MOVE);
+        if (got < 0 && errno != EINTR) {
+            return errno != EINVAL;
+        }
+    } while (got != 0);
+    return true;
+}
+
+/* write_all()
+ * -----------
+ * Writes a whole block to a file descriptor, carrying on after partial 
+ * writes. Gives up on any other error, as printf() would.
+ *
+ * fd: the file descriptor
+ *
+ * data: the block
+ *
+ * len: the number of bytes in the block
+ */
+void write_all(int fd, char* data, size_t len) {
+    while (len) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
+/* send_sub()
+ * ----------
+ * Sends a sub command to the server. With reconnect set the subscription is
+ * tracked and sent with resume_sub() so it can be resumed later.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ *
+ * line: the sub command
+ */
+void send_sub(InOut* inOut, char* line) {
+    Subscription* sub = inOut->reconnect ? track_sub(inOut, line) : NULL;
+    if (sub) {
+        resume_sub(inOut, sub);
+    } else {
+        fprintf(inOut->out, "%s\n", line);
+    }
+    fflush(inOut->out);
+}
+
+/* find_subscription()
+ * -------------------
+ * Finds the tracked subscription to a topic
+ *
+ * inOut: a pointer to the InOut struct holding the subscriptions
+ *
+ * topic: the topic
+ *
+ * Returns: the subscription, or NULL if the topic is not tracked
+ */
+Subscription* find_subscription(InOut* inOut, char* topic) {
+    for (int i = 0; topic && i < inOut->subCount; i++) {
+        if (!strcmp(inOut->subs[i].topic, topic)) {
+            return &inOut->subs[i];
+        }
+    }
+    return NULL;
+}
+
+/* track_sub()
+ * -----------
+ * Records the topic and options of a sub command so it can be sent again on
+ * a new connection. The seq and after options are left out of the recorded
+ * options as they are added whenever the command is sent, though the number
+ * given to after is remembered.
+ *
+ * inOut: a pointer to the InOut struct holding the subscriptions
+ *
+ * line: the sub command
+ *
+ * Returns: the recorded subscription, or NULL if there is no topic
+ */
+Subscription* track_sub(InOut* inOut, char* line) {
+    char* copy = strdup(line);
+    char* save;
+    strtok_r(copy, " ", &save);
+    char* topic = strtok_r(NULL, " ", &save);
+    if (!topic) {
+        free(copy);
+        return NULL;
+    }
+    Subscription* sub = find_subscription(inOut, topic);
+    if (!sub) {
+        inOut->subs = realloc(inOut->subs, 
+                sizeof(Subscription) * (inOut->subCount + 1));
+        sub = &inOut->subs[inOut->subCount++];
+        sub->topic = strdup(topic);
+        sub->lastSeq = 0;
+    } else {
+        free(sub->options);
+    }
+
+    sub->options = calloc(strlen(line) + 1, 1);
+    char* option;
+    while ((option = strtok_r(NULL, " ", &save))) {
+        if (!strcmp(option, "after") && (option = strtok_r(NULL, " ", 
+                &save))) {
+            sub->lastSeq = strtoull(option, NULL, 10);
+        } else if (strcmp(option, "seq")) {
+            strcat(sub->options, " ");
+            strcat(sub->options, option);
+        }
+    }
+    free(copy);
+    return sub;
+}
+
+/* track_unsub()
+ * -------------
+ * Stops tracking the topic of an unsub command
+ *
+ * inOut: a pointer to the InOut struct holding the subscriptions
+ *
+ * line: the unsub command
+ */
+void track_unsub(InOut* inOut, char* line) {
+    char* copy = strdup(line);
+    char* save;
+    strtok_r(copy, " ", &save);
+    Subscription* sub = find_subscription(inOut, strtok_r(NULL, " ", &save));
+    free(copy);
+    if (!sub) {
+        return;
+    }
+    free(sub->topic);
+    free(sub->options);
+    *sub = inOut->subs[--inOut->subCount];
+}
+
+/* resume_sub()
+ * ------------
+ * Sends a tracked subscription to the server, asking for numbered messages
+ * and for any recent messages after the last one received. A group, a 
+ * filtered subscription, or a topic that no message has been received on, 
+ * resumes with new messages only.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ *
+ * sub: the subscription
+ */
+void resume_sub(InOut* inOut, Subscription* sub) {
+    if (sub->lastSeq && !strstr(sub->options, " group ") &&
+            !strstr(sub->options, " where ")) {
+        fprintf(inOut->out, "sub %s%s after %" PRIu64 "\n", sub->topic,
+                sub->options, sub->lastSeq);
+    } else {
+        fprintf(inOut->out, "sub %s%s seq\n", sub->topic, sub->options);
+    }
+}
+
+/* send_name()
+ * -----------
+ * Sends the client's name to the server, asking for compressed messages if
+ * deflate is set. The stream is not flushed.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ */
+void send_name(InOut* inOut) {
+    fprintf(inOut->out, "name %s%s\n", inOut->name, 
+            inOut->deflate ? " deflate" : "");
+}
+
+/* handle_frame()
+ * --------------
+ * Handles a line received from the server. If it starts a compressed frame,
+ * the frame is read and inflated and each line in it is handled in turn.
+ *
+ * inOut: a pointer to the InOut struct connected to the server
+ *
+ * line: the line received
+ *
+ * Returns: false if a frame could not be read or inflated, in which case the
+ * connection can no longer be trusted, and true otherwise
+ */
+bool handle_frame(InOut* inOut, char* line) {
+    size_t compressedLen;
+    size_t len;
+    if (!inOut->deflate || !parse_frame_header(line, &compressedLen, &len)) {
+        handle_message(inOut, line);
+        return true;
+    }
+    char* compressed = malloc(compressedLen + 1);
+    char* data = NULL;
+    if (fread(compressed, 1, compressedLen, inOut->in) == compressedLen) {
+        data = inflate_frame(compressed, compressedLen, len);
+    }
+    free(compressed);
+    if (!data) {
+        fprintf(stderr, "psclient: invalid compressed message\n");
+        return false;
+    }
+
+    //Every line in a frame ends with a newline
+    char* next = data;
+    char* newline;
+    while ((newline = strchr(next, '\n'))) {
+        *newline = '\0';
+        handle_message(inOut, next);
+        next = newline + 1;
+    }
+    free(data);
+    return true;
+}
+
+/* handle_message()
+ * ----------------
+ * Prints a line received from the server. Numbered messages are printed
+ * without their number, which is remembered for the message's topic, and
+ * notices of missed messages are reported on stderr.
+ *
+ * inOut: a pointer to the InOut struct holding the subscriptions
+ *
+ * line: the line received
+ */
+void handle_message(InOut* inOut, char* line) {
+    char* end;
+    uint64_t seq = 0;
+    if (inOut->reconnect && line[0] == ':') {
+        seq = strtoull(line + 1, &end, 10);
+        if (end != line + 1 && *end == ':') {
+            line = end + 1;
+        } else {
+            seq = 0;
+        }
+    }
+    if (seq) {
+        //Find the topic between the first two colons of name:topic:value
+        char* topic = strchr(line, ':');
+        char* topicEnd = topic ? strchr(topic + 1, ':') : NULL;
+        if (topicEnd) {
+            *topicEnd = '\0';
+            pthread_mutex_lock(&inOut->lock);
+            Subscription* sub = find_subscription(inOut, topic + 1);
+            if (sub) {
+                sub->lastSeq = seq;
+            }
+            pthread_mutex_unlock(&inOut->lock);
+            *topicEnd = ':';
+        }
+    } else if (inOut->reconnect && !strncmp(line, ":gap ", strlen(":gap "))) {
+        fprintf(stderr, "psclient: missed messages %s\n", 
+                line + strlen(":gap "));
+        return;
+    }
+    printf("%s\n", line);
+    if (!inOut->pump) {
+        fflush(stdout);
+    }
+}
+
+/* reconnect()
+ * -----------
+ * Connects to the server again once the connection has been lost, waiting
+ * longer between each attempt. The client's name is sent again and each
+ * tracked subscription resumes after the last message received on it.
+ *
+ * inOut: a pointer to the InOut struct whose streams are replaced
+ */
+void reconnect(InOut* inOut) {
+    fprintf(stderr, "psclient: server connection lost, reconnecting\n");
+    pthread_mutex_lock(&inOut->lock);
+    fclose(inOut->in);
+    fclose(inOut->out);
+
+    long delay = FIRST_RETRY_MILLIS;
+    while (!open_connection(inOut->port, inOut)) {
+        struct timespec pause = {delay / MILLIS_PER_SECOND, 
+                (delay % MILLIS_PER_SECOND) * NANOS_PER_MILLI};
+        nanosleep(&pause, NULL);
+        delay = delay * 2 < MAX_RETRY_MILLIS ? delay * 2 : MAX_RETRY_MILLIS;
+    }
+
+    send_name(inOut);
+    for (int i = 0; i < inOut->subCount; i++) {
+        resume_sub(inOut, &inOut->subs[i]);
+    }
+    fflush(inOut->out);
+    pthread_mutex_unlock(&inOut->lock);
+    fprintf(stderr, "psclient: reconnected\n");
+}
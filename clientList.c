@@ -35,6 +35,14 @@ Node* delete_client(Node* node, Client* client) {
     return result;
 }
 
+Node* remove_from_list(Node* node, Client* client) {
+    if (node->client == client) {
+        return delete_client(node, client);
+    }
+    delete_client(node, client);
+    return node;
+}
+
 bool is_last_client(Node* node) {
     return !node->next; 
 }
@@ -4,13 +4,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "rateLimit.h"
+#include "outQueue.h"
+#include "lineReader.h"
 
-//Struct that stores the data necessary to represent a client
+//Struct that stores the data necessary to represent a client. Commands are
+//read from fd through reader, and messages for the client wait in queue until
+//the sender writes them to fd. Once sequenced is set every message sent to
+//the client carries its number within its topic, and with deflate set large
+//messages are sent compressed.
 typedef struct {
     char* name;
     bool hasName;
-    FILE* in;
-    FILE* out;
+    LineReader reader;
+    int fd;
+    pthread_t thread;
+    OutQueue queue;
+    bool scheduled;
+    TokenBucket* bucket;
+    double throttledTime;
+    bool sequenced;
+    bool deflate;
 } Client;
 
 //A node in the linked list that can hold all clients
@@ -56,6 +70,20 @@ void add_client(Node* node, Client* client);
  */
 Node* delete_client(Node* node, Client* client);
 
+/* remove_from_list()
+ * ------------------
+ * Removes a client from the linked list. Unlike delete_client(), the list
+ * head is always returned.
+ *
+ * node: the first node in the client linked list
+ *
+ * client: the client to be removed
+ *
+ * Returns: the new first node of the list, which is NULL if the list is now
+ * empty
+ */
+Node* remove_from_list(Node* node, Client* client);
+
 /* is_last_client()
  * ----------------
  * Determines if there are more clients in the linked list
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "deflateFrame.h"
+
+#define FRAME_HEADER_SIZE 48
+#define MIN_WINDOW_BITS 9
+#define MAX_WINDOW_BITS 15
+#define MIN_MEM_LEVEL 1
+#define DEFAULT_MEM_LEVEL 8
+
+/* compress_sized()
+ * ----------------
+ * Compresses data as compress2() does, but with a window and hash table no
+ * bigger than the data needs. Setting up zlib's full sized tables costs far
+ * more than compressing a short message.
+ *
+ * Returns: true if the data was compressed and false otherwise
+ */
+bool compress_sized(char* data, size_t len, char* compressed,
+        uLongf* compressedLen) {
+    int windowBits = MIN_WINDOW_BITS;
+    while (windowBits < MAX_WINDOW_BITS && ((size_t) 1 << windowBits) < len) {
+        windowBits++;
+    }
+    int memLevel = windowBits - (MAX_WINDOW_BITS - DEFAULT_MEM_LEVEL);
+    memLevel = memLevel < MIN_MEM_LEVEL ? MIN_MEM_LEVEL : memLevel;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits,
+            memLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return false;
+    }
+    stream.next_in = (Bytef*) data;
+    stream.avail_in = len;
+    stream.next_out = (Bytef*) compressed;
+    stream.avail_out = *compressedLen;
+    int status = deflate(&stream, Z_FINISH);
+    *compressedLen = stream.total_out;
+    deflateEnd(&stream);
+    return status == Z_STREAM_END;
+}
+
+char* deflate_frame(char* data, size_t len, size_t* frameLen) {
+    if (len < DEFLATE_MIN_SIZE) {
+        return NULL;
+    }
+    uLongf compressedLen = compressBound(len);
+    char* frame = malloc(FRAME_HEADER_SIZE + compressedLen);
+    char* compressed = frame + FRAME_HEADER_SIZE;
+    if (!compress_sized(data, len, compressed, &compressedLen)) {
+        free(frame);
+        return NULL;
+    }
+
+    char header[FRAME_HEADER_SIZE];
+    int headerLen = snprintf(header, FRAME_HEADER_SIZE, 
+            DEFLATE_FRAME_PREFIX "%lu %zu\n", (unsigned long) compressedLen,
+            len);
+    if (headerLen + compressedLen >= len) {
+        free(frame);
+        return NULL;
+    }
+    memcpy(frame, header, headerLen);
+    memmove(frame + headerLen, compressed, compressedLen);
+    *frameLen = headerLen + compressedLen;
+    return frame;
+}
+
+bool parse_frame_header(char* line, size_t* compressedLen, size_t* len) {
+    if (strncmp(line, DEFLATE_FRAME_PREFIX, strlen(DEFLATE_FRAME_PREFIX))) {
+        return false;
+    }
+    char* end;
+    char* next = line + strlen(DEFLATE_FRAME_PREFIX);
+    *compressedLen = strtoull(next, &end, 10);
+    if (end == next || *end != ' ') {
+        return false;
+    }
+    next = end + 1;
+    *len = strtoull(next, &end, 10);
+    return end != next && *end == '\0';
+}
+
+char* inflate_frame(char* compressed, size_t compressedLen, size_t len) {
+    char* data = malloc(len + 1);
+    uLongf inflated = len;
+    if (uncompress((Bytef*) data, &inflated, (Bytef*) compressed, 
+            compressedLen) != Z_OK || inflated != len) {
+        free(data);
+        return NULL;
+    }
+    data[len] = '\0';
+    return data;
+}
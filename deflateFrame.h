@@ -0,0 +1,59 @@
+#ifndef DEFLATEFRAME_H
+#define DEFLATEFRAME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//Messages shorter than this are always sent as they are, as compressing 
+//them saves too little to be worth the time
+#define DEFLATE_MIN_SIZE 256
+
+//The start of the line that introduces a compressed frame. A frame is the
+//line ":z <compressed length> <length>\n" followed by the compressed bytes,
+//which inflate to the original text of one or more lines.
+#define DEFLATE_FRAME_PREFIX ":z "
+
+/* deflate_frame()
+ * ---------------
+ * Compresses text into a frame for a client that asked for compression
+ *
+ * data: the text to compress, usually a single message line
+ *
+ * len: the number of bytes of text
+ *
+ * frameLen: set to the number of bytes in the frame
+ *
+ * Returns: the frame, which the caller must free, or NULL if the text is
+ * shorter than DEFLATE_MIN_SIZE or would not be any smaller compressed
+ */
+char* deflate_frame(char* data, size_t len, size_t* frameLen);
+
+/* parse_frame_header()
+ * --------------------
+ * Checks whether a line received is the start of a compressed frame
+ *
+ * line: the line received, without its newline
+ *
+ * compressedLen: set to the number of compressed bytes that follow the line
+ *
+ * len: set to the number of bytes the frame inflates to
+ *
+ * Returns: true if the line starts a frame and false otherwise
+ */
+bool parse_frame_header(char* line, size_t* compressedLen, size_t* len);
+
+/* inflate_frame()
+ * ---------------
+ * Inflates the compressed bytes of a frame
+ *
+ * compressed: the compressed bytes
+ *
+ * compressedLen: the number of compressed bytes
+ *
+ * len: the number of bytes the frame inflates to, from its header
+ *
+ * Returns: the inflated text with a null terminator added, which the caller
+ * must free, or NULL if the bytes are not a valid frame of that length
+ */
+char* inflate_frame(char* compressed, size_t compressedLen, size_t len);
+#endif
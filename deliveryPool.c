@@ -0,0 +1,220 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "deliveryPool.h"
+
+#define PARALLEL_THRESHOLD 1024
+#define MIN_CHUNK_SIZE 256
+#define CHUNKS_PER_WORKER 4
+#define INITIAL_WORK_QUEUE_SIZE 16
+
+//Stores the data required for one worker thread
+typedef struct {
+    DeliveryPool* pool;
+    int index;
+} WorkerInfo;
+
+void* delivery_worker(void* arg);
+
+/* push_chunk()
+ * ------------
+ * Adds a chunk to the tail of a work queue
+ *
+ * queue: the work queue
+ *
+ * chunk: the chunk to add
+ */
+void push_chunk(WorkQueue* queue, Chunk chunk) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->size) {
+        Chunk* chunks = malloc(sizeof(Chunk) * queue->size * 2);
+        for (int i = 0; i < queue->count; i++) {
+            chunks[i] = queue->chunks[(queue->head + i) % queue->size];
+        }
+        free(queue->chunks);
+        queue->chunks = chunks;
+        queue->head = 0;
+        queue->size *= 2;
+    }
+    queue->chunks[(queue->head + queue->count) % queue->size] = chunk;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* take_chunk()
+ * ------------
+ * Removes a chunk from a work queue
+ *
+ * queue: the work queue
+ *
+ * chunk: set to the chunk removed
+ *
+ * steal: true to take from the head, as a thief does, and false to take
+ * from the tail, as the owner does
+ *
+ * Returns: true if a chunk was removed and false if the queue was empty
+ */
+bool take_chunk(WorkQueue* queue, Chunk* chunk, bool steal) {
+    pthread_mutex_lock(&queue->lock);
+    if (!queue->count) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+    if (steal) {
+        *chunk = queue->chunks[queue->head];
+        queue->head = (queue->head + 1) % queue->size;
+    } else {
+        *chunk = queue->chunks[(queue->head + queue->count - 1) %
+                queue->size];
+    }
+    queue->count--;
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+/* find_chunk()
+ * ------------
+ * Finds a chunk to work on, first from the worker's own queue and then by
+ * stealing from the other workers
+ *
+ * pool: the delivery pool
+ *
+ * home: the index of the worker's own queue, or -1 for a caller of fan_out()
+ * that has no queue of its own
+ *
+ * chunk: set to the chunk found
+ *
+ * Returns: true if a chunk was found and false otherwise
+ */
+bool find_chunk(DeliveryPool* pool, int home, Chunk* chunk) {
+    bool found = home >= 0 && take_chunk(&pool->queues[home], chunk, false);
+    for (int i = 1; !found && i <= pool->workerCount; i++) {
+        int victim = (home + i + pool->workerCount) % pool->workerCount;
+        found = take_chunk(&pool->queues[victim], chunk, true);
+    }
+    if (found) {
+        __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_RELAXED);
+    }
+    return found;
+}
+
+/* run_chunk()
+ * -----------
+ * Delivers to every client in a chunk and marks the chunk as done
+ *
+ * chunk: the chunk to run
+ */
+void run_chunk(Chunk* chunk) {
+    FanOut* fanOut = chunk->fanOut;
+    for (int i = 0; i < chunk->count; i++) {
+        fanOut->deliver(chunk->clients[i], fanOut->arg);
+    }
+
+    pthread_mutex_lock(&fanOut->lock);
+    if (--fanOut->remaining == 0) {
+        pthread_cond_signal(&fanOut->done);
+    }
+    pthread_mutex_unlock(&fanOut->lock);
+}
+
+void init_delivery_pool(DeliveryPool* pool, int workers) {
+    pool->workerCount = workers;
+    pool->queued = 0;
+    pool->nextQueue = 0;
+    pthread_mutex_init(&pool->idleLock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pool->queues = malloc(sizeof(WorkQueue) * (workers ? workers : 1));
+
+    for (int i = 0; i < workers; i++) {
+        WorkQueue* queue = &pool->queues[i];
+        pthread_mutex_init(&queue->lock, NULL);
+        queue->size = INITIAL_WORK_QUEUE_SIZE;
+        queue->chunks = malloc(sizeof(Chunk) * queue->size);
+        queue->head = 0;
+        queue->count = 0;
+    }
+
+    //Workers steal from every queue as soon as they start, so the queues are
+    //all set up first
+    for (int i = 0; i < workers; i++) {
+        WorkerInfo* info = malloc(sizeof(WorkerInfo));
+        info->pool = pool;
+        info->index = i;
+        pthread_t threadId;
+        pthread_create(&threadId, NULL, delivery_worker, info);
+        pthread_detach(threadId);
+    }
+}
+
+void fan_out(DeliveryPool* pool, Client** clients, int count,
+        DeliverFunction deliver, void* arg) {
+    //Small fan-outs are not worth handing over
+    if (!pool->workerCount || count < PARALLEL_THRESHOLD) {
+        for (int i = 0; i < count; i++) {
+            deliver(clients[i], arg);
+        }
+        return;
+    }
+
+    int chunkSize = count / (pool->workerCount * CHUNKS_PER_WORKER) + 1;
+    if (chunkSize < MIN_CHUNK_SIZE) {
+        chunkSize = MIN_CHUNK_SIZE;
+    }
+    FanOut fanOut;
+    fanOut.deliver = deliver;
+    fanOut.arg = arg;
+    fanOut.remaining = (count + chunkSize - 1) / chunkSize;
+    pthread_mutex_init(&fanOut.lock, NULL);
+    pthread_cond_init(&fanOut.done, NULL);
+
+    //Split the array and spread the chunks over the workers' queues
+    for (int start = 0; start < count; start += chunkSize) {
+        Chunk chunk = {&fanOut, clients + start, chunkSize};
+        if (count - start < chunkSize) {
+            chunk.count = count - start;
+        }
+        unsigned int next = __atomic_fetch_add(&pool->nextQueue, 1,
+                __ATOMIC_RELAXED);
+        push_chunk(&pool->queues[next % pool->workerCount], chunk);
+    }
+    pthread_mutex_lock(&pool->idleLock);
+    __atomic_add_fetch(&pool->queued, fanOut.remaining, __ATOMIC_RELAXED);
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->idleLock);
+
+    //Help out rather than sit idle, then wait for the chunks still running
+    Chunk chunk;
+    while (find_chunk(pool, -1, &chunk)) {
+        run_chunk(&chunk);
+    }
+    pthread_mutex_lock(&fanOut.lock);
+    while (fanOut.remaining) {
+        pthread_cond_wait(&fanOut.done, &fanOut.lock);
+    }
+    pthread_mutex_unlock(&fanOut.lock);
+    pthread_mutex_destroy(&fanOut.lock);
+    pthread_cond_destroy(&fanOut.done);
+}
+
+/* delivery_worker()
+ * -----------------
+ * Runs chunks for the life of the server, sleeping while there are none
+ *
+ * arg: a pointer to the WorkerInfo struct for this worker
+ */
+void* delivery_worker(void* arg) {
+    WorkerInfo* info = arg;
+    DeliveryPool* pool = info->pool;
+    Chunk chunk;
+    while (true) {
+        if (find_chunk(pool, info->index, &chunk)) {
+            run_chunk(&chunk);
+            continue;
+        }
+        pthread_mutex_lock(&pool->idleLock);
+        while (__atomic_load_n(&pool->queued, __ATOMIC_RELAXED) <= 0) {
+            pthread_cond_wait(&pool->work, &pool->idleLock);
+        }
+        pthread_mutex_unlock(&pool->idleLock);
+    }
+    return NULL;
+}
@@ -0,0 +1,78 @@
+#ifndef DELIVERYPOOL_H
+#define DELIVERYPOOL_H
+
+#include <pthread.h>
+#include "clientList.h"
+
+//Function called once for every client a message is fanned out to
+typedef void (*DeliverFunction)(Client* client, void* arg);
+
+//One fan-out in progress. The caller waits until remaining reaches zero.
+typedef struct {
+    DeliverFunction deliver;
+    void* arg;
+    int remaining;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+} FanOut;
+
+//A run of consecutive clients from a subscriber array
+typedef struct {
+    FanOut* fanOut;
+    Client** clients;
+    int count;
+} Chunk;
+
+//A worker's double ended queue of chunks. The worker takes chunks from the
+//tail while idle workers steal from the head.
+typedef struct {
+    pthread_mutex_t lock;
+    Chunk* chunks;
+    int head;
+    int count;
+    int size;
+} WorkQueue;
+
+//A pool of delivery workers that share out the subscribers of large
+//fan-outs
+typedef struct {
+    int workerCount;
+    WorkQueue* queues;
+    int queued;
+    unsigned int nextQueue;
+    pthread_mutex_t idleLock;
+    pthread_cond_t work;
+} DeliveryPool;
+
+/* init_delivery_pool()
+ * --------------------
+ * Sets up a delivery pool and starts its workers
+ *
+ * pool: the pool to set up
+ *
+ * workers: the number of worker threads. With no workers every fan-out is
+ * done by the caller.
+ */
+void init_delivery_pool(DeliveryPool* pool, int workers);
+
+/* fan_out()
+ * ---------
+ * Calls deliver for every client in an array. Large arrays are split into
+ * chunks that are spread over the workers, with the chunk size growing with
+ * the length of the array. The caller helps with the chunks and returns only
+ * once every client has been delivered to, so a client always sees the
+ * messages of consecutive fan-outs in order.
+ *
+ * pool: the delivery pool
+ *
+ * clients: the array of clients
+ *
+ * count: the number of clients in the array
+ *
+ * deliver: the function to call for each client
+ *
+ * arg: passed to deliver along with each client
+ */
+void fan_out(DeliveryPool* pool, Client** clients, int count,
+        DeliverFunction deliver, void* arg);
+#endif
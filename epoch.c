@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include "epoch.h"
+
+#define FIRST_EPOCH 1
+#define SYNCHRONIZE_POLL_NANOS 100000
+
+/* oldest_active_epoch()
+ * ---------------------
+ * Finds the oldest epoch any reader is still in. The domain lock must be
+ * held.
+ *
+ * domain: the epoch domain
+ *
+ * Returns: the oldest active epoch, or the current epoch if no reader is
+ * inside a read-side section
+ */
+unsigned long oldest_active_epoch(EpochDomain* domain) {
+    unsigned long oldest = __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST);
+    for (EpochRecord* record = domain->records; record;
+            record = record->next) {
+        unsigned long epoch = __atomic_load_n(&record->epoch,
+                __ATOMIC_SEQ_CST);
+        if (epoch && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+/* take_reclaimable()
+ * ------------------
+ * Removes every retired entry that no reader can still be using. The domain
+ * lock must be held.
+ *
+ * domain: the epoch domain
+ *
+ * Returns: the list of entries removed, which the caller releases once the
+ * lock has been dropped
+ */
+Retired* take_reclaimable(EpochDomain* domain) {
+    unsigned long oldest = oldest_active_epoch(domain);
+    Retired* reclaimable = NULL;
+    Retired** link = &domain->retired;
+    while (*link) {
+        Retired* entry = *link;
+        if (entry->epoch < oldest) {
+            *link = entry->next;
+            entry->next = reclaimable;
+            reclaimable = entry;
+            domain->retiredCount--;
+        } else {
+            link = &entry->next;
+        }
+    }
+    return reclaimable;
+}
+
+/* release_all()
+ * -------------
+ * Releases a list of retired entries
+ *
+ * entry: the first entry in the list
+ */
+void release_all(Retired* entry) {
+    while (entry) {
+        Retired* next = entry->next;
+        entry->release(entry->ptr);
+        free(entry);
+        entry = next;
+    }
+}
+
+void init_epoch_domain(EpochDomain* domain) {
+    domain->epoch = FIRST_EPOCH;
+    domain->records = NULL;
+    domain->retired = NULL;
+    domain->retiredCount = 0;
+    pthread_mutex_init(&domain->lock, NULL);
+}
+
+EpochRecord* register_reader(EpochDomain* domain) {
+    EpochRecord* record = malloc(sizeof(EpochRecord));
+    record->epoch = 0;
+    pthread_mutex_lock(&domain->lock);
+    record->next = domain->records;
+    domain->records = record;
+    pthread_mutex_unlock(&domain->lock);
+    return record;
+}
+
+void unregister_reader(EpochDomain* domain, EpochRecord* record) {
+    pthread_mutex_lock(&domain->lock);
+    EpochRecord** link = &domain->records;
+    while (*link != record) {
+        link = &(*link)->next;
+    }
+    *link = record->next;
+    pthread_mutex_unlock(&domain->lock);
+    free(record);
+}
+
+void epoch_enter(EpochDomain* domain, EpochRecord* record) {
+    __atomic_store_n(&record->epoch,
+            __atomic_load_n(&domain->epoch, __ATOMIC_SEQ_CST),
+            __ATOMIC_SEQ_CST);
+    //The record must be visible to writers before any shared pointer is
+    //loaded, or a writer could miss the reader and free what it loads
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(EpochRecord* record) {
+    __atomic_store_n(&record->epoch, 0, __ATOMIC_RELEASE);
+}
+
+void retire(EpochDomain* domain, void* ptr, ReleaseFunction release) {
+    Retired* entry = malloc(sizeof(Retired));
+    entry->ptr = ptr;
+    entry->release = release;
+
+    //Readers that load the pointer from now on see the next epoch, so only
+    //readers still in this epoch or an older one can be holding it
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&domain->lock);
+    entry->epoch = __atomic_fetch_add(&domain->epoch, 1, __ATOMIC_SEQ_CST);
+    entry->next = domain->retired;
+    domain->retired = entry;
+    domain->retiredCount++;
+    Retired* reclaimable = take_reclaimable(domain);
+    pthread_mutex_unlock(&domain->lock);
+    release_all(reclaimable);
+}
+
+void synchronize_epoch(EpochDomain* domain) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    unsigned long target = __atomic_add_fetch(&domain->epoch, 1,
+            __ATOMIC_SEQ_CST);
+    struct timespec poll = {0, SYNCHRONIZE_POLL_NANOS};
+    while (true) {
+        pthread_mutex_lock(&domain->lock);
+        bool done = oldest_active_epoch(domain) >= target;
+        Retired* reclaimable = done ? take_reclaimable(domain) : NULL;
+        pthread_mutex_unlock(&domain->lock);
+        if (done) {
+            release_all(reclaimable);
+            return;
+        }
+        nanosleep(&poll, NULL);
+    }
+}
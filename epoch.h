@@ -0,0 +1,110 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <pthread.h>
+
+//Function that frees memory once no reader can still be using it
+typedef void (*ReleaseFunction)(void* ptr);
+
+//One reader thread's place in the epoch domain. epoch is the global epoch
+//the reader saw when it entered its current read-side section, or 0 while it
+//is outside one.
+struct EpochRecord {
+    unsigned long epoch;
+    struct EpochRecord* next;
+};
+
+typedef struct EpochRecord EpochRecord;
+
+//Memory that has been unlinked by a writer but may still be in use by
+//readers that entered before it was unlinked
+struct Retired {
+    void* ptr;
+    ReleaseFunction release;
+    unsigned long epoch;
+    struct Retired* next;
+};
+
+typedef struct Retired Retired;
+
+//Epoch based reclamation. Readers never take a lock. Writers unlink shared
+//memory and retire it, and it is released once every reader has left the
+//epoch it was retired in.
+typedef struct {
+    unsigned long epoch;
+    EpochRecord* records;
+    Retired* retired;
+    int retiredCount;
+    pthread_mutex_t lock;
+} EpochDomain;
+
+/* init_epoch_domain()
+ * -------------------
+ * Sets up an epoch domain with no readers and nothing retired
+ *
+ * domain: the domain to set up
+ */
+void init_epoch_domain(EpochDomain* domain);
+
+/* register_reader()
+ * -----------------
+ * Adds a reader thread to the domain
+ *
+ * domain: the epoch domain
+ *
+ * Returns: the record the thread passes to epoch_enter() and epoch_exit()
+ */
+EpochRecord* register_reader(EpochDomain* domain);
+
+/* unregister_reader()
+ * -------------------
+ * Removes a reader thread from the domain and frees its record. The thread
+ * must not be inside a read-side section.
+ *
+ * domain: the epoch domain
+ *
+ * record: the record of the reader
+ */
+void unregister_reader(EpochDomain* domain, EpochRecord* record);
+
+/* epoch_enter()
+ * -------------
+ * Starts a read-side section. Shared memory loaded inside the section stays
+ * valid until epoch_exit() is called.
+ *
+ * domain: the epoch domain
+ *
+ * record: the record of the calling reader
+ */
+void epoch_enter(EpochDomain* domain, EpochRecord* record);
+
+/* epoch_exit()
+ * ------------
+ * Ends a read-side section
+ *
+ * record: the record of the calling reader
+ */
+void epoch_exit(EpochRecord* record);
+
+/* retire()
+ * --------
+ * Hands memory that writers have unlinked to the domain. It is released once
+ * no reader can still hold a pointer to it, which may be straight away.
+ *
+ * domain: the epoch domain
+ *
+ * ptr: the memory that has been unlinked
+ *
+ * release: the function that frees it
+ */
+void retire(EpochDomain* domain, void* ptr, ReleaseFunction release);
+
+/* synchronize_epoch()
+ * -------------------
+ * Waits until every reader that was inside a read-side section when it was
+ * called has left it. Must not be called from inside a read-side section.
+ *
+ * domain: the epoch domain
+ */
+void synchronize_epoch(EpochDomain* domain);
+#endif
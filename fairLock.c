@@ -0,0 +1,24 @@
+#include "fairLock.h"
+
+void fair_lock_init(FairLock* lock) {
+    pthread_mutex_init(&lock->mutex, NULL);
+    pthread_cond_init(&lock->turn, NULL);
+    lock->nextTicket = 0;
+    lock->nowServing = 0;
+}
+
+void fair_lock(FairLock* lock) {
+    pthread_mutex_lock(&lock->mutex);
+    unsigned long ticket = lock->nextTicket++;
+    while (lock->nowServing != ticket) {
+        pthread_cond_wait(&lock->turn, &lock->mutex);
+    }
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+void fair_unlock(FairLock* lock) {
+    pthread_mutex_lock(&lock->mutex);
+    lock->nowServing++;
+    pthread_cond_broadcast(&lock->turn);
+    pthread_mutex_unlock(&lock->mutex);
+}
@@ -0,0 +1,40 @@
+#ifndef FAIRLOCK_H
+#define FAIRLOCK_H
+
+#include <pthread.h>
+
+//A ticket lock. Threads are granted the lock in the order they asked for it,
+//so one busy client cannot take the lock again ahead of clients already
+//waiting for it.
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t turn;
+    unsigned long nextTicket;
+    unsigned long nowServing;
+} FairLock;
+
+/* fair_lock_init()
+ * ----------------
+ * Initialises a fair lock in the unlocked state
+ *
+ * lock: the lock to initialise
+ */
+void fair_lock_init(FairLock* lock);
+
+/* fair_lock()
+ * -----------
+ * Waits until every thread that asked for the lock earlier has released it,
+ * and then takes the lock
+ *
+ * lock: the lock to take
+ */
+void fair_lock(FairLock* lock);
+
+/* fair_unlock()
+ * -------------
+ * Releases the lock to the next waiting thread
+ *
+ * lock: the lock to release
+ */
+void fair_unlock(FairLock* lock);
+#endif
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "filter.h"
+
+#define FIELD_FILTER_ARGS 3
+#define TEXT_FILTER_ARGS 2
+#define FIELD_SEPARATORS " ,"
+#define FIELD_EQUALS '='
+#define SSE_WIDTH 16
+
+/* is_filter_text()
+ * ----------------
+ * Determines if an argument can be looked for in a value. Values cannot be
+ * empty or contain colons, so neither can the text.
+ *
+ * arg: the argument
+ *
+ * Returns: true if the argument is valid and false otherwise
+ */
+bool is_filter_text(char* arg) {
+    return strcmp(arg, "") && !strchr(arg, ':');
+}
+
+int parse_filter(char** args, int count, Filter* filter) {
+    if (count >= TEXT_FILTER_ARGS && is_filter_text(args[1])) {
+        filter->text = args[1];
+        filter->len = strlen(args[1]);
+        filter->name = NULL;
+        filter->nameLen = 0;
+        if (!strcmp(args[0], "prefix")) {
+            filter->kind = FILTER_PREFIX;
+            return TEXT_FILTER_ARGS;
+        }
+        if (!strcmp(args[0], "contains")) {
+            filter->kind = FILTER_CONTAINS;
+            return TEXT_FILTER_ARGS;
+        }
+    }
+    if (count >= FIELD_FILTER_ARGS && !strcmp(args[0], "field") &&
+            is_filter_text(args[1]) && !strchr(args[1], FIELD_EQUALS) &&
+            is_filter_text(args[2])) {
+        filter->kind = FILTER_FIELD;
+        filter->name = args[1];
+        filter->nameLen = strlen(args[1]);
+        filter->text = args[2];
+        filter->len = strlen(args[2]);
+        return FIELD_FILTER_ARGS;
+    }
+    return 0;
+}
+
+Filter* copy_filter(Filter* filter) {
+    Filter* copy = malloc(sizeof(Filter));
+    *copy = *filter;
+    copy->text = strdup(filter->text);
+    copy->name = filter->name ? strdup(filter->name) : NULL;
+    return copy;
+}
+
+void free_filter(Filter* filter) {
+    free(filter->text);
+    free(filter->name);
+    free(filter);
+}
+
+bool same_filter(Filter* a, Filter* b) {
+    if (a->kind != b->kind || a->len != b->len || a->nameLen != b->nameLen ||
+            memcmp(a->text, b->text, a->len)) {
+        return false;
+    }
+    return a->kind != FILTER_FIELD || !memcmp(a->name, b->name, a->nameLen);
+}
+
+/* is_field_edge()
+ * ---------------
+ * Determines if a position in a value is the start or end of a field
+ *
+ * value: the value
+ *
+ * len: the length of the value
+ *
+ * pos: the position, which is the start or end of the value itself or the
+ * position of the character either side of the field
+ *
+ * Returns: true if the position is a field boundary and false otherwise
+ */
+bool is_field_edge(const char* value, size_t len, size_t pos) {
+    return pos == len || strchr(FIELD_SEPARATORS, value[pos]);
+}
+
+/* match_field()
+ * -------------
+ * Tests if a value holds a field with the filter's name and value. The name
+ * is searched for and each place it appears is checked for being a whole
+ * field followed by the wanted value.
+ *
+ * filter: a FILTER_FIELD filter
+ *
+ * value: the value
+ *
+ * len: the length of the value
+ *
+ * Returns: true if the field is present and false otherwise
+ */
+bool match_field(Filter* filter, const char* value, size_t len) {
+    size_t fieldLen = filter->nameLen + 1 + filter->len;
+    size_t from = 0;
+    const char* found;
+    while ((found = find_text(value + from, len - from, filter->name,
+            filter->nameLen))) {
+        size_t pos = found - value;
+        from = pos + 1;
+        if ((pos && !is_field_edge(value, len, pos - 1)) ||
+                pos + fieldLen > len ||
+                found[filter->nameLen] != FIELD_EQUALS) {
+            continue;
+        }
+        if (!memcmp(found + filter->nameLen + 1, filter->text,
+                filter->len) && is_field_edge(value, len, pos + fieldLen)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool match_filter(Filter* filter, const char* value, size_t len) {
+    switch (filter->kind) {
+        case FILTER_PREFIX:
+            return len >= filter->len &&
+                    !memcmp(value, filter->text, filter->len);
+        case FILTER_CONTAINS:
+            return find_text(value, len, filter->text, filter->len) != NULL;
+        default:
+            return match_field(filter, value, len);
+    }
+}
+
+const char* find_text(const char* haystack, size_t len, const char* needle,
+        size_t needleLen) {
+    if (!needleLen || needleLen > len) {
+        return needleLen ? NULL : haystack;
+    }
+    size_t pos = 0;
+#ifdef __SSE2__
+    //Each bit of the mask is a position whose first and last characters
+    //match the text's
+    __m128i first = _mm_set1_epi8(needle[0]);
+    __m128i last = _mm_set1_epi8(needle[needleLen - 1]);
+    for (; pos + needleLen - 1 + SSE_WIDTH <= len; pos += SSE_WIDTH) {
+        __m128i starts = _mm_loadu_si128((const __m128i*) (haystack + pos));
+        __m128i ends = _mm_loadu_si128((const __m128i*)
+                (haystack + pos + needleLen - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(starts, first), _mm_cmpeq_epi8(ends, last)));
+        while (mask) {
+            const char* candidate = haystack + pos + __builtin_ctz(mask);
+            if (!memcmp(candidate, needle, needleLen)) {
+                return candidate;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    return find_text_scalar(haystack + pos, len - pos, needle, needleLen);
+}
+
+const char* find_text_scalar(const char* haystack, size_t len,
+        const char* needle, size_t needleLen) {
+    if (!needleLen || needleLen > len) {
+        return needleLen ? NULL : haystack;
+    }
+    const char* end = haystack + len - needleLen + 1;
+    for (const char* pos = haystack; pos < end; pos++) {
+        pos = memchr(pos, needle[0], end - pos);
+        if (!pos) {
+            return NULL;
+        }
+        if (!memcmp(pos, needle, needleLen)) {
+            return pos;
+        }
+    }
+    return NULL;
+}
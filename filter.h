@@ -0,0 +1,119 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FILTER_PREFIX 0
+#define FILTER_CONTAINS 1
+#define FILTER_FIELD 2
+
+//A test on the value of a published message, from "where prefix <text>",
+//"where contains <text>" or "where field <name> <text>". For a field, name
+//is the name of the field and text the value it must have. Values are made
+//of fields of the form name=value separated by spaces or commas.
+typedef struct {
+    int kind;
+    char* text;
+    size_t len;
+    char* name;
+    size_t nameLen;
+} Filter;
+
+/* parse_filter()
+ * --------------
+ * Reads a filter from the arguments following "where" in a sub command. The
+ * filter points into the arguments rather than copying them.
+ *
+ * args: the arguments, starting at the kind of filter
+ *
+ * count: the number of arguments left
+ *
+ * filter: set to the filter read
+ *
+ * Returns: the number of arguments used, or 0 if they are not a valid filter
+ */
+int parse_filter(char** args, int count, Filter* filter);
+
+/* copy_filter()
+ * -------------
+ * Makes a copy of a filter that owns its text, for keeping after the command
+ * it was read from is freed
+ *
+ * filter: the filter to copy
+ *
+ * Returns: the copy, which must be freed with free_filter()
+ */
+Filter* copy_filter(Filter* filter);
+
+/* free_filter()
+ * -------------
+ * Frees a filter made by copy_filter()
+ *
+ * filter: the filter
+ */
+void free_filter(Filter* filter);
+
+/* same_filter()
+ * -------------
+ * Determines if two filters test for exactly the same thing
+ *
+ * a: the first filter
+ *
+ * b: the second filter
+ *
+ * Returns: true if the filters are the same and false otherwise
+ */
+bool same_filter(Filter* a, Filter* b);
+
+/* match_filter()
+ * --------------
+ * Tests a published value against a filter
+ *
+ * filter: the filter
+ *
+ * value: the value, which need not be null terminated
+ *
+ * len: the length of the value
+ *
+ * Returns: true if the value passes the filter and false otherwise
+ */
+bool match_filter(Filter* filter, const char* value, size_t len);
+
+/* find_text()
+ * -----------
+ * Finds the first place some text appears in a string. With SSE2, 16
+ * positions are tested at once by comparing the first and last characters
+ * of the text, and only positions where both match are compared in full.
+ *
+ * haystack: the string to search, which need not be null terminated
+ *
+ * len: the length of the string
+ *
+ * needle: the text to look for
+ *
+ * needleLen: the length of the text
+ *
+ * Returns: the first place the text appears, or NULL if it does not
+ */
+const char* find_text(const char* haystack, size_t len, const char* needle,
+        size_t needleLen);
+
+/* find_text_scalar()
+ * ------------------
+ * Does the same as find_text() one position at a time. Used where SSE2 is
+ * not available and for the end of a string too short for a full block.
+ *
+ * haystack: the string to search, which need not be null terminated
+ *
+ * len: the length of the string
+ *
+ * needle: the text to look for
+ *
+ * needleLen: the length of the text
+ *
+ * Returns: the first place the text appears, or NULL if it does not
+ */
+const char* find_text_scalar(const char* haystack, size_t len,
+        const char* needle, size_t needleLen);
+#endif
@@ -0,0 +1,327 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "handoff.h"
+
+#define INITIAL_SNAPSHOT_SIZE 4096
+#define FD_BATCH 250
+#define HANDOFF_BACKLOG 1
+
+void init_snapshot(Snapshot* snapshot) {
+    snapshot->size = INITIAL_SNAPSHOT_SIZE;
+    snapshot->data = malloc(snapshot->size);
+    snapshot->len = 0;
+    snapshot->pos = 0;
+    snapshot->valid = true;
+}
+
+void free_snapshot(Snapshot* snapshot) {
+    free(snapshot->data);
+}
+
+/* put_raw()
+ * ---------
+ * Appends bytes to the snapshot without a length, growing it as needed
+ *
+ * snapshot: the snapshot
+ *
+ * data: the bytes to append
+ *
+ * len: the number of bytes
+ */
+void put_raw(Snapshot* snapshot, const void* data, size_t len) {
+    while (snapshot->size - snapshot->len < len) {
+        snapshot->size *= 2;
+        snapshot->data = realloc(snapshot->data, snapshot->size);
+    }
+    memcpy(snapshot->data + snapshot->len, data, len);
+    snapshot->len += len;
+}
+
+/* get_raw()
+ * ---------
+ * Takes the next bytes from the snapshot
+ *
+ * snapshot: the snapshot
+ *
+ * len: the number of bytes to take
+ *
+ * Returns: a pointer to the bytes, or NULL if fewer than len bytes are left,
+ * in which case the snapshot is marked invalid
+ */
+char* get_raw(Snapshot* snapshot, size_t len) {
+    if (!snapshot->valid || snapshot->len - snapshot->pos < len) {
+        snapshot->valid = false;
+        return NULL;
+    }
+    char* data = snapshot->data + snapshot->pos;
+    snapshot->pos += len;
+    return data;
+}
+
+void put_u32(Snapshot* snapshot, uint32_t value) {
+    put_raw(snapshot, &value, sizeof(value));
+}
+
+void put_u64(Snapshot* snapshot, uint64_t value) {
+    put_raw(snapshot, &value, sizeof(value));
+}
+
+void put_bytes(Snapshot* snapshot, char* data, size_t len) {
+    put_u32(snapshot, len);
+    put_raw(snapshot, data, len);
+}
+
+void put_string(Snapshot* snapshot, char* string) {
+    put_bytes(snapshot, string, strlen(string));
+}
+
+size_t reserve_u32(Snapshot* snapshot) {
+    size_t pos = snapshot->len;
+    put_u32(snapshot, 0);
+    return pos;
+}
+
+void patch_u32(Snapshot* snapshot, size_t pos, uint32_t value) {
+    memcpy(snapshot->data + pos, &value, sizeof(value));
+}
+
+uint32_t get_u32(Snapshot* snapshot) {
+    uint32_t value = 0;
+    char* data = get_raw(snapshot, sizeof(value));
+    if (data) {
+        memcpy(&value, data, sizeof(value));
+    }
+    return value;
+}
+
+uint64_t get_u64(Snapshot* snapshot) {
+    uint64_t value = 0;
+    char* data = get_raw(snapshot, sizeof(value));
+    if (data) {
+        memcpy(&value, data, sizeof(value));
+    }
+    return value;
+}
+
+char* get_bytes(Snapshot* snapshot, size_t* len) {
+    *len = get_u32(snapshot);
+    return get_raw(snapshot, *len);
+}
+
+char* get_string(Snapshot* snapshot) {
+    size_t len;
+    char* data = get_bytes(snapshot, &len);
+    if (!data) {
+        return NULL;
+    }
+    char* string = malloc(len + 1);
+    memcpy(string, data, len);
+    string[len] = '\0';
+    return string;
+}
+
+/* handoff_address()
+ * -----------------
+ * Fills in the address of a handoff socket
+ *
+ * path: the path of the socket
+ *
+ * address: the address to fill in
+ *
+ * Returns: true if the path fits in the address and false otherwise
+ */
+bool handoff_address(char* path, struct sockaddr_un* address) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+int listen_handoff(char* path) {
+    struct sockaddr_un address;
+    if (!handoff_address(path, &address)) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (sock < 0 || bind(sock, (struct sockaddr*) &address,
+            sizeof(address)) < 0 || listen(sock, HANDOFF_BACKLOG) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int connect_handoff(char* path) {
+    struct sockaddr_un address;
+    if (!handoff_address(path, &address)) {
+        return -1;
+    }
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*) &address,
+            sizeof(address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+/* write_all()
+ * -----------
+ * Writes every byte of a buffer to a socket
+ *
+ * Returns: true if every byte was written and false otherwise
+ */
+bool write_all(int sock, const void* data, size_t len) {
+    const char* next = data;
+    while (len) {
+        ssize_t written = write(sock, next, len);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        next += written;
+        len -= written;
+    }
+    return true;
+}
+
+/* read_all()
+ * ----------
+ * Reads exactly len bytes from a socket
+ *
+ * Returns: true if every byte was read and false otherwise
+ */
+bool read_all(int sock, void* data, size_t len) {
+    char* next = data;
+    while (len) {
+        ssize_t got = read(sock, next, len);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        next += got;
+        len -= got;
+    }
+    return true;
+}
+
+/* send_fd_batch()
+ * ---------------
+ * Sends up to FD_BATCH file descriptors attached to a single byte
+ *
+ * Returns: true if the batch was sent and false otherwise
+ */
+bool send_fd_batch(int sock, int* fds, int count) {
+    char byte = 0;
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int) * FD_BATCH)];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(header), fds, sizeof(int) * count);
+
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &message, 0)) < 0 && errno == EINTR) {
+    }
+    return sent == 1;
+}
+
+/* receive_fd_batch()
+ * ------------------
+ * Receives a batch of file descriptors sent by send_fd_batch()
+ *
+ * Returns: true if exactly count descriptors were received and false
+ * otherwise
+ */
+bool receive_fd_batch(int sock, int* fds, int count) {
+    char byte;
+    struct iovec iov = {&byte, 1};
+    char control[CMSG_SPACE(sizeof(int) * FD_BATCH)];
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t got;
+    while ((got = recvmsg(sock, &message, 0)) < 0 && errno == EINTR) {
+    }
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (got != 1 || !header || header->cmsg_level != SOL_SOCKET ||
+            header->cmsg_type != SCM_RIGHTS ||
+            header->cmsg_len != CMSG_LEN(sizeof(int) * count)) {
+        return false;
+    }
+    memcpy(fds, CMSG_DATA(header), sizeof(int) * count);
+    return true;
+}
+
+bool send_snapshot(int sock, Snapshot* snapshot, int* fds, int count) {
+    uint64_t len = snapshot->len;
+    uint32_t fdCount = count;
+    if (!write_all(sock, &len, sizeof(len)) ||
+            !write_all(sock, snapshot->data, snapshot->len) ||
+            !write_all(sock, &fdCount, sizeof(fdCount))) {
+        return false;
+    }
+    for (int sent = 0; sent < count; sent += FD_BATCH) {
+        int batch = count - sent < FD_BATCH ? count - sent : FD_BATCH;
+        if (!send_fd_batch(sock, fds + sent, batch)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool receive_snapshot(int sock, Snapshot* snapshot, int** fds, int* count) {
+    uint64_t len;
+    uint32_t fdCount;
+    *fds = NULL;
+    *count = 0;
+    init_snapshot(snapshot);
+    if (!read_all(sock, &len, sizeof(len))) {
+        return false;
+    }
+    free(snapshot->data);
+    snapshot->data = malloc(len ? len : 1);
+    snapshot->size = len ? len : 1;
+    snapshot->len = len;
+    if (!read_all(sock, snapshot->data, len) ||
+            !read_all(sock, &fdCount, sizeof(fdCount))) {
+        return false;
+    }
+
+    *fds = malloc(sizeof(int) * (fdCount ? fdCount : 1));
+    for (uint32_t got = 0; got < fdCount; got += FD_BATCH) {
+        uint32_t batch = fdCount - got < FD_BATCH ? fdCount - got : FD_BATCH;
+        if (!receive_fd_batch(sock, *fds + got, batch)) {
+            return false;
+        }
+        *count = got + batch;
+    }
+    return true;
+}
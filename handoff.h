@@ -0,0 +1,184 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//A growable buffer that a server's state is written to, or read back from,
+//as a compact binary snapshot. Integers are stored in host byte order as
+//the snapshot only ever passes between processes on the same machine.
+typedef struct {
+    char* data;
+    size_t len;
+    size_t size;
+    size_t pos;
+    bool valid;
+} Snapshot;
+
+/* init_snapshot()
+ * ---------------
+ * Sets up an empty snapshot ready to be written to
+ *
+ * snapshot: the snapshot to set up
+ */
+void init_snapshot(Snapshot* snapshot);
+
+/* free_snapshot()
+ * ---------------
+ * Frees the data of a snapshot
+ *
+ * snapshot: the snapshot to free
+ */
+void free_snapshot(Snapshot* snapshot);
+
+/* put_u32()
+ * ---------
+ * Appends a 32 bit integer to the snapshot
+ */
+void put_u32(Snapshot* snapshot, uint32_t value);
+
+/* put_u64()
+ * ---------
+ * Appends a 64 bit integer to the snapshot
+ */
+void put_u64(Snapshot* snapshot, uint64_t value);
+
+/* put_bytes()
+ * -----------
+ * Appends a run of bytes to the snapshot, preceded by its length
+ *
+ * snapshot: the snapshot
+ *
+ * data: the bytes to append
+ *
+ * len: the number of bytes
+ */
+void put_bytes(Snapshot* snapshot, char* data, size_t len);
+
+/* put_string()
+ * ------------
+ * Appends a string to the snapshot
+ */
+void put_string(Snapshot* snapshot, char* string);
+
+/* reserve_u32()
+ * -------------
+ * Appends a 32 bit integer whose value is not yet known, such as the number
+ * of items that follow
+ *
+ * snapshot: the snapshot
+ *
+ * Returns: the position to pass to patch_u32() once the value is known
+ */
+size_t reserve_u32(Snapshot* snapshot);
+
+/* patch_u32()
+ * -----------
+ * Fills in an integer appended by reserve_u32()
+ *
+ * snapshot: the snapshot
+ *
+ * pos: the position returned by reserve_u32()
+ *
+ * value: the value of the integer
+ */
+void patch_u32(Snapshot* snapshot, size_t pos, uint32_t value);
+
+/* get_u32()
+ * ---------
+ * Reads the next 32 bit integer from the snapshot
+ *
+ * Returns: the integer, or 0 if the snapshot has run out, in which case the
+ * snapshot is marked invalid
+ */
+uint32_t get_u32(Snapshot* snapshot);
+
+/* get_u64()
+ * ---------
+ * Reads the next 64 bit integer from the snapshot
+ *
+ * Returns: the integer, or 0 if the snapshot has run out, in which case the
+ * snapshot is marked invalid
+ */
+uint64_t get_u64(Snapshot* snapshot);
+
+/* get_bytes()
+ * -----------
+ * Reads the next run of bytes from the snapshot
+ *
+ * snapshot: the snapshot
+ *
+ * len: set to the number of bytes
+ *
+ * Returns: a pointer to the bytes inside the snapshot, or NULL if the
+ * snapshot has run out, in which case the snapshot is marked invalid
+ */
+char* get_bytes(Snapshot* snapshot, size_t* len);
+
+/* get_string()
+ * ------------
+ * Reads the next string from the snapshot
+ *
+ * Returns: a copy of the string that the caller must free, or NULL if the
+ * snapshot has run out, in which case the snapshot is marked invalid
+ */
+char* get_string(Snapshot* snapshot);
+
+/* listen_handoff()
+ * ----------------
+ * Opens the unix domain socket that a new server connects to in order to
+ * take over from this one. Any stale socket file at the path is replaced.
+ *
+ * path: the path of the socket
+ *
+ * Returns: the listening socket, or -1 if it could not be opened
+ */
+int listen_handoff(char* path);
+
+/* connect_handoff()
+ * -----------------
+ * Connects to a running server that is listening for a handoff
+ *
+ * path: the path of the socket
+ *
+ * Returns: the connected socket, or -1 if no server is listening there
+ */
+int connect_handoff(char* path);
+
+/* send_snapshot()
+ * ---------------
+ * Sends a snapshot followed by a set of file descriptors. The descriptors
+ * are passed with SCM_RIGHTS in batches, so any number may be sent.
+ *
+ * sock: the connected handoff socket
+ *
+ * snapshot: the snapshot to send
+ *
+ * fds: the file descriptors to send
+ *
+ * count: the number of file descriptors
+ *
+ * Returns: true if everything was sent and false otherwise
+ */
+bool send_snapshot(int sock, Snapshot* snapshot, int* fds, int count);
+
+/* receive_snapshot()
+ * ------------------
+ * Receives a snapshot and file descriptors sent by send_snapshot()
+ *
+ * sock: the connected handoff socket
+ *
+ * snapshot: set up with the snapshot received, ready to be read from. It is
+ * set up even if receiving fails, and must be freed with free_snapshot().
+ *
+ * fds: set to a newly allocated array of the descriptors received, or NULL
+ * if none were, which must be freed even if receiving fails
+ *
+ * count: set to the number of descriptors received, which may be fewer than
+ * were sent if receiving fails
+ *
+ * Returns: true if everything was received and false otherwise
+ */
+bool receive_snapshot(int sock, Snapshot* snapshot, int** fds, int* count);
+#endif
@@ -0,0 +1,49 @@
+#include <stdlib.h>
+#include "history.h"
+
+#define FIRST_SEQUENCE 1
+
+void init_history(History* history, int size) {
+    history->size = size;
+    history->messages = NULL;
+    history->kept = false;
+    history->first = FIRST_SEQUENCE;
+    history->next = FIRST_SEQUENCE;
+    pthread_mutex_init(&history->lock, NULL);
+}
+
+void free_history(History* history) {
+    for (uint64_t seq = history->first; seq < history->next; seq++) {
+        release_payload(history->messages[seq % history->size]);
+    }
+    free(history->messages);
+    pthread_mutex_destroy(&history->lock);
+}
+
+void keep_history(History* history) {
+    history->kept = true;
+}
+
+void add_history(History* history, Payload* payload) {
+    if (!history->size || !history->kept) {
+        history->first = ++history->next;
+        return;
+    }
+    if (!history->messages) {
+        history->messages = malloc(sizeof(Payload*) * history->size);
+    }
+    if (history->next - history->first == history->size) {
+        release_payload(history->messages[history->first % history->size]);
+        history->first++;
+    }
+    hold_payload(payload);
+    history->messages[history->next % history->size] = payload;
+    history->next++;
+}
+
+Payload* find_history(History* history, uint64_t seq) {
+    if (seq < history->first || seq >= history->next) {
+        return NULL;
+    }
+    return history->messages[seq % history->size];
+}
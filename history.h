@@ -0,0 +1,77 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "outQueue.h"
+
+//The most recent messages published to a topic, numbered from 1 in the order
+//they were published. Messages first up to next are held, with the message
+//numbered seq in messages[seq % size]. lock is held while a message is
+//numbered and delivered, so every subscriber sees the topic's messages in
+//order and a client can join the topic between two messages. Messages are
+//only held once kept is set, and until then they are just numbered.
+typedef struct {
+    Payload** messages;
+    uint64_t size;
+    bool kept;
+    uint64_t first;
+    uint64_t next;
+    pthread_mutex_t lock;
+} History;
+
+/* init_history()
+ * --------------
+ * Sets up an empty history. Room for the messages is not allocated until
+ * the first one is added, so a topic nobody publishes to holds none.
+ *
+ * history: the history to set up
+ *
+ * size: the number of messages to hold. With 0 messages are still numbered
+ * but none are held.
+ */
+void init_history(History* history, int size);
+
+/* free_history()
+ * --------------
+ * Releases every message held in the history
+ *
+ * history: the history to free
+ */
+void free_history(History* history);
+
+/* keep_history()
+ * --------------
+ * Starts holding the messages added to the history from now on. The history
+ * lock must be held.
+ *
+ * history: the history
+ */
+void keep_history(History* history);
+
+/* add_history()
+ * -------------
+ * Adds the message numbered history->next to the history, dropping the
+ * oldest message if the history is full. If the history is not kept the
+ * message is only numbered. The history lock must be held.
+ *
+ * history: the history
+ *
+ * payload: the message, which may be NULL if the history is not kept. The
+ * history takes its own reference.
+ */
+void add_history(History* history, Payload* payload);
+
+/* find_history()
+ * --------------
+ * Finds a message held in the history. The history lock must be held.
+ *
+ * history: the history
+ *
+ * seq: the number of the message
+ *
+ * Returns: the message, or NULL if it is not held
+ */
+Payload* find_history(History* history, uint64_t seq);
+#endif
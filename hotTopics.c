@@ -0,0 +1,104 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hotTopics.h"
+#include "topicTable.h"
+
+void init_hot_topics(HotTopics* hot) {
+    for (int i = 0; i < HOT_STRIPES; i++) {
+        hot->stripes[i].messages.used = 0;
+        hot->stripes[i].bytes.used = 0;
+        pthread_mutex_init(&hot->stripes[i].lock, NULL);
+    }
+}
+
+/* count_in_summary()
+ * ------------------
+ * Adds weight to a topic's counter in a Space-Saving summary, taking over
+ * the lightest counter if the topic has none and the summary is full
+ *
+ * summary: the summary
+ *
+ * topic: the name of the topic
+ *
+ * hash: the hash of the name
+ *
+ * weight: the amount to count
+ */
+void count_in_summary(HotSummary* summary, char* topic, unsigned int hash,
+        uint64_t weight) {
+    int lightest = 0;
+    for (int i = 0; i < summary->used; i++) {
+        HotCounter* counter = &summary->counters[i];
+        if (counter->hash == hash && !strcmp(counter->name, topic)) {
+            counter->count += weight;
+            return;
+        }
+        if (counter->count < summary->counters[lightest].count) {
+            lightest = i;
+        }
+    }
+
+    HotCounter* counter;
+    if (summary->used < HOT_CAPACITY) {
+        counter = &summary->counters[summary->used++];
+        counter->count = 0;
+        counter->error = 0;
+    } else {
+        counter = &summary->counters[lightest];
+        free(counter->name);
+        counter->error = counter->count;
+    }
+    counter->name = strdup(topic);
+    counter->hash = hash;
+    counter->count += weight;
+}
+
+void count_hot_topic(HotTopics* hot, char* topic, uint64_t bytes) {
+    unsigned int hash = hash_name(topic);
+    HotStripe* stripe = &hot->stripes[hash % HOT_STRIPES];
+    pthread_mutex_lock(&stripe->lock);
+    count_in_summary(&stripe->messages, topic, hash, 1);
+    count_in_summary(&stripe->bytes, topic, hash, bytes);
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+/* compare_counters()
+ * ------------------
+ * qsort() comparison function that puts the heaviest counters first
+ */
+int compare_counters(const void* a, const void* b) {
+    uint64_t x = ((const HotCounter*) a)->count;
+    uint64_t y = ((const HotCounter*) b)->count;
+    return (x < y) - (x > y);
+}
+
+int top_hot_topics(HotTopics* hot, bool byBytes, HotCounter* top, 
+        int count) {
+    HotCounter* all = malloc(sizeof(HotCounter) * HOT_STRIPES * 
+            HOT_CAPACITY);
+    int total = 0;
+    for (int i = 0; i < HOT_STRIPES; i++) {
+        HotStripe* stripe = &hot->stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        HotSummary* summary = byBytes ? &stripe->bytes : &stripe->messages;
+        for (int j = 0; j < summary->used; j++) {
+            all[total] = summary->counters[j];
+            all[total].name = strdup(summary->counters[j].name);
+            total++;
+        }
+        pthread_mutex_unlock(&stripe->lock);
+    }
+
+    qsort(all, total, sizeof(HotCounter), compare_counters);
+    int found = total < count ? total : count;
+    memcpy(top, all, sizeof(HotCounter) * found);
+    free_hot_counters(all + found, total - found);
+    free(all);
+    return found;
+}
+
+void free_hot_counters(HotCounter* counters, int count) {
+    for (int i = 0; i < count; i++) {
+        free(counters[i].name);
+    }
+}
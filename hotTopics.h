@@ -0,0 +1,92 @@
+#ifndef HOTTOPICS_H
+#define HOTTOPICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define HOT_STRIPES 16
+#define HOT_CAPACITY 32
+
+//One topic counted by a Space-Saving summary. count never underestimates
+//the topic's true total and overestimates it by at most error.
+typedef struct {
+    char* name;
+    unsigned int hash;
+    uint64_t count;
+    uint64_t error;
+} HotCounter;
+
+//A Space-Saving summary of the heaviest topics seen. A topic that is not
+//being counted takes over the lightest counter once every counter is in use,
+//inheriting its count as the error.
+typedef struct {
+    HotCounter counters[HOT_CAPACITY];
+    int used;
+} HotSummary;
+
+//One stripe of the hot topic tracker, counting topics by the number of 
+//messages and by the number of bytes published to them
+typedef struct {
+    HotSummary messages;
+    HotSummary bytes;
+    pthread_mutex_t lock;
+} HotStripe;
+
+//Tracks the topics with the most messages and the most bytes published in
+//a fixed amount of memory, however many short lived topics come and go. A
+//topic is always counted in the stripe picked by its hash, so publishes to
+//topics in different stripes do not wait for each other and no two stripes
+//count the same topic.
+typedef struct {
+    HotStripe stripes[HOT_STRIPES];
+} HotTopics;
+
+/* init_hot_topics()
+ * -----------------
+ * Sets up a tracker that has counted nothing
+ *
+ * hot: the tracker to set up
+ */
+void init_hot_topics(HotTopics* hot);
+
+/* count_hot_topic()
+ * -----------------
+ * Counts one message published to a topic
+ *
+ * hot: the tracker
+ *
+ * topic: the name of the topic
+ *
+ * bytes: the size of the message
+ */
+void count_hot_topic(HotTopics* hot, char* topic, uint64_t bytes);
+
+/* top_hot_topics()
+ * ----------------
+ * Finds the heaviest topics counted so far
+ *
+ * hot: the tracker
+ *
+ * byBytes: true to rank topics by bytes and false to rank them by messages
+ *
+ * top: an array with room for count counters, populated heaviest first with
+ * copies that must be freed with free_hot_counters()
+ *
+ * count: the number of topics wanted
+ *
+ * Returns: the number of topics populated, which is less than count if fewer
+ * topics have been counted
+ */
+int top_hot_topics(HotTopics* hot, bool byBytes, HotCounter* top, int count);
+
+/* free_hot_counters()
+ * -------------------
+ * Frees the names of counters populated by top_hot_topics()
+ *
+ * counters: the counters
+ *
+ * count: the number of counters
+ */
+void free_hot_counters(HotCounter* counters, int count);
+#endif
@@ -0,0 +1,210 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "lineReader.h"
+
+#define INITIAL_READER_SIZE 256
+#define KEPT_READER_SIZE 65536
+
+/* make_room()
+ * -----------
+ * Ensures there is free space after the buffered input, moving the input to
+ * the front of the buffer or growing the buffer as needed. The buffer is
+ * allocated here the first time it is needed.
+ *
+ * reader: the reader
+ *
+ * needed: the number of free bytes needed
+ */
+void make_room(LineReader* reader, size_t needed) {
+    if (!reader->buffer) {
+        reader->size = INITIAL_READER_SIZE;
+        reader->buffer = malloc(reader->size);
+    }
+    if (reader->start) {
+        memmove(reader->buffer, reader->buffer + reader->start,
+                reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    while (reader->size - reader->end < needed) {
+        reader->size *= 2;
+        reader->buffer = realloc(reader->buffer, reader->size);
+    }
+}
+
+/* drop_input()
+ * ------------
+ * Removes the first len bytes of buffered input. A buffer that has grown 
+ * past KEPT_READER_SIZE for a long line is freed once it is empty, so the
+ * memory is only held while such a line is being read or thrown away.
+ *
+ * reader: the reader
+ *
+ * len: the number of bytes to remove
+ */
+void drop_input(LineReader* reader, size_t len) {
+    reader->start += len;
+    if (reader->start == reader->end) {
+        reader->start = 0;
+        reader->end = 0;
+        if (reader->size > KEPT_READER_SIZE && !reader->discarding) {
+            free(reader->buffer);
+            reader->buffer = NULL;
+            reader->size = 0;
+        }
+    }
+}
+
+/* take_line()
+ * -----------
+ * Removes the first len bytes of buffered input and returns them as a string
+ *
+ * reader: the reader
+ *
+ * len: the number of bytes in the line
+ *
+ * skip: the number of bytes after the line to discard, such as its newline
+ *
+ * Returns: the line, which the caller must free
+ */
+char* take_line(LineReader* reader, size_t len, size_t skip) {
+    char* line = malloc(len + 1);
+    memcpy(line, reader->buffer + reader->start, len);
+    line[len] = '\0';
+    drop_input(reader, len + skip);
+    return line;
+}
+
+void init_line_reader(LineReader* reader, int fd, size_t maxLine) {
+    reader->fd = fd;
+    reader->maxLine = maxLine;
+    reader->discarding = false;
+    reader->size = 0;
+    reader->buffer = NULL;
+    reader->start = 0;
+    reader->end = 0;
+}
+
+void free_line_reader(LineReader* reader) {
+    free(reader->buffer);
+}
+
+void push_input(LineReader* reader, char* data, size_t len) {
+    make_room(reader, len);
+    memcpy(reader->buffer + reader->end, data, len);
+    reader->end += len;
+}
+
+/* find_newline()
+ * --------------
+ * Looks for the end of the first buffered line
+ *
+ * reader: the reader
+ *
+ * scanned: the number of buffered bytes already known not to hold a newline
+ *
+ * Returns: a pointer to the newline in the buffer, or NULL if there is none
+ */
+char* find_newline(LineReader* reader, size_t scanned) {
+    if (reader->end - reader->start <= scanned) {
+        return NULL;
+    }
+    return memchr(reader->buffer + reader->start + scanned, '\n',
+            reader->end - reader->start - scanned);
+}
+
+/* find_line()
+ * -----------
+ * Takes the next whole line from the buffer, throwing away lines longer than
+ * the reader's limit. The start of a line already over the limit is thrown
+ * away without waiting for the rest of it, which is thrown away in turn as
+ * it arrives.
+ *
+ * reader: the reader
+ *
+ * scanned: the number of buffered bytes known not to hold a newline, which
+ * is updated for the next call
+ *
+ * Returns: the line without its newline, an empty line in place of one that
+ * was too long, or NULL if no whole line is buffered
+ */
+char* find_line(LineReader* reader, size_t* scanned) {
+    char* newline = find_newline(reader, *scanned);
+    if (newline) {
+        size_t len = newline - reader->buffer - reader->start;
+        *scanned = 0;
+        if (reader->discarding || (reader->maxLine && len > reader->maxLine)) {
+            reader->discarding = false;
+            drop_input(reader, len + 1);
+            return strdup("");
+        }
+        return take_line(reader, len, 1);
+    }
+    *scanned = reader->end - reader->start;
+    if (reader->discarding || 
+            (reader->maxLine && *scanned > reader->maxLine)) {
+        reader->discarding = true;
+        drop_input(reader, *scanned);
+        *scanned = 0;
+    }
+    return NULL;
+}
+
+char* next_line(LineReader* reader, bool* stop) {
+    size_t scanned = 0;
+    while (!__atomic_load_n(stop, __ATOMIC_ACQUIRE)) {
+        char* line = find_line(reader, &scanned);
+        if (line) {
+            return line;
+        }
+
+        make_room(reader, 1);
+        ssize_t got = read(reader->fd, reader->buffer + reader->end,
+                reader->size - reader->end);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return scanned ? take_line(reader, scanned, 0) : NULL;
+        }
+        reader->end += got;
+    }
+    return NULL;
+}
+
+bool read_available(LineReader* reader) {
+    make_room(reader, 1);
+    ssize_t got = recv(reader->fd, reader->buffer + reader->end,
+            reader->size - reader->end, MSG_DONTWAIT);
+    if (got < 0) {
+        return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    reader->end += got;
+    return got > 0;
+}
+
+char* buffered_line(LineReader* reader, bool atEnd) {
+    size_t scanned = 0;
+    char* line = find_line(reader, &scanned);
+    if (!line && atEnd && scanned) {
+        line = take_line(reader, scanned, 0);
+    }
+    return line;
+}
+
+bool has_buffered_input(LineReader* reader) {
+    return reader->end > reader->start;
+}
+
+void release_idle_buffer(LineReader* reader) {
+    if (reader->end == reader->start && !reader->discarding) {
+        free(reader->buffer);
+        reader->buffer = NULL;
+        reader->size = 0;
+        reader->start = 0;
+        reader->end = 0;
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef LINEREADER_H
+#define LINEREADER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//Reads lines from a file descriptor through a buffer that is kept in the
+//open, so bytes read from the socket but not yet handled can be handed on
+//to another process. Bytes from start up to end are waiting to be handled.
+//The buffer is only allocated once there is something to read into it, so a
+//reader that has released its buffer costs nothing while its client is idle.
+//Lines longer than maxLine bytes are thrown away as they arrive, with 
+//discarding set while the rest of such a line is still to come, so the 
+//buffer never grows much past maxLine.
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t start;
+    size_t end;
+    size_t size;
+    size_t maxLine;
+    bool discarding;
+} LineReader;
+
+/* init_line_reader()
+ * ------------------
+ * Sets up a line reader. No buffer is allocated until input arrives.
+ *
+ * reader: the reader to set up
+ *
+ * fd: the file descriptor to read from
+ *
+ * maxLine: the longest line accepted in bytes, not counting its newline, or
+ * 0 for no limit
+ */
+void init_line_reader(LineReader* reader, int fd, size_t maxLine);
+
+/* free_line_reader()
+ * ------------------
+ * Frees the buffer of a line reader. The file descriptor is not closed.
+ *
+ * reader: the reader to free
+ */
+void free_line_reader(LineReader* reader);
+
+/* push_input()
+ * ------------
+ * Adds bytes to the reader's buffer as if they had been read from the file
+ * descriptor
+ *
+ * reader: the reader
+ *
+ * data: the bytes to add
+ *
+ * len: the number of bytes
+ */
+void push_input(LineReader* reader, char* data, size_t len);
+
+/* next_line()
+ * -----------
+ * Reads the next line, waiting for more input if a whole line is not yet
+ * buffered. A last line without a newline is returned when the end of the
+ * input is reached. A line longer than the reader's limit is returned as an
+ * empty line, which is not a valid command, once its newline arrives.
+ *
+ * reader: the reader
+ *
+ * stop: checked before each line and whenever a read is interrupted by a
+ * signal. Once it is true no more lines are returned and the unread bytes
+ * stay in the buffer.
+ *
+ * Returns: the line without its newline, which the caller must free, or NULL
+ * at the end of the input, on an error or once stop is true
+ */
+char* next_line(LineReader* reader, bool* stop);
+
+/* read_available()
+ * ----------------
+ * Reads whatever input is waiting on the socket into the buffer without
+ * blocking, for callers that wait for input with poll() or epoll rather than
+ * in next_line()
+ *
+ * reader: the reader
+ *
+ * Returns: false once the end of the input is reached or on an error, and
+ * true otherwise, including when there was nothing to read
+ */
+bool read_available(LineReader* reader);
+
+/* buffered_line()
+ * ---------------
+ * Takes the next whole line from the buffer without reading. A line longer
+ * than the reader's limit is returned as an empty line, as by next_line().
+ *
+ * reader: the reader
+ *
+ * atEnd: true if no more input will arrive, in which case a last line
+ * without a newline is returned as well
+ *
+ * Returns: the line without its newline, which the caller must free, or NULL
+ * if no whole line is buffered
+ */
+char* buffered_line(LineReader* reader, bool atEnd);
+
+/* has_buffered_input()
+ * --------------------
+ * Returns: true if the reader holds input that has not been taken yet
+ */
+bool has_buffered_input(LineReader* reader);
+
+/* release_idle_buffer()
+ * ---------------------
+ * Frees the reader's buffer if it holds no input and no line that is too
+ * long is being thrown away. The next read allocates a new one.
+ *
+ * reader: the reader
+ */
+void release_idle_buffer(LineReader* reader);
+#endif
@@ -0,0 +1,246 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "outQueue.h"
+
+#define NANOSECONDS 1000000000ULL
+#define NANOS_PER_MILLI 1000000ULL
+
+uint64_t queue_clock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOSECONDS + now.tv_nsec;
+}
+
+Payload* init_payload(char* topic, char* data, size_t len) {
+    Payload* payload = malloc(sizeof(Payload));
+    payload->refs = 1;
+    payload->expired = false;
+    payload->priority = topic ? DEFAULT_PRIORITY : CONTROL_PRIORITY;
+    payload->created = queue_clock();
+    payload->expires = 0;
+    payload->topic = topic ? strdup(topic) : NULL;
+    payload->data = data;
+    payload->len = len;
+    return payload;
+}
+
+void hold_payload(Payload* payload) {
+    __atomic_add_fetch(&payload->refs, 1, __ATOMIC_RELAXED);
+}
+
+void release_payload(Payload* payload) {
+    if (__atomic_sub_fetch(&payload->refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    free(payload->topic);
+    free(payload->data);
+    free(payload);
+}
+
+void expire_payload(Payload* payload) {
+    __atomic_store_n(&payload->expired, true, __ATOMIC_RELEASE);
+}
+
+bool is_expired(Payload* payload) {
+    return __atomic_load_n(&payload->expired, __ATOMIC_ACQUIRE);
+}
+
+uint64_t time_to_live(Payload* payload) {
+    if (!payload->expires) {
+        return 0;
+    }
+    uint64_t now = queue_clock();
+    if (payload->expires <= now) {
+        return 1;
+    }
+    return (payload->expires - now + NANOS_PER_MILLI - 1) / NANOS_PER_MILLI;
+}
+
+void pop_entry(OutQueue* queue) {
+    if (!queue->head) {
+        stage_entries(queue, NULL, 1);
+    }
+    QueueEntry* entry = queue->head;
+    queue->head = entry->next;
+    if (!queue->head) {
+        queue->tail = NULL;
+    }
+    queue->sent = 0;
+    queue->length--;
+    queue->staged--;
+    queue->depths[entry->payload->priority]--;
+    release_payload(entry->payload);
+    free(entry);
+}
+
+/* stage_from()
+ * ------------
+ * Moves the first message of a lane to the end of the staged list. The
+ * queue lock must be held.
+ *
+ * queue: the queue
+ *
+ * lane: the lane, which must not be empty
+ */
+void stage_from(OutQueue* queue, Lane* lane) {
+    QueueEntry* entry = lane->head;
+    lane->head = entry->next;
+    if (!lane->head) {
+        lane->tail = NULL;
+    }
+    lane->length--;
+
+    entry->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = entry;
+    } else {
+        queue->head = entry;
+    }
+    queue->tail = entry;
+    queue->staged++;
+}
+
+void stage_entries(OutQueue* queue, DrainPolicy* policy, size_t count) {
+    while (queue->staged < count && queue->staged < queue->length) {
+        if (!policy || !policy->weighted) {
+            int lane = 0;
+            while (!queue->lanes[lane].length) {
+                lane++;
+            }
+            stage_from(queue, &queue->lanes[lane]);
+            continue;
+        }
+
+        //Move on to the next lane once this one has used its turn
+        if (!queue->credit || !queue->lanes[queue->lane].length) {
+            queue->lane = (queue->lane + 1) % PRIORITY_CLASSES;
+            queue->credit = policy->weights[queue->lane];
+            continue;
+        }
+        stage_from(queue, &queue->lanes[queue->lane]);
+        queue->credit--;
+    }
+}
+
+void init_queue(OutQueue* queue) {
+    memset(queue, 0, sizeof(OutQueue));
+    pthread_mutex_init(&queue->lock, NULL);
+
+    //The first turn goes to the most urgent lane
+    queue->lane = PRIORITY_CLASSES - 1;
+}
+
+/* drop_list()
+ * -----------
+ * Releases every entry in a list of entries
+ *
+ * entry: the first entry in the list
+ */
+void drop_list(QueueEntry* entry) {
+    while (entry) {
+        QueueEntry* next = entry->next;
+        release_payload(entry->payload);
+        free(entry);
+        entry = next;
+    }
+}
+
+/* drop_entries()
+ * --------------
+ * Releases every entry in the queue and leaves it empty. The queue lock must
+ * be held.
+ *
+ * queue: the queue to empty
+ */
+void drop_entries(OutQueue* queue) {
+    drop_list(queue->head);
+    for (int i = 0; i < PRIORITY_CLASSES; i++) {
+        drop_list(queue->lanes[i].head);
+        memset(&queue->lanes[i], 0, sizeof(Lane));
+        queue->depths[i] = 0;
+    }
+    queue->head = NULL;
+    queue->tail = NULL;
+    queue->sent = 0;
+    queue->length = 0;
+    queue->staged = 0;
+}
+
+/* find_conflated()
+ * ----------------
+ * Finds an unsent conflated message for a topic in a list of entries
+ *
+ * entry: the first entry in the list
+ *
+ * topic: the topic
+ *
+ * Returns: the entry, or NULL if there is none
+ */
+QueueEntry* find_conflated(QueueEntry* entry, char* topic) {
+    for (; entry; entry = entry->next) {
+        if (entry->conflate && !strcmp(entry->payload->topic, topic)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void free_queue(OutQueue* queue) {
+    drop_entries(queue);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+bool enqueue(OutQueue* queue, Payload* payload, bool conflate) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    //Replace an unsent message for the same topic, which is either staged or
+    //in the topic's lane. The first staged entry may have been partly 
+    //written so it is left alone.
+    Lane* lane = &queue->lanes[payload->priority];
+    if (conflate) {
+        QueueEntry* entry = queue->head;
+        if (entry && queue->sent) {
+            entry = entry->next;
+        }
+        entry = find_conflated(entry, payload->topic);
+        if (!entry) {
+            entry = find_conflated(lane->head, payload->topic);
+        }
+        if (entry) {
+            hold_payload(payload);
+            release_payload(entry->payload);
+            entry->payload = payload;
+            pthread_mutex_unlock(&queue->lock);
+            return true;
+        }
+    }
+
+    QueueEntry* entry = malloc(sizeof(QueueEntry));
+    hold_payload(payload);
+    entry->payload = payload;
+    entry->conflate = conflate;
+    entry->next = NULL;
+    if (lane->tail) {
+        lane->tail->next = entry;
+    } else {
+        lane->head = entry;
+    }
+    lane->tail = entry;
+    lane->length++;
+    queue->length++;
+    queue->depths[payload->priority]++;
+    pthread_mutex_unlock(&queue->lock);
+    return false;
+}
+
+void close_queue(OutQueue* queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = true;
+    drop_entries(queue);
+    pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,211 @@
+#ifndef OUTQUEUE_H
+#define OUTQUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+//Messages are sent in one of PRIORITY_CLASSES classes, where class 0 is the
+//most urgent. Replies to commands are CONTROL_PRIORITY, and topics are
+//DEFAULT_PRIORITY unless configured otherwise.
+#define PRIORITY_CLASSES 4
+#define CONTROL_PRIORITY 0
+#define DEFAULT_PRIORITY 2
+
+//A message ready to be written to clients. The same payload is shared by
+//every client it is delivered to and freed when the last one releases it.
+//created is the time it was made in nanoseconds, which its delivery latency
+//is measured from, and expires is when its time to live is up on the same
+//clock, or 0 if it never expires.
+typedef struct {
+    int refs;
+    bool expired;
+    int priority;
+    uint64_t created;
+    uint64_t expires;
+    char* topic;
+    char* data;
+    size_t len;
+} Payload;
+
+//One message waiting in a client's outgoing queue
+struct QueueEntry {
+    Payload* payload;
+    bool conflate;
+    struct QueueEntry* next;
+};
+
+typedef struct QueueEntry QueueEntry;
+
+//The messages of one priority class waiting to be staged for writing
+typedef struct {
+    QueueEntry* head;
+    QueueEntry* tail;
+    size_t length;
+} Lane;
+
+//How a client's lanes take turns being staged. Unless weighted, the most
+//urgent lane with messages always goes first. When weighted, the lanes take
+//turns from the most urgent, each staging up to its weight in messages per
+//turn, so bulk traffic still gets a share.
+typedef struct {
+    bool weighted;
+    int weights[PRIORITY_CLASSES];
+} DrainPolicy;
+
+//The messages waiting to be written to one client. Messages wait in the 
+//lane of their priority class until they are staged, and are then written
+//from the staged list starting at head. sent is the number of bytes of the
+//first staged entry that have already been written. length counts every
+//message in the queue and depths counts them by class. lane and credit are
+//the lane taking its turn and how many more messages it may stage.
+typedef struct {
+    QueueEntry* head;
+    QueueEntry* tail;
+    size_t sent;
+    size_t length;
+    size_t staged;
+    Lane lanes[PRIORITY_CLASSES];
+    size_t depths[PRIORITY_CLASSES];
+    int lane;
+    int credit;
+    bool closed;
+    pthread_mutex_t lock;
+} OutQueue;
+
+/* queue_clock()
+ * -------------
+ * Returns: the current value of the monotonic clock that payloads are 
+ * timestamped with, in nanoseconds
+ */
+uint64_t queue_clock(void);
+
+/* init_payload()
+ * --------------
+ * Creates a payload holding one line of text
+ *
+ * topic: the topic the line was published to, or NULL if it is a reply that
+ * does not belong to a topic
+ *
+ * data: the text to send, including the trailing newline. The payload takes
+ * ownership of it.
+ *
+ * len: the length of the text
+ *
+ * Returns: a payload with one reference held by the caller. Its priority is
+ * CONTROL_PRIORITY for a reply and DEFAULT_PRIORITY otherwise.
+ */
+Payload* init_payload(char* topic, char* data, size_t len);
+
+/* hold_payload()
+ * --------------
+ * Takes another reference to a payload
+ *
+ * payload: the payload being referenced
+ */
+void hold_payload(Payload* payload);
+
+/* release_payload()
+ * -----------------
+ * Drops a reference to a payload, freeing it if it was the last reference
+ *
+ * payload: the payload being released
+ */
+void release_payload(Payload* payload);
+
+/* expire_payload()
+ * ----------------
+ * Marks a payload as expired. Expired payloads are dropped rather than sent
+ * unless they are already partly written.
+ *
+ * payload: the payload that has expired
+ */
+void expire_payload(Payload* payload);
+
+/* is_expired()
+ * ------------
+ * Determines if a payload has expired
+ *
+ * payload: the payload being checked
+ *
+ * Returns: true if the payload has expired and false otherwise
+ */
+bool is_expired(Payload* payload);
+
+/* time_to_live()
+ * --------------
+ * Finds how long a payload has left before it expires
+ *
+ * payload: the payload being checked
+ *
+ * Returns: the number of milliseconds left, rounded up and at least 1, or 0
+ * if the payload never expires
+ */
+uint64_t time_to_live(Payload* payload);
+
+/* pop_entry()
+ * -----------
+ * Removes the first staged entry from the queue, staging the most urgent
+ * waiting message first if none are staged. The queue lock must be held.
+ *
+ * queue: the queue to remove from, which must not be empty
+ */
+void pop_entry(OutQueue* queue);
+
+/* stage_entries()
+ * ---------------
+ * Moves messages from the lanes to the end of the staged list, in the order
+ * the policy gives, until count are staged or the lanes are empty. The queue
+ * lock must be held.
+ *
+ * queue: the queue
+ *
+ * policy: how the lanes take turns, or NULL to always take the most urgent
+ *
+ * count: the number of messages wanted in the staged list
+ */
+void stage_entries(OutQueue* queue, DrainPolicy* policy, size_t count);
+
+/* init_queue()
+ * ------------
+ * Initialises an empty outgoing queue
+ *
+ * queue: the queue to initialise
+ */
+void init_queue(OutQueue* queue);
+
+/* free_queue()
+ * ------------
+ * Releases every message still waiting in the queue
+ *
+ * queue: the queue to free
+ */
+void free_queue(OutQueue* queue);
+
+/* enqueue()
+ * ---------
+ * Adds a message to the end of the lane for its priority. If the message is 
+ * conflated and a conflated message for the same topic is still waiting to 
+ * be written, the new message replaces the old one in place instead of 
+ * being added.
+ *
+ * queue: the queue to add to
+ *
+ * payload: the message to add. The queue takes its own reference.
+ *
+ * conflate: true if only the newest message for the topic is wanted
+ *
+ * Returns: true if an older message was replaced and false otherwise
+ */
+bool enqueue(OutQueue* queue, Payload* payload, bool conflate);
+
+/* close_queue()
+ * -------------
+ * Drops every waiting message and ignores any messages added later. Used
+ * once the client can no longer be written to.
+ *
+ * queue: the queue to close
+ */
+void close_queue(OutQueue* queue);
+#endif
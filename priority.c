@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "priority.h"
+
+#define PRIORITY_LINE_SIZE 256
+#define PRIORITY_NAME_SIZE 128
+#define PRIORITY_FIELD_COUNT 2
+#define DRAIN_KEYWORD "drain"
+
+void init_priorities(Priorities* priorities) {
+    priorities->rules = NULL;
+    priorities->policy.weighted = false;
+    for (int i = 0; i < PRIORITY_CLASSES; i++) {
+        priorities->policy.weights[i] = 1;
+    }
+}
+
+/* parse_drain()
+ * -------------
+ * Reads the policy from a "drain" line of a priorities file
+ *
+ * line: the line, after the "drain" keyword
+ *
+ * policy: set to the policy read
+ *
+ * Returns: true if the line is a valid policy and false otherwise
+ */
+bool parse_drain(char* line, DrainPolicy* policy) {
+    char mode[PRIORITY_NAME_SIZE];
+    int used;
+    if (sscanf(line, "%127s%n", mode, &used) != 1) {
+        return false;
+    }
+    if (!strcmp(mode, "strict")) {
+        policy->weighted = false;
+        return sscanf(line + used, "%127s", mode) != 1;
+    }
+    if (strcmp(mode, "weighted")) {
+        return false;
+    }
+
+    //Every lane needs a weight of at least one or it would never be sent
+    policy->weighted = true;
+    for (int i = 0; i < PRIORITY_CLASSES; i++) {
+        line += used;
+        if (sscanf(line, "%d%n", &policy->weights[i], &used) != 1 ||
+                policy->weights[i] < 1) {
+            return false;
+        }
+    }
+    return sscanf(line + used, "%127s", mode) != 1;
+}
+
+bool load_priorities(char* path, Priorities* priorities) {
+    init_priorities(priorities);
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[PRIORITY_LINE_SIZE];
+    char topic[PRIORITY_NAME_SIZE];
+    char rest[PRIORITY_NAME_SIZE];
+    int priority;
+    int used;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (sscanf(line, "%127s%n", topic, &used) == 1 && 
+                !strcmp(topic, DRAIN_KEYWORD) && 
+                parse_drain(line + used, &priorities->policy)) {
+            continue;
+        }
+        if (sscanf(line, "%127s %d %127s", topic, &priority, rest) !=
+                PRIORITY_FIELD_COUNT || priority < 0 || 
+                priority >= PRIORITY_CLASSES) {
+            ok = false;
+            break;
+        }
+        PriorityRule* rule = malloc(sizeof(PriorityRule));
+        rule->topic = strdup(topic);
+        rule->priority = priority;
+        rule->next = priorities->rules;
+        priorities->rules = rule;
+    }
+    fclose(file);
+    return ok;
+}
+
+int find_priority(Priorities* priorities, char* topic) {
+    int fallback = DEFAULT_PRIORITY;
+    for (PriorityRule* rule = priorities->rules; rule; rule = rule->next) {
+        if (!strcmp(rule->topic, topic)) {
+            return rule->priority;
+        }
+        if (!strcmp(rule->topic, "*")) {
+            fallback = rule->priority;
+        }
+    }
+    return fallback;
+}
@@ -0,0 +1,63 @@
+#ifndef PRIORITY_H
+#define PRIORITY_H
+
+#include <stdbool.h>
+#include "outQueue.h"
+
+//The priority class of the topic with the given name. A name of "*" applies
+//to every topic without a rule of its own.
+struct PriorityRule {
+    char* topic;
+    int priority;
+    struct PriorityRule* next;
+};
+
+typedef struct PriorityRule PriorityRule;
+
+//The priority classes of topics and how the lanes of each client's queue
+//take turns
+typedef struct {
+    PriorityRule* rules;
+    DrainPolicy policy;
+} Priorities;
+
+/* init_priorities()
+ * -----------------
+ * Sets up priorities with no rules, so every topic is DEFAULT_PRIORITY, and
+ * lanes drained most urgent first
+ *
+ * priorities: the priorities to set up
+ */
+void init_priorities(Priorities* priorities);
+
+/* load_priorities()
+ * -----------------
+ * Reads topic priorities from a file. Each line is of the form 
+ * "topic class", where class is from 0, the most urgent, to 
+ * PRIORITY_CLASSES - 1. A line "drain strict" sends the most urgent lane 
+ * with messages first, which is the default, and a line "drain weighted" 
+ * followed by PRIORITY_CLASSES weights gives each lane up to its weight in
+ * messages per turn. Blank lines and lines starting with '#' are ignored.
+ *
+ * path: the path of the file to read
+ *
+ * priorities: set up with the rules and policy read
+ *
+ * Returns: false if the file cannot be read or has an invalid line and true
+ * otherwise
+ */
+bool load_priorities(char* path, Priorities* priorities);
+
+/* find_priority()
+ * ---------------
+ * Finds the priority class of a topic
+ *
+ * priorities: the priorities
+ *
+ * topic: the name of the topic
+ *
+ * Returns: the class of the topic's rule, the class of the "*" rule if it
+ * has none, or DEFAULT_PRIORITY if there is neither
+ */
+int find_priority(Priorities* priorities, char* topic);
+#endif
@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rateLimit.h"
+
+#define RULE_LINE_SIZE 256
+#define RULE_NAME_SIZE 128
+#define RULE_FIELD_COUNT 3
+#define NANOSECONDS 1e9
+
+/* elapsed_seconds()
+ * -----------------
+ * Determines the number of seconds between two times
+ *
+ * from: the earlier time
+ *
+ * to: the later time
+ *
+ * Returns: the number of seconds from the first time to the second
+ */
+double elapsed_seconds(struct timespec* from, struct timespec* to) {
+    return (to->tv_sec - from->tv_sec) +
+            (to->tv_nsec - from->tv_nsec) / NANOSECONDS;
+}
+
+RateRule* load_rate_rules(char* path, bool* valid) {
+    *valid = false;
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+
+    RateRule* rules = NULL;
+    char line[RULE_LINE_SIZE];
+    char name[RULE_NAME_SIZE];
+    double rate, burst;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+        if (sscanf(line, "%127s %lf %lf", name, &rate, &burst) !=
+                RULE_FIELD_COUNT || rate <= 0 || burst < 1) {
+            ok = false;
+            break;
+        }
+        RateRule* rule = malloc(sizeof(RateRule));
+        rule->name = strdup(name);
+        rule->rate = rate;
+        rule->burst = burst;
+        rule->next = rules;
+        rules = rule;
+    }
+    fclose(file);
+    *valid = ok;
+    return rules;
+}
+
+RateRule* find_rate_rule(RateRule* rules, char* name) {
+    RateRule* fallback = NULL;
+    for (RateRule* rule = rules; rule; rule = rule->next) {
+        if (!strcmp(rule->name, name)) {
+            return rule;
+        }
+        if (!strcmp(rule->name, "*")) {
+            fallback = rule;
+        }
+    }
+    return fallback;
+}
+
+TokenBucket* init_bucket(RateRule* rule) {
+    TokenBucket* bucket = malloc(sizeof(TokenBucket));
+    bucket->rate = rule->rate;
+    bucket->burst = rule->burst;
+    bucket->tokens = rule->burst;
+    clock_gettime(CLOCK_MONOTONIC, &bucket->last);
+    return bucket;
+}
+
+double bucket_wait_time(TokenBucket* bucket) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    bucket->tokens += elapsed_seconds(&bucket->last, &now) * bucket->rate;
+    if (bucket->tokens > bucket->burst) {
+        bucket->tokens = bucket->burst;
+    }
+    bucket->last = now;
+
+    if (bucket->tokens >= 1) {
+        return 0;
+    }
+    return (1 - bucket->tokens) / bucket->rate;
+}
+
+void bucket_take(TokenBucket* bucket) {
+    bucket->tokens--;
+}
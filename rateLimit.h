@@ -0,0 +1,85 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdbool.h>
+#include <time.h>
+
+//A rate limit that applies to all clients with the given name. A name of "*"
+//applies to every client without a rule of its own.
+struct RateRule {
+    char* name;
+    double rate;
+    double burst;
+    struct RateRule* next;
+};
+
+typedef struct RateRule RateRule;
+
+//Token bucket that limits how quickly one client may publish
+typedef struct {
+    double rate;
+    double burst;
+    double tokens;
+    struct timespec last;
+} TokenBucket;
+
+/* load_rate_rules()
+ * -----------------
+ * Reads rate limit rules from a file. Each line is of the form
+ * "name rate burst" where rate is in publishes per second and burst is the
+ * number of publishes allowed back to back. Blank lines and lines starting
+ * with '#' are ignored.
+ *
+ * path: the path of the file to read
+ *
+ * valid: set to false if the file cannot be read or has an invalid line and
+ * true otherwise
+ *
+ * Returns: the list of rules, or NULL if there are none
+ */
+RateRule* load_rate_rules(char* path, bool* valid);
+
+/* find_rate_rule()
+ * ----------------
+ * Finds the rule that applies to a client
+ *
+ * rules: the first rule in the list
+ *
+ * name: the name of the client
+ *
+ * Returns: the rule for that name, the "*" rule if there is no rule for that
+ * name, or NULL if the client is not limited
+ */
+RateRule* find_rate_rule(RateRule* rules, char* name);
+
+/* init_bucket()
+ * -------------
+ * Creates a full token bucket for a rule
+ *
+ * rule: the rule that the bucket enforces
+ *
+ * Returns: a pointer to the new bucket
+ */
+TokenBucket* init_bucket(RateRule* rule);
+
+/* bucket_wait_time()
+ * ------------------
+ * Refills the bucket for the time that has passed and determines how long
+ * the client must wait before it may publish again
+ *
+ * bucket: the bucket being checked
+ *
+ * Returns: the number of seconds until a token is available, which is 0 if
+ * one is available now
+ */
+double bucket_wait_time(TokenBucket* bucket);
+
+/* bucket_take()
+ * -------------
+ * Removes one token from the bucket. The bucket may go into debt, in which
+ * case the client will wait longer next time.
+ *
+ * bucket: the bucket to take from
+ */
+void bucket_take(TokenBucket* bucket);
+#endif
@@ -0,0 +1,498 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include "sender.h"
+
+#define INITIAL_SENDER_SIZE 16
+#define DRAINED 0
+#define BLOCKED 1
+#define FAILED 2
+#define IOV_BATCH 64
+#define SENDER_FDS 2
+#define NANOSECONDS 1000000000L
+#define NANOS_PER_MICRO 1000L
+
+void* sender_thread(void* arg);
+
+/* monotonic_nanos()
+ * -----------------
+ * Returns: the current value of the monotonic clock in nanoseconds
+ */
+long monotonic_nanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NANOSECONDS + now.tv_nsec;
+}
+
+/* push_client()
+ * -------------
+ * Adds a client to one of the sender's growable client arrays
+ *
+ * array: a pointer to the array
+ *
+ * count: a pointer to the number of clients in the array
+ *
+ * size: a pointer to the capacity of the array
+ *
+ * client: the client to add
+ */
+void push_client(Client*** array, int* count, int* size, Client* client) {
+    if (*count == *size) {
+        *size *= 2;
+        *array = realloc(*array, *size * sizeof(Client*));
+    }
+    (*array)[(*count)++] = client;
+}
+
+/* drop_client()
+ * -------------
+ * Removes a client from one of the sender's client arrays if it is there
+ *
+ * array: the array
+ *
+ * count: a pointer to the number of clients in the array
+ *
+ * client: the client to remove
+ */
+void drop_client(Client** array, int* count, Client* client) {
+    for (int i = 0; i < *count; i++) {
+        if (array[i] == client) {
+            array[i] = array[--(*count)];
+            return;
+        }
+    }
+}
+
+bool init_sender(Sender* sender, TraceLog* trace, int profile, 
+        long flushDelay, DrainPolicy* policy) {
+    //Both ends of the wake pipe are non-blocking, as a full pipe already 
+    //holds a wake up and the sender empties it without waiting
+    if (pipe(sender->wake) < 0) {
+        return false;
+    }
+    sender->timer = timerfd_create(CLOCK_MONOTONIC, 
+            TFD_CLOEXEC | TFD_NONBLOCK);
+    if (sender->timer < 0 || 
+            fcntl(sender->wake[0], F_SETFL, O_NONBLOCK) < 0 ||
+            fcntl(sender->wake[1], F_SETFL, O_NONBLOCK) < 0) {
+        close(sender->wake[0]);
+        close(sender->wake[1]);
+        if (sender->timer >= 0) {
+            close(sender->timer);
+        }
+        return false;
+    }
+
+    pthread_mutex_init(&sender->lock, NULL);
+    pthread_cond_init(&sender->flushed, NULL);
+    memset(sender->latency, 0, sizeof(sender->latency));
+    sender->policy = policy;
+    sender->trace = trace;
+    sender->profile = profile;
+    sender->flushDelay = flushDelay * NANOS_PER_MICRO;
+    sender->due = 0;
+    sender->pendingSize = INITIAL_SENDER_SIZE;
+    sender->pendingCount = 0;
+    sender->pending = malloc(sizeof(Client*) * sender->pendingSize);
+    sender->blockedSize = INITIAL_SENDER_SIZE;
+    sender->blockedCount = 0;
+    sender->blocked = malloc(sizeof(Client*) * sender->blockedSize);
+    sender->writingSize = INITIAL_SENDER_SIZE;
+    sender->writingCount = 0;
+    sender->writing = malloc(sizeof(Client*) * sender->writingSize);
+    sender->resultsSize = INITIAL_SENDER_SIZE;
+    sender->results = malloc(sizeof(int) * sender->resultsSize);
+    sender->flushing = false;
+    sender->sleeping = false;
+
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, sender_thread, sender);
+    pthread_detach(threadId);
+    return true;
+}
+
+void configure_socket(int fd) {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(int));
+}
+
+/* add_pending()
+ * -------------
+ * Adds a client to the clients waiting to be written. The sender lock must
+ * be held.
+ *
+ * sender: the sender
+ *
+ * client: the client with messages waiting
+ */
+void add_pending(Sender* sender, Client* client) {
+    client->scheduled = true;
+    push_client(&sender->pending, &sender->pendingCount,
+            &sender->pendingSize, client);
+
+    //The sender is already waiting for the deadline of earlier clients if
+    //there are any, and this client is written along with them
+    if (sender->pendingCount == 1) {
+        sender->due = monotonic_nanos() + sender->flushDelay;
+    }
+}
+
+void schedule_client(Sender* sender, Client* client) {
+    pthread_mutex_lock(&sender->lock);
+    if (!client->scheduled) {
+        add_pending(sender, client);
+        if (sender->sleeping && sender->pendingCount == 1) {
+            sender->sleeping = false;
+            char byte = 0;
+            while (write(sender->wake[1], &byte, 1) < 0 && errno == EINTR) {
+            }
+        }
+    }
+    pthread_mutex_unlock(&sender->lock);
+}
+
+void unschedule_client(Sender* sender, Client* client) {
+    pthread_mutex_lock(&sender->lock);
+    drop_client(sender->pending, &sender->pendingCount, client);
+    drop_client(sender->blocked, &sender->blockedCount, client);
+
+    //The sender may be writing to the client with the lock let go
+    bool writing = false;
+    for (int i = 0; i < sender->writingCount; i++) {
+        if (sender->writing[i] == client) {
+            __atomic_store_n(&sender->writing[i], NULL, __ATOMIC_RELAXED);
+            writing = true;
+        }
+    }
+    while (writing && sender->flushing) {
+        pthread_cond_wait(&sender->flushed, &sender->lock);
+    }
+    client->scheduled = false;
+    pthread_mutex_unlock(&sender->lock);
+}
+
+void pause_sender(Sender* sender) {
+    pthread_mutex_lock(&sender->lock);
+    while (sender->flushing) {
+        pthread_cond_wait(&sender->flushed, &sender->lock);
+    }
+}
+
+void resume_sender(Sender* sender) {
+    pthread_mutex_unlock(&sender->lock);
+}
+
+/* set_cork()
+ * ----------
+ * Corks or uncorks a socket. While corked, the kernel only sends full 
+ * segments, and uncorking sends whatever is left.
+ *
+ * fd: the socket
+ *
+ * cork: true to cork the socket and false to uncork it
+ */
+void set_cork(int fd, bool cork) {
+    int value = cork;
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(int));
+}
+
+/* gather_entries()
+ * ----------------
+ * Fills an iovec array with the unsent part of the messages at the front of
+ * a queue. Gathering stops before an expired message so that it can be 
+ * dropped rather than sent. The queue lock must be held.
+ *
+ * queue: the queue, which must not be empty
+ *
+ * iov: the array to fill, with room for IOV_BATCH entries
+ *
+ * Returns: the number of entries filled
+ */
+int gather_entries(OutQueue* queue, struct iovec* iov) {
+    QueueEntry* entry = queue->head;
+    size_t offset = queue->sent;
+    int count = 0;
+    while (entry && count < IOV_BATCH && 
+            (count == 0 || !is_expired(entry->payload))) {
+        iov[count].iov_base = entry->payload->data + offset;
+        iov[count].iov_len = entry->payload->len - offset;
+        offset = 0;
+        count++;
+        entry = entry->next;
+    }
+    return count;
+}
+
+/* record_latency()
+ * ----------------
+ * Records the delivery latency of a message that has been written in full
+ *
+ * sender: the sender
+ *
+ * entry: the queue entry of the message
+ *
+ * now: the current time in nanoseconds
+ */
+void record_latency(Sender* sender, QueueEntry* entry, uint64_t now) {
+    LaneLatency* latency = &sender->latency[entry->payload->priority];
+    uint64_t nanos = now - entry->payload->created;
+    __atomic_add_fetch(&latency->delivered, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&latency->total, nanos, __ATOMIC_RELAXED);
+    if (nanos > latency->max) {
+        __atomic_store_n(&latency->max, nanos, __ATOMIC_RELAXED);
+    }
+}
+
+/* consume_entries()
+ * -----------------
+ * Removes the messages that a write has finished from the front of a queue
+ * and records how much of the next one was written. The queue lock must be
+ * held.
+ *
+ * sender: the sender, which records the latency of each finished message
+ *
+ * queue: the queue
+ *
+ * written: the number of bytes written
+ */
+void consume_entries(Sender* sender, OutQueue* queue, size_t written) {
+    uint64_t now = queue_clock();
+    while (written > 0) {
+        size_t left = queue->head->payload->len - queue->sent;
+        if (written < left) {
+            queue->sent += written;
+            return;
+        }
+        written -= left;
+        record_latency(sender, queue->head, now);
+        pop_entry(queue);
+    }
+}
+
+/* flush_client()
+ * --------------
+ * Writes as much of a client's queue as its socket will take without
+ * blocking. Up to IOV_BATCH messages are staged from the client's lanes and
+ * written with each sendmsg().
+ *
+ * sender: the sender
+ *
+ * client: the client to write to
+ *
+ * cork: true if a backlog too big for one sendmsg() should be corked so it
+ * leaves in full segments
+ *
+ * tracer: the trace ring of the sender's thread
+ *
+ * Returns: DRAINED if the queue is now empty, BLOCKED if the socket is full
+ * and FAILED if the client can no longer be written to
+ */
+int flush_client(Sender* sender, Client* client, bool cork, 
+        TraceRing* tracer) {
+    OutQueue* queue = &client->queue;
+    struct iovec iov[IOV_BATCH];
+    struct msghdr message;
+    memset(&message, 0, sizeof(struct msghdr));
+    message.msg_iov = iov;
+    uint32_t total = 0;
+    int result = DRAINED;
+    trace_event(tracer, TRACE_WRITE_BEGIN, client->fd, 0);
+    pthread_mutex_lock(&queue->lock);
+    bool corked = cork && queue->length > IOV_BATCH;
+    if (corked) {
+        set_cork(client->fd, true);
+    }
+    while (queue->length) {
+        stage_entries(queue, sender->policy, IOV_BATCH);
+        if (!queue->sent && is_expired(queue->head->payload)) {
+            pop_entry(queue);
+            continue;
+        }
+        message.msg_iovlen = gather_entries(queue, iov);
+        ssize_t written = sendmsg(client->fd, &message, 
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = (errno == EAGAIN || errno == EWOULDBLOCK) ? BLOCKED : 
+                    FAILED;
+            break;
+        }
+        total += written;
+        consume_entries(sender, queue, written);
+    }
+    if (corked) {
+        set_cork(client->fd, false);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    if (result == FAILED) {
+        close_queue(queue);
+    }
+    trace_event(tracer, TRACE_WRITE_END, client->fd, total);
+    return result;
+}
+
+/* has_messages()
+ * --------------
+ * Returns: true if the client's queue holds messages and false otherwise
+ */
+bool has_messages(Client* client) {
+    pthread_mutex_lock(&client->queue.lock);
+    bool waiting = client->queue.length > 0;
+    pthread_mutex_unlock(&client->queue.lock);
+    return waiting;
+}
+
+/* flush_pending()
+ * ---------------
+ * Writes to every pending client, setting aside those whose sockets are 
+ * full. The sender lock must be held, and is let go while the clients are
+ * written so that publishers scheduling more clients do not wait behind the
+ * writes. Clients scheduled in the meantime are left for the next pass.
+ *
+ * sender: the sender
+ *
+ * tracer: the trace ring of the sender's thread
+ */
+void flush_pending(Sender* sender, TraceRing* tracer) {
+    bool cork = sender->profile == PROFILE_THROUGHPUT;
+    Client** writing = sender->writing;
+    int writingSize = sender->writingSize;
+    sender->writing = sender->pending;
+    sender->writingSize = sender->pendingSize;
+    sender->writingCount = sender->pendingCount;
+    sender->pending = writing;
+    sender->pendingSize = writingSize;
+    sender->pendingCount = 0;
+    if (sender->resultsSize < sender->writingCount) {
+        sender->resultsSize = sender->writingSize;
+        sender->results = realloc(sender->results, 
+                sizeof(int) * sender->resultsSize);
+    }
+    sender->flushing = true;
+    pthread_mutex_unlock(&sender->lock);
+
+    //unschedule_client() clears the slot of a client being removed, and 
+    //waits for the pass to finish if it was too late to
+    for (int i = 0; i < sender->writingCount; i++) {
+        Client* client = __atomic_load_n(&sender->writing[i], 
+                __ATOMIC_RELAXED);
+        if (client) {
+            sender->results[i] = flush_client(sender, client, cork, tracer);
+        }
+    }
+
+    pthread_mutex_lock(&sender->lock);
+    sender->flushing = false;
+    pthread_cond_broadcast(&sender->flushed);
+    for (int i = 0; i < sender->writingCount; i++) {
+        Client* client = sender->writing[i];
+        if (!client) {
+            continue;
+        }
+        if (sender->results[i] == BLOCKED) {
+            push_client(&sender->blocked, &sender->blockedCount,
+                    &sender->blockedSize, client);
+        } else if (sender->results[i] == DRAINED && has_messages(client)) {
+            //Messages queued during the write found the client still 
+            //scheduled, so it is scheduled again for them
+            add_pending(sender, client);
+        } else {
+            client->scheduled = false;
+        }
+    }
+    sender->writingCount = 0;
+}
+
+/* sender_thread()
+ * ---------------
+ * Writes queued messages to clients for the life of the server. Pending 
+ * clients are written once their flush deadline has passed, and clients 
+ * whose sockets are full are retried once poll() reports them writable.
+ *
+ * arg: a pointer to the Sender struct
+ */
+void* sender_thread(void* arg) {
+    Sender* sender = arg;
+    struct pollfd* fds = NULL;
+    int fdsSize = 0;
+    TraceRing* tracer = register_tracer(sender->trace, "sender");
+
+    pthread_mutex_lock(&sender->lock);
+    while (true) {
+        if (sender->pendingCount && sender->due <= monotonic_nanos()) {
+            flush_pending(sender, tracer);
+        }
+
+        //Clients still pending are waiting for their deadline, which the
+        //timer goes off at
+        if (sender->pendingCount) {
+            struct itimerspec deadline;
+            memset(&deadline, 0, sizeof(struct itimerspec));
+            deadline.it_value.tv_sec = sender->due / NANOSECONDS;
+            deadline.it_value.tv_nsec = sender->due % NANOSECONDS;
+            timerfd_settime(sender->timer, TFD_TIMER_ABSTIME, &deadline, 
+                    NULL);
+        }
+
+        //Wait for a full socket to drain, for more messages or for the 
+        //deadline
+        if (fdsSize < sender->blockedCount + SENDER_FDS) {
+            fdsSize = sender->blockedCount + SENDER_FDS;
+            fds = realloc(fds, fdsSize * sizeof(struct pollfd));
+        }
+        fds[0].fd = sender->wake[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = sender->timer;
+        fds[1].events = POLLIN;
+        for (int i = 0; i < sender->blockedCount; i++) {
+            fds[i + SENDER_FDS].fd = sender->blocked[i]->fd;
+            fds[i + SENDER_FDS].events = POLLOUT;
+        }
+        int count = sender->blockedCount + SENDER_FDS;
+        sender->sleeping = true;
+        pthread_mutex_unlock(&sender->lock);
+
+        if (poll(fds, count, -1) < 0) {
+            fds[0].revents = fds[1].revents = 0;
+        }
+        if (fds[0].revents & POLLIN) {
+            char bytes[INITIAL_SENDER_SIZE];
+            ssize_t got;
+            while ((got = read(sender->wake[0], bytes, sizeof(bytes))) > 0 ||
+                    (got < 0 && errno == EINTR)) {
+            }
+        }
+
+        //A timer set again since poll() returned has nothing to read yet
+        if (fds[1].revents & POLLIN) {
+            uint64_t expirations;
+            while (read(sender->timer, &expirations, sizeof(uint64_t)) < 0 &&
+                    errno == EINTR) {
+            }
+        }
+
+        //Full sockets have already waited, so they are retried straight away
+        pthread_mutex_lock(&sender->lock);
+        sender->sleeping = false;
+        if (sender->blockedCount && !sender->pendingCount) {
+            sender->due = monotonic_nanos();
+        }
+        for (int i = 0; i < sender->blockedCount; i++) {
+            push_client(&sender->pending, &sender->pendingCount,
+                    &sender->pendingSize, sender->blocked[i]);
+        }
+        sender->blockedCount = 0;
+    }
+    return NULL;
+}
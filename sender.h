@@ -0,0 +1,132 @@
+#ifndef SENDER_H
+#define SENDER_H
+
+#include <pthread.h>
+#include "clientList.h"
+#include "trace.h"
+
+//Profiles that set how the sender trades latency for fewer, larger writes.
+//With PROFILE_LATENCY messages are written as soon as they are queued. With
+//PROFILE_THROUGHPUT clients wait up to the flush delay for more messages to
+//join them, and large backlogs are corked so they leave in full segments.
+#define PROFILE_LATENCY 0
+#define PROFILE_THROUGHPUT 1
+
+//The flush delay of each profile, in microseconds, unless one is given
+#define LATENCY_FLUSH_DELAY 0
+#define THROUGHPUT_FLUSH_DELAY 1000
+
+//The delivery latency of one priority class, from a message being made to
+//the last of it being written to a client, in nanoseconds
+typedef struct {
+    uint64_t delivered;
+    uint64_t total;
+    uint64_t max;
+} LaneLatency;
+
+//The thread that writes queued messages to clients. Sockets are written
+//without blocking, so a slow client only holds up its own queue. Everything
+//queued for a client is written together with sendmsg(), and pending 
+//clients are written at most flushDelay nanoseconds after the first of them
+//was scheduled. Each client's lanes are staged for writing as policy says,
+//and the latency of each class is recorded. Each write to a client is 
+//recorded in the trace log. Pending clients are swapped into writing and 
+//written with the lock let go, with flushing set until the pass is over and
+//flushed signalled when it is, and the outcome of each write in results.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;
+    int profile;
+    long flushDelay;
+    DrainPolicy* policy;
+    LaneLatency latency[PRIORITY_CLASSES];
+    long due;
+    Client** pending;
+    int pendingCount;
+    int pendingSize;
+    Client** blocked;
+    int blockedCount;
+    int blockedSize;
+    Client** writing;
+    int writingCount;
+    int writingSize;
+    int* results;
+    int resultsSize;
+    bool flushing;
+    int wake[2];
+    int timer;
+    bool sleeping;
+    TraceLog* trace;
+} Sender;
+
+/* init_sender()
+ * -------------
+ * Sets up the sender and starts its thread
+ *
+ * sender: the sender to set up
+ *
+ * trace: the trace log the sender's thread records its writes in
+ *
+ * profile: PROFILE_LATENCY or PROFILE_THROUGHPUT
+ *
+ * flushDelay: the longest a queued message may wait for others to join it,
+ * in microseconds
+ *
+ * policy: how the priority lanes of each client take turns
+ *
+ * Returns: true if the sender was started and false if its wake pipe or 
+ * timer could not be made
+ */
+bool init_sender(Sender* sender, TraceLog* trace, int profile, 
+        long flushDelay, DrainPolicy* policy);
+
+/* configure_socket()
+ * ------------------
+ * Sets the options of a client's socket for the sender. Nagle's algorithm is
+ * turned off in both profiles, as the sender already gathers small messages 
+ * into one write and Nagle would only hold the last of them back waiting for
+ * an acknowledgement.
+ *
+ * fd: the client's socket
+ */
+void configure_socket(int fd);
+
+/* schedule_client()
+ * -----------------
+ * Tells the sender that a client has messages waiting in its queue
+ *
+ * sender: the sender
+ *
+ * client: the client with messages waiting
+ */
+void schedule_client(Sender* sender, Client* client);
+
+/* unschedule_client()
+ * -------------------
+ * Stops the sender from writing to a client. Once this returns the sender
+ * will not touch the client again, so it may be freed. If the client is 
+ * being written to, this waits for the sender's current pass to finish.
+ *
+ * sender: the sender
+ *
+ * client: the client being removed
+ */
+void unschedule_client(Sender* sender, Client* client);
+
+/* pause_sender()
+ * --------------
+ * Stops the sender from writing to any client, waiting for a pass that has
+ * already started to finish, until resume_sender() is called
+ *
+ * sender: the sender
+ */
+void pause_sender(Sender* sender);
+
+/* resume_sender()
+ * ---------------
+ * Lets a sender stopped by pause_sender() carry on
+ *
+ * sender: the sender
+ */
+void resume_sender(Sender* sender);
+#endif
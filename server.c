@@ -9,33 +9,99 @@
 #include <csse2310a3.h>
 #include <csse2310a4.h>
 #include <string.h>
-#include <stringmap.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include "clientList.h"
+#include "topic.h"
+#include "topicTable.h"
+#include "epoch.h"
 #include <semaphore.h>
 #include <signal.h>
+#include <time.h>
+#include "fairLock.h"
+#include "rateLimit.h"
+#include "outQueue.h"
+#include "sender.h"
+#include "timerWheel.h"
+#include "deliveryPool.h"
+#include "lineReader.h"
+#include "handoff.h"
+#include "trace.h"
+#include "hotTopics.h"
+#include "deflateFrame.h"
+#include "priority.h"
+#include "filter.h"
 
 #define INITIAL_CLIENTS_SIZE 5
 #define SUBSCRIBE 0
 #define UNSUBSCRIBE 1
 #define PUBLISH 2
+#define UNSUBSCRIBE_GROUP 5
+#define PUBLISH_DELAYED 6
+#define PUBLISH_TTL 7
 #define INVALID_COMMAND -1
 #define INITIAL_LIST_SIZE 1
 #define INVALID_FORMAT_EXIT 1
 #define CONNECTION_ERROR_EXIT 2
+#define STARTUP_ERROR_EXIT 3
 #define MIN_ARG_COUNT 2
-#define MAX_ARG_COUNT 3
+#define MAX_POSITIONAL_COUNT 3
 #define CONNECTIONS_POS 1
 #define PORT_POS 2
 #define MIN_PORT_LIMIT 1024
 #define MAX_PORT_LIMIT 65535
 #define NAME_POS 1
+#define DEFLATE_POS 2
+#define DEFLATE_OPTION "deflate"
 #define TOPIC_POS 1
+#define GROUP_KEYWORD_POS 2
+#define GROUP_POS 3
+#define GROUP_ARG_COUNT 4
+#define FIRST_SUB_OPTION_POS 2
+#define MESSAGE_EXTRA_CHARS 4
+#define TIMED_PUB_FIELD_COUNT 4
+#define TIMED_PUB_DELAY_POS 1
+#define TIMED_PUB_TOPIC_POS 2
+#define TIMED_PUB_VALUE_POS 3
 #define IGNORE 3
+#define OPTION_PREFIX "--"
+#define NANOSECONDS 1e9
+#define HANDOFF_SIGNAL SIGUSR2
+#define HANDOFF_MAGIC 0x31485350
+#define HANDOFF_RETRY_NANOS 10000000
+#define HANDOFF_ACK 'k'
+#define MILLISECONDS 1000
+#define NANOS_PER_MILLI 1e6
+#define DEFAULT_HISTORY 256
+#define TOPIC_RETENTION 60000
+#define TRACE_SIGNAL SIGUSR1
+#define TRACE_PATH_SIZE 64
+#define SEQUENCE_EXTRA_CHARS 23
+#define GAP_EXTRA_CHARS 48
+#define LOOP_EVENTS 64
+#define INITIAL_PENDING_SIZE 8
+#define HOT_TOPIC_COUNT 10
+#define FORM_PLAIN 0
+#define FORM_SEQUENCED 1
+#define FORM_DEFLATE 2
+#define MESSAGE_FORMS 4
+#define DEFAULT_MAX_MESSAGE (1024 * 1024)
+#define PUB_PREFIX "pub "
 
 //Struct stores command line argument information
 typedef struct {
     int connections;
     char* port;
+    RateRule* rateRules;
+    int workers;
+    char* handoffPath;
+    int history;
+    int readers;
+    int profile;
+    long flushDelay;
+    Priorities priorities;
+    int maxMessage;
 } Params;
 
 //Struct stores the stats of the psserver
@@ -45,59 +111,290 @@ typedef struct {
     int pubCount;
     int subCount;
     int unsubCount;
+    int conflatedCount;
     int maxClients;
+    Node* clients;
+    TimerWheel* wheel;
+    TraceLog* trace;
+    TopicTable* topics;
+    EpochDomain* epoch;
+    HotTopics* hot;
+    Sender* sender;
     sem_t* guard;
     sigset_t* set;
     pthread_mutex_t* lockStat;
 } Stats;
 
-//Stores the data required for one client thread
+//Tracks the threads that must stand still while the server hands its
+//clients over to a new process. threads counts the client threads, the
+//reader loops and the accepting thread, and parked counts those that have
+//stopped.
 typedef struct {
-    Client* client;
-    StringMap* map;
-    pthread_mutex_t* lock;
+    bool frozen;
+    int threads;
+    int parked;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t acceptThread;
+    int listenFd;
+} HandoffState;
+
+//Stores the state shared by every client thread. Publishers read the topic
+//table without a lock while changes to subscriptions take turns on lock.
+//loops holds the reader loops when clients do not have a thread each.
+typedef struct {
+    TopicTable* topics;
+    FairLock* lock;
+    EpochDomain* epoch;
+    EpochRecord* timerReader;
     Stats* stats;
+    Params* params;
+    Sender* sender;
+    TimerWheel* wheel;
+    DeliveryPool* pool;
+    HandoffState* handoff;
+    TraceLog* trace;
+    struct ReaderLoop* loops;
+    unsigned int nextLoop;
+} Server;
+
+//Stores the data required for one client thread. A client served by a 
+//reader loop has no thread of its own and uses the loop's epoch record and
+//trace ring.
+typedef struct {
+    Client* client;
+    Server* server;
+    EpochRecord* reader;
+    TraceRing* tracer;
+    struct ReaderLoop* loop;
 } ClientThreadInfo;
 
+//A thread that reads commands from many clients with epoll, used instead of
+//a thread per client when --readers is given so that an idle client costs
+//little more than its Client struct. Clients the loop must serve without
+//waiting for input, such as one whose throttling has ended, are put on
+//pending and the loop is woken through wakeFd. A client is never watched
+//for input while it is pending.
+struct ReaderLoop {
+    int epollFd;
+    int wakeFd;
+    pthread_t thread;
+    Server* server;
+    EpochRecord* reader;
+    TraceRing* tracer;
+    sem_t* ready;
+    ClientThreadInfo** pending;
+    int pendingCount;
+    int pendingSize;
+    pthread_mutex_t lock;
+};
+
+typedef struct ReaderLoop ReaderLoop;
+
+//A timer that hands a throttled client back to its reader loop once it may
+//publish again
+typedef struct {
+    Timer timer;
+    ClientThreadInfo* cti;
+} Wakeup;
+
+//A publish waiting on the timer wheel until it is due to be delivered
+typedef struct {
+    Timer timer;
+    Server* server;
+    char* name;
+    char* topic;
+    char* value;
+} DelayedPublish;
+
+//Stores what every subscriber of a fan-out is sent. The message takes one
+//form for each combination of FORM_SEQUENCED, which puts its number in 
+//front, and FORM_DEFLATE, which compresses it. The plain form is made before
+//the fan-out, as is the sequenced form if the topic keeps its history, while
+//the other forms are made under lock by the first subscriber that needs them
+//and shared by the rest. seq is the number of the message.
+typedef struct {
+    Server* server;
+    Payload* forms[MESSAGE_FORMS];
+    uint64_t seq;
+    bool conflate;
+    pthread_mutex_t lock;
+} DeliveryJob;
+
+//A timer that marks a message as expired once its time to live is up. forms
+//holds every form of the message that was made.
+typedef struct {
+    Timer timer;
+    Payload* forms[MESSAGE_FORMS];
+} Expiry;
+
+//A timer that removes a topic once it has had no subscribers for
+//TOPIC_RETENTION milliseconds
+typedef struct {
+    Timer timer;
+    Server* server;
+    char* topic;
+} Retention;
+
+//Stores the options given to a sub command. after is the number of the last
+//message the client has seen when replay is set, and filter is the test
+//values must pass when filtered is set.
+typedef struct {
+    char* group;
+    bool conflate;
+    bool sequenced;
+    bool replay;
+    uint64_t after;
+    bool filtered;
+    Filter filter;
+} SubOptions;
+
 void init_stats(Stats* stats, int maxClients);
 void validate_commands(int argc, char** argv, Params* params);
 bool is_valid_port(char* port);
 bool is_non_neg_int(char* value);
 void invalid_format();
 int open_listen(Params* params);
-void process_connections(int fdServer, Stats* stats, StringMap* map, 
-        pthread_mutex_t* lock);
+void parse_option(char* option, char* value, Params* params);
+void print_listen_port(int listenFd);
+void process_connections(int fdServer, Server* server);
+ClientThreadInfo* init_client(Server* server, int fd);
+void start_client(ClientThreadInfo* cti);
 void* client_thread(void* arg);
-void subscribe(ClientThreadInfo* cti, char* topic);
+void start_reader_loops(Server* server);
+ReaderLoop* next_reader_loop(Server* server);
+void* reader_loop(void* arg);
+void watch_client(ClientThreadInfo* cti, uint32_t events, int op);
+void queue_pending(ReaderLoop* loop, ClientThreadInfo* cti);
+void serve_pending(ReaderLoop* loop);
+void serve_client(ClientThreadInfo* cti, bool readable);
+bool defer_client(ClientThreadInfo* cti);
+void wake_client(void* arg);
+void handle_command(ClientThreadInfo* cti, char* buffer);
+bool wait_for_handoff(Server* server);
+void interrupt_handler(int sig);
+void* handoff_thread(void* arg);
+bool hand_over(Server* server, int sock);
+void freeze_server(Server* server);
+void thaw_server(Server* server);
+void save_state(Server* server, Snapshot* snapshot, int** fds, int* count,
+        uint64_t frozenAt);
+void save_client(Snapshot* snapshot, Client* client);
+void save_queue(Snapshot* snapshot, OutQueue* queue);
+void save_client_list(Snapshot* snapshot, Node* list, Client** clients,
+        int count);
+void save_topic(Snapshot* snapshot, TopicEntry* entry, Client** clients,
+        int count);
+void save_delayed_publish(Timer* timer, uint64_t delay, void* arg);
+bool take_over(Server* server, int sock);
+bool restore_state(Server* server, Snapshot* snapshot, int* fds, int count,
+        ClientThreadInfo*** ctis, uint64_t* frozenAt);
+Client** restore_client_list(Snapshot* snapshot, ClientThreadInfo** ctis, 
+        uint32_t count, uint32_t* listCount);
+bool restore_queue(Server* server, Snapshot* snapshot, OutQueue* queue);
+bool restore_topic(Server* server, Snapshot* snapshot, 
+        ClientThreadInfo** ctis, uint32_t count);
+bool restore_filtered(Snapshot* snapshot, Topic* topic, 
+        ClientThreadInfo** ctis, uint32_t count);
+uint64_t now_nanos(void);
+void name_client(ClientThreadInfo* cti, char* name);
+void throttle_client(ClientThreadInfo* cti);
+void lock_subscriptions(ClientThreadInfo* cti);
+void unlock_subscriptions(ClientThreadInfo* cti);
+void change_subscription(ClientThreadInfo* cti, char* buffer, int command);
+void keep_recent_messages(ClientThreadInfo* cti, char* topic);
+Topic* find_or_add_topic(ClientThreadInfo* cti, char* topic);
+void subscribe(ClientThreadInfo* cti, char* topic, bool conflate);
+void subscribe_after(ClientThreadInfo* cti, char* topic, bool conflate,
+        uint64_t after);
+void subscribe_filtered(ClientThreadInfo* cti, char* topic, Filter* filter,
+        bool conflate);
 void unsubscribe(ClientThreadInfo* cti, char* topic);
+void subscribe_group(ClientThreadInfo* cti, char* topic, char* group, 
+        bool conflate);
+void unsubscribe_group(ClientThreadInfo* cti, char* topic, char* group);
+void remove_empty_topic(ClientThreadInfo* cti, char* topic, Topic* topicInfo);
+void retain_topic(Server* server, char* topic, Topic* topicInfo,
+        uint64_t emptyFor);
+void fire_retention(void* arg);
 void publish(ClientThreadInfo* cti, char* buffer);
+void publish_timed(ClientThreadInfo* cti, char* buffer, bool delayed);
+void publish_message(Server* server, EpochRecord* reader, char* name, 
+        char* topic, char* value, uint64_t ttl);
+Payload* stamp_payload(Payload* payload, uint64_t seq);
+Payload* deflate_payload(Payload* payload);
+Payload* get_form(DeliveryJob* job, int form);
+void fire_delayed_publish(void* arg);
+void fire_expiry(void* arg);
+void expire_later(Server* server, Payload* payload, uint64_t ttl);
+void deliver(Server* server, Client* client, Payload* payload, 
+        bool conflate);
+void deliver_job(Client* client, void* arg);
+void reply(ClientThreadInfo* cti, char* text);
 int validate_cmd(char* cmd);
+bool parse_pub(char* line, size_t* topicLen, char** value);
+bool parse_sub_options(char** args, int count, SubOptions* options);
 int count_args(char** args);
 bool is_name(char* line);
 void connection_error();
 void clean_up_client(ClientThreadInfo* cti);
 void* signal_handler(void* arg);
+void print_stats(Stats* stats, EpochRecord* reader);
+void print_hot_topics(Stats* stats, EpochRecord* reader, bool byBytes);
+void print_priorities(Stats* stats);
+int compare_clients(const void* a, const void* b);
 
 int main(int argc, char** argv) {
     Params params;
     validate_commands(argc, argv, &params);
-    int fdServer = open_listen(&params);
 
-    //Setup lock to protect client list
-    pthread_mutex_t lock;
-    pthread_mutex_init(&lock, NULL);
+    //Take over from a running server if there is one, otherwise listen
+    int sock = params.handoffPath ? connect_handoff(params.handoffPath) : -1;
+    int fdServer = sock < 0 ? open_listen(&params) : -1;
+
+    //Setup lock that changes to subscriptions take turns on. Clients are 
+    //served in the order they ask for it so a busy client cannot starve the
+    //others
+    FairLock lock;
+    fair_lock_init(&lock);
     pthread_mutex_t lockStat;
     pthread_mutex_init(&lockStat, NULL);
 
-    StringMap* map = stringmap_init();
+    //Topics are read by publishers without a lock, and anything unlinked
+    //from them is freed once no publisher can still be using it
+    EpochDomain epoch;
+    init_epoch_domain(&epoch);
+    TopicTable topics;
+    init_topic_table(&topics, &epoch);
 
     Stats stats;
     init_stats(&stats, params.connections);
+    stats.topics = &topics;
+    stats.epoch = &epoch;
+
+    //Count the hottest topics without keeping stats for every topic
+    HotTopics hot;
+    init_hot_topics(&hot);
+    stats.hot = &hot;
+
+    //Every thread records what it is doing in its own trace ring, which are
+    //dumped to a file on TRACE_SIGNAL
+    TraceLog trace;
+    init_trace_log(&trace);
+    stats.trace = &trace;
+
+    //Signal used to interrupt threads that are blocked reading when the
+    //server hands over to a new process
+    struct sigaction interrupt;
+    memset(&interrupt, 0, sizeof(struct sigaction));
+    interrupt.sa_handler = interrupt_handler;
+    sigaction(HANDOFF_SIGNAL, &interrupt, NULL);
 
     //Create thread that handles signal
     sigset_t set;
     sigemptyset(&set);
     sigaddset(&set, SIGHUP);
+    sigaddset(&set, TRACE_SIGNAL);
     pthread_sigmask(SIG_BLOCK, &set, NULL);
     stats.set = &set;
     stats.lockStat = &lockStat;
@@ -105,35 +402,188 @@ int main(int argc, char** argv) {
     pthread_t threadId;
     pthread_create(&threadId, NULL, signal_handler, &stats);
     pthread_detach(threadId);
+
+    //Start the thread that writes queued messages to clients
+    Sender sender;
+    if (!init_sender(&sender, &trace, params.profile, params.flushDelay,
+            &params.priorities.policy)) {
+        fprintf(stderr, "psserver: unable to start the sender\n");
+        exit(STARTUP_ERROR_EXIT);
+    }
+    stats.sender = &sender;
+
+    //Start the timer wheel for delayed publishes and message expiry
+    TimerWheel wheel;
+    init_timer_wheel(&wheel);
+    stats.wheel = &wheel;
+
+    //Start the workers that share out large fan-outs
+    DeliveryPool pool;
+    init_delivery_pool(&pool, params.workers);
     
     //Semaphore to limit max clients
+    sem_t guard;
     if (stats.maxClients != 0) {
-        sem_t guard;
         sem_init(&guard, 0, stats.maxClients);
         stats.guard = &guard;
     }
 
-    process_connections(fdServer, &stats, map, &lock); 
+    HandoffState handoff;
+    handoff.frozen = false;
+    handoff.threads = 1;
+    handoff.parked = 0;
+    pthread_mutex_init(&handoff.lock, NULL);
+    pthread_cond_init(&handoff.changed, NULL);
+    handoff.acceptThread = pthread_self();
+    handoff.listenFd = fdServer;
+
+    Server server = {&topics, &lock, &epoch, register_reader(&epoch), &stats,
+            &params, &sender, &wheel, &pool, &handoff, &trace, NULL, 0};
+    start_reader_loops(&server);
+    if (sock >= 0 && !take_over(&server, sock)) {
+        fprintf(stderr, "psserver: unable to take over from running "
+                "server\n");
+        exit(CONNECTION_ERROR_EXIT);
+    }
+
+    //Listen for a new server taking over from this one
+    if (params.handoffPath) {
+        pthread_create(&threadId, NULL, handoff_thread, &server);
+        pthread_detach(threadId);
+    }
+    process_connections(handoff.listenFd, &server); 
     pthread_exit(0);
 }
 
 /* signal_handler()
  * ----------------
- * Prints statistics upon SIGHUP about server
+ * Prints statistics upon SIGHUP about server, and dumps every thread's
+ * trace ring to a file upon TRACE_SIGNAL
  */
 void* signal_handler(void* arg) {
     Stats* stats = arg;
+    EpochRecord* reader = register_reader(stats->epoch);
     int sig;
     while (true) {
         sigwait(stats->set, &sig);
-        pthread_mutex_lock(stats->lockStat);
-        fprintf(stderr, "Connected clients:%d\n", stats->currentClientCount);
-        fprintf(stderr, "Completed clients:%d\n", stats->completedClients);
-        fprintf(stderr, "pub operations:%d\n", stats->pubCount);
-        fprintf(stderr, "sub operations:%d\n", stats->subCount);
-        fprintf(stderr, "unsub operations:%d\n", stats->unsubCount);
+        if (sig != TRACE_SIGNAL) {
+            print_stats(stats, reader);
+            continue;
+        }
+        char path[TRACE_PATH_SIZE];
+        if (dump_traces(stats->trace, path, TRACE_PATH_SIZE)) {
+            fprintf(stderr, "trace:%s\n", path);
+        } else {
+            fprintf(stderr, "psserver: unable to write trace %s\n", path);
+        }
         fflush(stderr);
-        pthread_mutex_unlock(stats->lockStat);
+    }
+}
+
+/* print_stats()
+ * -------------
+ * Prints statistics about the server, including the hottest topics and the
+ * number of seconds each rate limited client has spent throttled
+ *
+ * stats: a pointer to the Stats struct
+ *
+ * reader: the signal handling thread's epoch record
+ */
+void print_stats(Stats* stats, EpochRecord* reader) {
+    pthread_mutex_lock(stats->lockStat);
+    fprintf(stderr, "Connected clients:%d\n", stats->currentClientCount);
+    fprintf(stderr, "Completed clients:%d\n", stats->completedClients);
+    fprintf(stderr, "pub operations:%d\n", stats->pubCount);
+    fprintf(stderr, "sub operations:%d\n", stats->subCount);
+    fprintf(stderr, "unsub operations:%d\n", stats->unsubCount);
+    fprintf(stderr, "conflated messages:%d\n", stats->conflatedCount);
+    int levels[WHEEL_LEVELS];
+    fprintf(stderr, "pending timers:%d\n", 
+            get_wheel_occupancy(stats->wheel, levels));
+    for (int i = 0; i < WHEEL_LEVELS; i++) {
+        fprintf(stderr, "timer wheel level %d:%d\n", i, levels[i]);
+    }
+    fprintf(stderr, "topics:%d\n", 
+            __atomic_load_n(&stats->topics->count, __ATOMIC_RELAXED));
+    print_hot_topics(stats, reader, false);
+    print_hot_topics(stats, reader, true);
+    for (Node* node = stats->clients; node; node = node->next) {
+        if (node->client->bucket) {
+            fprintf(stderr, "throttled %s:%.3f\n", node->client->name, 
+                    node->client->throttledTime);
+        }
+    }
+    print_priorities(stats);
+    fflush(stderr);
+    pthread_mutex_unlock(stats->lockStat);
+}
+
+/* print_hot_topics()
+ * ------------------
+ * Prints the HOT_TOPIC_COUNT topics with the most messages or bytes 
+ * published, heaviest first. The estimate from the hot topic tracker may be
+ * too high by up to the error printed with it. The exact traffic and the
+ * current number of subscribers are printed as well for hot topics that 
+ * still exist.
+ *
+ * stats: a pointer to the Stats struct
+ *
+ * reader: the signal handling thread's epoch record
+ *
+ * byBytes: true to rank topics by bytes and false to rank them by messages
+ */
+void print_hot_topics(Stats* stats, EpochRecord* reader, bool byBytes) {
+    HotCounter top[HOT_TOPIC_COUNT];
+    int found = top_hot_topics(stats->hot, byBytes, top, HOT_TOPIC_COUNT);
+    char* ranking = byBytes ? "bytes" : "messages";
+    epoch_enter(stats->epoch, reader);
+    for (int i = 0; i < found; i++) {
+        fprintf(stderr, "hot %s %s:%" PRIu64 " error:%" PRIu64, ranking,
+                top[i].name, top[i].count, top[i].error);
+        Topic* topic = find_topic(stats->topics, top[i].name);
+        if (topic) {
+            TopicTraffic* traffic = &topic->traffic;
+            fprintf(stderr, " publishes:%" PRIu64 " bytes:%" PRIu64 
+                    " deliveries:%" PRIu64 " subscribers:%d",
+                    __atomic_load_n(&traffic->publishes, __ATOMIC_RELAXED),
+                    __atomic_load_n(&traffic->bytes, __ATOMIC_RELAXED),
+                    __atomic_load_n(&traffic->deliveries, __ATOMIC_RELAXED),
+                    count_subscribers(topic));
+        }
+        fprintf(stderr, "\n");
+    }
+    epoch_exit(reader);
+    free_hot_counters(top, found);
+}
+
+/* print_priorities()
+ * ------------------
+ * Prints, for each priority class, the number of messages waiting in every 
+ * client's queue, the number delivered and their average and worst 
+ * delivery latency in milliseconds. lockStat must be held.
+ *
+ * stats: a pointer to the Stats struct
+ */
+void print_priorities(Stats* stats) {
+    size_t depths[PRIORITY_CLASSES] = {0};
+    for (Node* node = stats->clients; node; node = node->next) {
+        OutQueue* queue = &node->client->queue;
+        pthread_mutex_lock(&queue->lock);
+        for (int i = 0; i < PRIORITY_CLASSES; i++) {
+            depths[i] += queue->depths[i];
+        }
+        pthread_mutex_unlock(&queue->lock);
+    }
+    for (int i = 0; i < PRIORITY_CLASSES; i++) {
+        LaneLatency* latency = &stats->sender->latency[i];
+        uint64_t delivered = __atomic_load_n(&latency->delivered, 
+                __ATOMIC_RELAXED);
+        uint64_t total = __atomic_load_n(&latency->total, __ATOMIC_RELAXED);
+        fprintf(stderr, "priority %d queued:%zu delivered:%" PRIu64 
+                " latency avg:%.3fms max:%.3fms\n", i, depths[i], delivered,
+                delivered ? total / NANOS_PER_MILLI / delivered : 0.0,
+                __atomic_load_n(&latency->max, __ATOMIC_RELAXED) / 
+                NANOS_PER_MILLI);
     }
 }
 
@@ -152,13 +602,16 @@ void init_stats(Stats* stats, int maxClients) {
     stats->pubCount = 0;
     stats->subCount = 0;
     stats->unsubCount = 0;
+    stats->conflatedCount = 0;
     stats->maxClients = maxClients;
+    stats->clients = NULL;
 }
 
 /* validate_commands()
  * -------------------
  * Checks whether the command line arguments are valid for the server. 
  * Populates a Params struct with command line information if successful.
+ * Options of the form "--option value" may follow the positional arguments.
  *
  * argc: the number of command line arguments
  *
@@ -170,20 +623,91 @@ void init_stats(Stats* stats, int maxClients) {
  * with exit status 1
  */
 void validate_commands(int argc, char** argv, Params* params) {
+    //Find where the options start
+    int positional = 1;
+    while (positional < argc && positional < MAX_POSITIONAL_COUNT && 
+            strncmp(argv[positional], OPTION_PREFIX, strlen(OPTION_PREFIX))) {
+        positional++;
+    }
+
     //Validate arguments
-    if (argc < MIN_ARG_COUNT || argc > MAX_ARG_COUNT || 
+    if (positional < MIN_ARG_COUNT || (argc - positional) % 2 != 0 ||
             !is_non_neg_int(argv[CONNECTIONS_POS]) || 
-            (argc == MAX_ARG_COUNT && !is_valid_port(argv[PORT_POS]))) {
+            (positional == MAX_POSITIONAL_COUNT && 
+            !is_valid_port(argv[PORT_POS]))) {
         invalid_format();
     } 
     
     //Populate params
-    if (argc == MAX_ARG_COUNT) {
+    if (positional == MAX_POSITIONAL_COUNT) {
         params->port = argv[PORT_POS];
     } else {
         params->port = "0";
     }
     params->connections = atoi(argv[CONNECTIONS_POS]);
+    params->rateRules = NULL;
+    params->workers = sysconf(_SC_NPROCESSORS_ONLN);
+    params->handoffPath = NULL;
+    params->history = DEFAULT_HISTORY;
+    params->readers = 0;
+    params->profile = PROFILE_LATENCY;
+    params->flushDelay = -1;
+    init_priorities(&params->priorities);
+    params->maxMessage = DEFAULT_MAX_MESSAGE;
+
+    for (int i = positional; i < argc; i += 2) {
+        parse_option(argv[i], argv[i + 1], params);
+    }
+    if (params->flushDelay < 0) {
+        params->flushDelay = params->profile == PROFILE_THROUGHPUT ? 
+                THROUGHPUT_FLUSH_DELAY : LATENCY_FLUSH_DELAY;
+    }
+}
+
+/* parse_option()
+ * --------------
+ * Applies one "--option value" command line option to the Params struct
+ *
+ * option: the name of the option, including the leading "--"
+ *
+ * value: the value given for the option
+ *
+ * params: a pointer to the Params struct to populate
+ *
+ * Errors: will exit with exit status 1 if the option is unknown or its value
+ * is invalid
+ */
+void parse_option(char* option, char* value, Params* params) {
+    if (!strcmp(option, "--ratelimit")) {
+        bool valid;
+        params->rateRules = load_rate_rules(value, &valid);
+        if (!valid) {
+            invalid_format();
+        }
+    } else if (!strcmp(option, "--workers") && is_non_neg_int(value)) {
+        params->workers = atoi(value);
+    } else if (!strcmp(option, "--handoff") && strcmp(value, "")) {
+        params->handoffPath = value;
+    } else if (!strcmp(option, "--history") && is_non_neg_int(value)) {
+        params->history = atoi(value);
+    } else if (!strcmp(option, "--readers") && is_non_neg_int(value)) {
+        params->readers = atoi(value);
+    } else if (!strcmp(option, "--profile") && !strcmp(value, "latency")) {
+        params->profile = PROFILE_LATENCY;
+    } else if (!strcmp(option, "--profile") && 
+            !strcmp(value, "throughput")) {
+        params->profile = PROFILE_THROUGHPUT;
+    } else if (!strcmp(option, "--flushdelay") && is_non_neg_int(value)) {
+        params->flushDelay = atoi(value);
+    } else if (!strcmp(option, "--priorities")) {
+        if (!load_priorities(value, &params->priorities)) {
+            invalid_format();
+        }
+    } else if (!strcmp(option, "--maxmessage") && is_non_neg_int(value)) {
+        params->maxMessage = atoi(value);
+    } else {
+        invalid_format();
+    }
 }
 
 /* is_valid_port()
@@ -226,7 +750,11 @@ bool is_non_neg_int(char* value) {
  * Errors: returns with exit status INVALID_FORMAT_ERROR (1)
  */
 void invalid_format() {
-    fprintf(stderr, "Usage: psserver connections [portnum]\n");
+    fprintf(stderr, "Usage: psserver connections [portnum] "
+            "[--ratelimit file] [--workers count] [--handoff path] "
+            "[--history count] [--readers count] "
+            "[--profile latency|throughput] [--flushdelay microseconds] "
+            "[--priorities file] [--maxmessage bytes]\n");
     exit(INVALID_FORMAT_EXIT);
 }
 
@@ -276,21 +804,34 @@ int open_listen(Params* params) {
     
     //Get port used if unknown and print it ;
     if (!strcmp(params->port, "0")) {
-        struct sockaddr_in ad;
-        memset(&ad, 0, sizeof(struct sockaddr_in));
-        socklen_t len = sizeof(struct sockaddr_in);
-        if (getsockname(listenFd, (struct sockaddr*) &ad, &len)) {
-            connection_error();
-        }
-        int port = ad.sin_port;
-        fprintf(stderr, "%d\n", ntohs(port));
+        print_listen_port(listenFd);
     } else {
         fprintf(stderr, "%s\n", params->port);
+        fflush(stderr);
     }
-    fflush(stderr);
     return listenFd;
 }
 
+/* print_listen_port()
+ * -------------------
+ * Prints the port that a listening socket is bound to
+ *
+ * listenFd: the listening socket
+ *
+ * Errors: exits with CONNECTION_ERROR_EXIT (2) if the port cannot be found
+ */
+void print_listen_port(int listenFd) {
+    struct sockaddr_in ad;
+    memset(&ad, 0, sizeof(struct sockaddr_in));
+    socklen_t len = sizeof(struct sockaddr_in);
+    if (getsockname(listenFd, (struct sockaddr*) &ad, &len)) {
+        connection_error();
+    }
+    int port = ad.sin_port;
+    fprintf(stderr, "%d\n", ntohs(port));
+    fflush(stderr);
+}
+
 /* connection_error()
  * ------------------
  * Performs the required procedure for a connection error
@@ -308,316 +849,2307 @@ void connection_error() {
  * with them
  *
  * fdServer: the socket the server is accepting from
- * 
- * stats: a pointer to the Stats struct for this server
  *
- * map: a pointer to a string map that holds informatino on which client is 
- * subscribed to what topic
- *
- * lock: the mutex lock for the string map
+ * server: a pointer to the Server struct holding the topic table, its lock
+ * and epoch domain, the stats, the command line params, the sender, the timer 
+ * wheel and the delivery pool
  */
-void process_connections(int fdServer, Stats* stats, StringMap* map, 
-        pthread_mutex_t* lock) {
+void process_connections(int fdServer, Server* server) {
+    Stats* stats = server->stats;
     int fd;
     struct sockaddr_in fromAddr;
     socklen_t fromAddrSize;
+    TraceRing* tracer = register_tracer(server->trace, "accept");
 
     while(true) {
+        //Stand still while the server is being handed over
+        wait_for_handoff(server);
+
         //Wait on client
         fromAddrSize = sizeof(struct sockaddr_in);
+        trace_event(tracer, TRACE_ACCEPT_BEGIN, 0, 0);
         
         //Limit max clients if necessary
-        if (stats->maxClients != 0) {
-            sem_wait(stats->guard);
+        if (stats->maxClients != 0 && sem_wait(stats->guard)) {
+            continue;
         }
 
         fd = accept(fdServer, (struct sockaddr*) &fromAddr, &fromAddrSize);
         if (fd < 0) {
+            if (stats->maxClients != 0) {
+                sem_post(stats->guard);
+            }
             continue;
         }
+        trace_event(tracer, TRACE_ACCEPT_END, fd, 0);
+        start_client(init_client(server, fd));
+    }
+}
 
-        //Update stats
-        pthread_mutex_lock(stats->lockStat);
-        stats->currentClientCount++;
-        pthread_mutex_unlock(stats->lockStat);
-
-        //Setup Client struct for new client
-        Client* client = malloc(sizeof(Client));
-        int fdCopy = dup(fd);
-        client->in = fdopen(fd, "r");
-        client->out = fdopen(fdCopy, "w");
-        client->hasName = false;
-
-        //Setup ClientThreadInfo for new client
-        ClientThreadInfo* cti = malloc(sizeof(ClientThreadInfo));
-        cti->client = client;
-        cti->map = map;
-        cti->lock = lock;
-        cti->stats = stats;
-        
+/* init_client()
+ * -------------
+ * Sets up the Client and ClientThreadInfo structs for a newly connected 
+ * client
+ *
+ * server: a pointer to the Server struct
+ *
+ * fd: the client's socket
+ *
+ * Returns: the ClientThreadInfo struct of the new client
+ */
+ClientThreadInfo* init_client(Server* server, int fd) {
+    //Setup Client struct for new client
+    Client* client = malloc(sizeof(Client));
+    configure_socket(fd);
+    init_line_reader(&client->reader, fd, server->params->maxMessage);
+    client->fd = fd;
+    init_queue(&client->queue);
+    client->scheduled = false;
+    client->name = NULL;
+    client->hasName = false;
+    client->bucket = NULL;
+    client->throttledTime = 0;
+    client->sequenced = false;
+    client->deflate = false;
+
+    //Setup ClientThreadInfo for new client
+    ClientThreadInfo* cti = malloc(sizeof(ClientThreadInfo));
+    cti->client = client;
+    cti->server = server;
+    cti->loop = next_reader_loop(server);
+    if (cti->loop) {
+        cti->reader = cti->loop->reader;
+        cti->tracer = cti->loop->tracer;
+    } else {
+        cti->reader = register_reader(server->epoch);
+    }
+    return cti;
+}
+
+/* start_client()
+ * --------------
+ * Records a client in the stats and starts the thread that serves it, or
+ * hands it to its reader loop. Input a client sent to an old server that has
+ * not been handled yet is handled straight away.
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ */
+void start_client(ClientThreadInfo* cti) {
+    Stats* stats = cti->server->stats;
+    HandoffState* handoff = cti->server->handoff;
+    if (!cti->loop) {
+        pthread_mutex_lock(&handoff->lock);
+        handoff->threads++;
+        pthread_mutex_unlock(&handoff->lock);
+    }
+
+    //The client cannot be cleaned up before it is in the list, as that needs
+    //lockStat too
+    pthread_mutex_lock(stats->lockStat);
+    stats->currentClientCount++;
+    if (!cti->loop) {
         pthread_t threadId;
         pthread_create(&threadId, NULL, client_thread, cti);
         pthread_detach(threadId);
+        cti->client->thread = threadId;
+    } else if (has_buffered_input(&cti->client->reader)) {
+        watch_client(cti, 0, EPOLL_CTL_ADD);
+        queue_pending(cti->loop, cti);
+    } else {
+        watch_client(cti, EPOLLIN, EPOLL_CTL_ADD);
+    }
+    if (!stats->clients) {
+        stats->clients = init_client_list(cti->client);
+    } else {
+        add_client(stats->clients, cti->client);
     }
+    pthread_mutex_unlock(stats->lockStat);
 }
 
 /* client_thread()
  * ---------------
  * The thread that handles the client for its life span. Will call clean up 
- * function for client when it disconnects.
+ * function for client when it disconnects. A rate limited client is not
+ * read from again until it may publish. While the server is handed over to
+ * a new process the thread stops reading and stands still.
  *
  * arg: a pointer to a ClientThreadInfo struct
  */
 void* client_thread(void* arg) {
     ClientThreadInfo* cti = arg;
     Client* client = cti->client;
+    bool* frozen = &cti->server->handoff->frozen;
     char* buffer;
-    while ((buffer = read_line(client->in)) != NULL) {
-        //Get name, if not name reject and wait for name
-        if (!client->hasName) {
-            if (is_name(buffer)) {
-                char* name = split_by_char(buffer, ' ', 0)[NAME_POS];
-                client->name = strdup(name);
-                client->hasName = true;
-                continue;
-            } else {
-                free(buffer);
-                continue;
-            }
-        }
-
-        //Handle commands
-        pthread_mutex_lock(cti->lock);
-        pthread_mutex_lock(cti->stats->lockStat);
-        switch (validate_cmd(buffer)) {
-            case SUBSCRIBE:
-                cti->stats->subCount++;
-                subscribe(cti, split_by_char(buffer, ' ', 0)[TOPIC_POS]);
-                break;
-            case UNSUBSCRIBE:
-                unsubscribe(cti, split_by_char(buffer, ' ', 0)[TOPIC_POS]);
-                break;
-            case PUBLISH:
-                cti->stats->pubCount++;
-                publish(cti, buffer);
-                break;
-            case IGNORE:
-                break;
-            default:
-                fprintf(client->out, ":invalid\n");
-                fflush(client->out);
+    cti->tracer = register_tracer(cti->server->trace, "client");
+    do {
+        while (throttle_client(cti), 
+                (buffer = next_line(&client->reader, frozen)) != NULL) {
+            handle_command(cti, buffer);
+            free(buffer);
         }
-        pthread_mutex_unlock(cti->stats->lockStat);
-        pthread_mutex_unlock(cti->lock);
-        free(buffer);
-    }
+    } while (wait_for_handoff(cti->server));
 
-    if (client->hasName) {
-        clean_up_client(cti);
-    }
+    clean_up_client(cti);
     return NULL;
 }
 
-/* clean_up_client()
- * -----------------
- * Performs freeing, and closing of IO streams for the client. Also 
- * unsubscribes them from all their topics
- * 
- * cti: a pointer to the ClientThreadInfo struct that holds info on
- * client to be cleaned up
+/* start_reader_loops()
+ * --------------------
+ * Starts the reader loops that serve clients when --readers is given. Each
+ * loop registers its own trace ring, which is waited for so that clients can
+ * be given the ring as soon as the loops are started.
+ *
+ * server: a pointer to the Server struct
  */
-void clean_up_client(ClientThreadInfo* cti) {
-    pthread_mutex_lock(cti->lock);
+void start_reader_loops(Server* server) {
+    int readers = server->params->readers;
+    if (!readers) {
+        return;
+    }
+    sem_t ready;
+    sem_init(&ready, 0, 0);
+    server->loops = malloc(sizeof(ReaderLoop) * readers);
+    for (int i = 0; i < readers; i++) {
+        ReaderLoop* loop = &server->loops[i];
+        loop->epollFd = epoll_create1(0);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK);
+        loop->server = server;
+        loop->reader = register_reader(server->epoch);
+        loop->ready = &ready;
+        loop->pendingSize = INITIAL_PENDING_SIZE;
+        loop->pendingCount = 0;
+        loop->pending = malloc(sizeof(ClientThreadInfo*) * loop->pendingSize);
+        pthread_mutex_init(&loop->lock, NULL);
 
-    //Create list to unsubscribe from
-    StringMapItem* itemMap = NULL;
-    char** unsubList = malloc(sizeof(char*) * INITIAL_LIST_SIZE);
-    int count = 0;
-    int size = INITIAL_LIST_SIZE;
+        //The wake up descriptor is the only one without a client
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &event);
 
-    while ((itemMap = stringmap_iterate(cti->map, itemMap))) {
-        if (count == size) {
-            size *= 2;
-            unsubList = realloc(unsubList, size * sizeof(char*));
-        }
-        unsubList[count] = strdup(itemMap->key);
-        count++;
+        pthread_create(&loop->thread, NULL, reader_loop, loop);
+        pthread_detach(loop->thread);
     }
-
-    //Unsubscribe from list
-    for (int i = 0; i < count; i++) {
-        unsubscribe(cti, unsubList[i]);
-        free(unsubList[i]);
+    for (int i = 0; i < readers; i++) {
+        sem_wait(&ready);
     }
-    free(unsubList);
-    
-    //Clean up client struct
-    free(cti->client->name);
-    fclose(cti->client->in);
-    fclose(cti->client->out);
-    free(cti->client);
-    free(cti);
+    sem_destroy(&ready);
 
-    //Update stats and client allowance
-    pthread_mutex_lock(cti->stats->lockStat);
-    cti->stats->currentClientCount--;
-    cti->stats->completedClients++;
-    if (cti->stats->maxClients != 0) {
-        sem_post(cti->stats->guard);
-    }
-    pthread_mutex_unlock(cti->stats->lockStat);
-    pthread_mutex_unlock(cti->lock);
+    HandoffState* handoff = server->handoff;
+    pthread_mutex_lock(&handoff->lock);
+    handoff->threads += readers;
+    pthread_mutex_unlock(&handoff->lock);
 }
 
-/* count_args()
- * ------------
- * Counts the number of arguments in a string array.
+/* next_reader_loop()
+ * ------------------
+ * Picks the reader loop a new client is served by, taking the loops in turn
  *
- * args: the string array to be counted
+ * server: a pointer to the Server struct
  *
- * Returns: the number of arguments in args
+ * Returns: the loop, or NULL if every client has a thread of its own
  */
-int count_args(char** args) {
-    int count = 0;
-    while (args[count]) {
-        count++;
+ReaderLoop* next_reader_loop(Server* server) {
+    if (!server->loops) {
+        return NULL;
     }
-    return count;
+    unsigned int next = __atomic_fetch_add(&server->nextLoop, 1, 
+            __ATOMIC_RELAXED);
+    return &server->loops[next % server->params->readers];
 }
 
-/* is_name()
- * ---------
- * Verifies if the input line argument is in the correct form of a name
- *
- * line: the line to be checked for whether it is a name
+/* reader_loop()
+ * -------------
+ * The thread of a reader loop. Waits for input from any of the loop's 
+ * clients and handles the lines each has sent. While the server is handed
+ * over to a new process the loop stands still.
  *
- * Returns: true if the line argument is a name and false otherwise.
+ * arg: a pointer to the ReaderLoop struct
  */
-bool is_name(char* line) {
-    char* lineCopy = strdup(line); 
-    char** args = split_by_char(lineCopy, ' ', 0);
-    int count = count_args(args);
-    bool result = (count == 2) && !strcmp(args[0], "name") && 
-        strlen(args[1]) != 0 && !strchr(args[1], ':');
-    free(lineCopy);
-    return result;
+void* reader_loop(void* arg) {
+    ReaderLoop* loop = arg;
+    Server* server = loop->server;
+    struct epoll_event events[LOOP_EVENTS];
+    loop->tracer = register_tracer(server->trace, "reader");
+    sem_post(loop->ready);
+
+    while (true) {
+        wait_for_handoff(server);
+        serve_pending(loop);
+        int ready = epoll_wait(loop->epollFd, events, LOOP_EVENTS, -1);
+        for (int i = 0; i < ready; i++) {
+            //Events not yet served are reported again once the server thaws
+            if (__atomic_load_n(&server->handoff->frozen, __ATOMIC_ACQUIRE)) {
+                break;
+            }
+            if (events[i].data.ptr) {
+                serve_client(events[i].data.ptr, true);
+            }
+        }
+    }
 }
 
-/* validate_cmd()
+/* watch_client()
  * --------------
- * Validates whether the cmd argument is a valid command from a client
+ * Adds a client to its reader loop's epoll set or changes what it is 
+ * watched for
  *
- * cmd: the command to be checked
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ *
+ * events: EPOLLIN to watch for input, or 0 to stop watching for now
  *
- * Returns: -1 if invalid and UNSUBSCRIBE (1) for unsub, SUBSCRIBE (0) for sub,
- * PUBLISH (2) for pub, and IGNORE (-2) for a name;
+ * op: EPOLL_CTL_ADD for a new client and EPOLL_CTL_MOD otherwise
  */
-int validate_cmd(char* cmd) {
-    char* cmdCopy = strdup(cmd);
-    char** args = split_by_char(cmdCopy, ' ', 0);
-    int count = count_args(args);
-    int result = INVALID_COMMAND;
-
-    //Name
-    if (count == 2 && !strcmp(args[0], "name") && is_name(args[1])) {
-        result = IGNORE;
-    }
-
-    //Subscribe, unsubscribe
-    if (count == 2 && strcmp(args[1], "") && !strchr(args[1], ':')) {
-        if (!strcmp(args[0], "sub")) {
-            result = SUBSCRIBE;
-        } else if (!strcmp(args[0], "unsub")) {
-            result = UNSUBSCRIBE;
-        } 
-    } 
-
-    //Publish
-    if (count > 2 && !strcmp(args[0], "pub") && !strchr(args[1], ':') && 
-            !strchr(args[2], ':') && strcmp(args[1], "") && 
-            strcmp(args[2], "")) {
-        result = PUBLISH;
-    }
-    free(cmdCopy);
-    return result;
+void watch_client(ClientThreadInfo* cti, uint32_t events, int op) {
+    struct epoll_event event;
+    event.events = events;
+    event.data.ptr = cti;
+    epoll_ctl(cti->loop->epollFd, op, cti->client->fd, &event);
 }
 
-/* subscribe()
- * -----------
- * Performs a subcribe for the client on the given topic
- * 
- * cti: pointer to ClientThreadInfo struct that desccribes client doing the 
- * sub
+/* queue_pending()
+ * ---------------
+ * Asks a reader loop to serve a client without waiting for input from it.
+ * The client must not be watched for input.
  *
- * topic: topic being subscribed to
+ * loop: the loop serving the client
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
  */
-void subscribe(ClientThreadInfo* cti, char* topic) {
-    Node* node = stringmap_search(cti->map, topic);
-    if (!node) {
-        //Topic not in map - create list and add to map
-        node = init_client_list(cti->client);
-        stringmap_add(cti->map, topic, node);
-    } else if (!in_list(node, cti->client)) {
-        //Topic in map and client not in list - add name to list
-        add_client(node, cti->client);
-    } 
+void queue_pending(ReaderLoop* loop, ClientThreadInfo* cti) {
+    pthread_mutex_lock(&loop->lock);
+    if (loop->pendingCount == loop->pendingSize) {
+        loop->pendingSize *= 2;
+        loop->pending = realloc(loop->pending, 
+                sizeof(ClientThreadInfo*) * loop->pendingSize);
+    }
+    loop->pending[loop->pendingCount++] = cti;
+    pthread_mutex_unlock(&loop->lock);
+
+    uint64_t one = 1;
+    if (write(loop->wakeFd, &one, sizeof(one)) < 0) {
+        //The counter is already non-zero, so the loop will wake anyway
+    }
 }
 
-/* unsubscribe()
- * -------------
- * Unsubcribes client from the given topic
- * 
- * cti: a pointer to a ClientThreadStruct describing the client who is 
- * unsubscribing
+/* serve_pending()
+ * ---------------
+ * Watches every pending client for input again and serves the lines they
+ * already have buffered
  *
- * topic: the topic being unsubscribed to
+ * loop: the loop
  */
-void unsubscribe(ClientThreadInfo* cti, char* topic) {
-    Node* node = stringmap_search(cti->map, topic); 
-    //Do nothing if topic does not exist or client not subbed to topic
-    if (!node || !in_list(node, cti->client)) {
+void serve_pending(ReaderLoop* loop) {
+    uint64_t count;
+    if (read(loop->wakeFd, &count, sizeof(count)) < 0) {
+        //Nothing has been queued since the last time
+    }
+    pthread_mutex_lock(&loop->lock);
+    int pendingCount = loop->pendingCount;
+    if (!pendingCount) {
+        pthread_mutex_unlock(&loop->lock);
         return;
     }
+    ClientThreadInfo** pending = malloc(sizeof(ClientThreadInfo*) * 
+            (pendingCount + 1));
+    memcpy(pending, loop->pending, sizeof(ClientThreadInfo*) * pendingCount);
+    loop->pendingCount = 0;
+    pthread_mutex_unlock(&loop->lock);
 
-    bool deleteTopic = is_last_client(node);
-    
-    //If deleting first node, set cti->map to point to new first node
-    Node* newFirstNode = delete_client(node, cti->client);
-    if (newFirstNode) {
-        stringmap_remove(cti->map, topic);
-        stringmap_add(cti->map, topic, newFirstNode);
+    for (int i = 0; i < pendingCount; i++) {
+        watch_client(pending[i], EPOLLIN, EPOLL_CTL_MOD);
+        serve_client(pending[i], false);
     }
-    
-    //If last client in clientList, remove topic from map 
-    if (deleteTopic) {
-        stringmap_remove(cti->map, topic);
-    }
-
-    //Update stats
-    cti->stats->unsubCount++;
+    free(pending);
 }
 
-/* publish()
- * ---------
- * Publishes the text that the client sends for a specific topic
+/* serve_client()
+ * --------------
+ * Handles the whole lines a reader loop's client has sent. The client's 
+ * input buffer is freed once it is empty, so an idle client holds no
+ * buffer. A client that has disconnected is cleaned up.
  *
- * cti: a pointer to a ClientThreadInfo struct that describes the client
- * sending the text
+ * cti: a pointer to the ClientThreadInfo struct of the client
  *
- * buffer: the string containing the text that the client sent
+ * readable: true if the client has input waiting to be read
  */
-void publish(ClientThreadInfo* cti, char* buffer) {
-    char** args = split_by_char(buffer, ' ', 3);
-    char* topic = args[1];
-    char* value = args[2];
+void serve_client(ClientThreadInfo* cti, bool readable) {
+    Client* client = cti->client;
+    bool* frozen = &cti->server->handoff->frozen;
+    bool open = !readable || read_available(&client->reader);
+    char* buffer;
+    while (true) {
+        //Lines left over are handled once the server thaws, or by the new
+        //server if the handoff goes ahead
+        if (__atomic_load_n(frozen, __ATOMIC_ACQUIRE)) {
+            if (has_buffered_input(&client->reader)) {
+                watch_client(cti, 0, EPOLL_CTL_MOD);
+                queue_pending(cti->loop, cti);
+            }
+            return;
+        }
+        if (defer_client(cti) || 
+                !(buffer = buffered_line(&client->reader, !open))) {
+            break;
+        }
+        handle_command(cti, buffer);
+        free(buffer);
+    }
+
+    if (!open && !has_buffered_input(&client->reader)) {
+        clean_up_client(cti);
+        return;
+    }
+    release_idle_buffer(&client->reader);
+}
+
+/* defer_client()
+ * --------------
+ * Stops a reader loop serving a rate limited client until it is allowed to
+ * publish again, and records the time it will spend waiting. This is
+ * throttle_client() for clients without a thread to sleep in.
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ *
+ * Returns: true if the client has been deferred and false if it may carry
+ * on
+ */
+bool defer_client(ClientThreadInfo* cti) {
+    Client* client = cti->client;
+    if (!client->bucket) {
+        return false;
+    }
+    double wait = bucket_wait_time(client->bucket);
+    if (wait <= 0) {
+        return false;
+    }
+    watch_client(cti, 0, EPOLL_CTL_MOD);
+    Wakeup* wakeup = malloc(sizeof(Wakeup));
+    wakeup->cti = cti;
+    wakeup->timer.fire = wake_client;
+    wakeup->timer.arg = wakeup;
+    add_timer(cti->server->wheel, &wakeup->timer, 
+            (uint64_t) (wait * MILLISECONDS) + 1);
+
+    pthread_mutex_lock(cti->server->stats->lockStat);
+    client->throttledTime += wait;
+    pthread_mutex_unlock(cti->server->stats->lockStat);
+    return true;
+}
+
+/* wake_client()
+ * -------------
+ * Hands a client deferred by defer_client() back to its reader loop. Called
+ * by the timer wheel.
+ *
+ * arg: a pointer to the Wakeup struct, which is freed
+ */
+void wake_client(void* arg) {
+    Wakeup* wakeup = arg;
+    queue_pending(wakeup->cti->loop, wakeup->cti);
+    free(wakeup);
+}
+
+/* handle_command()
+ * ----------------
+ * Handles one line sent by a client. Until the client has a name, any line 
+ * other than a name is ignored. Only changes to subscriptions take turns on
+ * the fair lock, so publishes never wait behind them.
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ *
+ * buffer: the line the client sent
+ */
+void handle_command(ClientThreadInfo* cti, char* buffer) {
+    Client* client = cti->client;
+
+    //Get name, if not name reject and wait for name
+    if (!client->hasName) {
+        if (is_name(buffer)) {
+            char** args = split_by_char(buffer, ' ', 0);
+            client->deflate = args[DEFLATE_POS] != NULL;
+            name_client(cti, args[NAME_POS]);
+            free(args);
+        }
+        return;
+    }
+
+    //Handle commands
+    trace_event(cti->tracer, TRACE_COMMAND_BEGIN, client->fd, 0);
+    int command = validate_cmd(buffer);
+    switch (command) {
+        case SUBSCRIBE:
+        case UNSUBSCRIBE:
+        case UNSUBSCRIBE_GROUP:
+            lock_subscriptions(cti);
+            change_subscription(cti, buffer, command);
+            unlock_subscriptions(cti);
+            break;
+        case PUBLISH:
+            __atomic_add_fetch(&cti->server->stats->pubCount, 1, 
+                    __ATOMIC_RELAXED);
+            if (client->bucket) {
+                bucket_take(client->bucket);
+            }
+            publish(cti, buffer);
+            break;
+        case PUBLISH_DELAYED:
+        case PUBLISH_TTL:
+            __atomic_add_fetch(&cti->server->stats->pubCount, 1, 
+                    __ATOMIC_RELAXED);
+            if (client->bucket) {
+                bucket_take(client->bucket);
+            }
+            publish_timed(cti, buffer, command == PUBLISH_DELAYED);
+            break;
+        case IGNORE:
+            break;
+        default:
+            reply(cti, ":invalid\n");
+    }
+    trace_event(cti->tracer, TRACE_COMMAND_END, client->fd, command);
+}
+
+/* lock_subscriptions()
+ * --------------------
+ * Waits for the client's turn on the fair lock and takes it, recording how
+ * long the wait was in the client's trace ring
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ */
+void lock_subscriptions(ClientThreadInfo* cti) {
+    trace_event(cti->tracer, TRACE_LOCK_WAIT, cti->client->fd, 0);
+    fair_lock(cti->server->lock);
+    trace_event(cti->tracer, TRACE_LOCK_ACQUIRED, cti->client->fd, 0);
+}
+
+/* unlock_subscriptions()
+ * ----------------------
+ * Releases the fair lock taken by lock_subscriptions()
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ */
+void unlock_subscriptions(ClientThreadInfo* cti) {
+    fair_unlock(cti->server->lock);
+    trace_event(cti->tracer, TRACE_LOCK_RELEASED, cti->client->fd, 0);
+}
+
+/* change_subscription()
+ * ----------------------
+ * Handles a sub, unsub or group unsub command. The fair lock must be held.
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ *
+ * buffer: the command the client sent
+ *
+ * command: SUBSCRIBE, UNSUBSCRIBE or UNSUBSCRIBE_GROUP
+ */
+void change_subscription(ClientThreadInfo* cti, char* buffer, int command) {
+    char** args = split_by_char(buffer, ' ', 0);
+    SubOptions options;
+    switch (command) {
+        case SUBSCRIBE:
+            __atomic_add_fetch(&cti->server->stats->subCount, 1, 
+                    __ATOMIC_RELAXED);
+            parse_sub_options(args, count_args(args), &options);
+            if (options.sequenced) {
+                __atomic_store_n(&cti->client->sequenced, true, 
+                        __ATOMIC_RELAXED);
+            }
+            if (options.group) {
+                subscribe_group(cti, args[TOPIC_POS], options.group, 
+                        options.conflate);
+            } else if (options.replay) {
+                subscribe_after(cti, args[TOPIC_POS], options.conflate,
+                        options.after);
+            } else if (options.filtered) {
+                subscribe_filtered(cti, args[TOPIC_POS], &options.filter,
+                        options.conflate);
+            } else {
+                subscribe(cti, args[TOPIC_POS], options.conflate);
+            }
+            if (cti->client->sequenced) {
+                keep_recent_messages(cti, args[TOPIC_POS]);
+            }
+            break;
+        case UNSUBSCRIBE:
+            unsubscribe(cti, args[TOPIC_POS]);
+            break;
+        case UNSUBSCRIBE_GROUP:
+            unsubscribe_group(cti, args[TOPIC_POS], args[GROUP_POS]);
+            break;
+    }
+    free(args);
+}
+
+/* keep_recent_messages()
+ * ----------------------
+ * Has a topic hold its recent messages from now on, as a sequenced client 
+ * has subscribed to it and may reconnect and resume. Other topics only 
+ * number their messages, which saves keeping a numbered copy of each. The
+ * fair lock must be held.
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ *
+ * topic: the topic subscribed to
+ */
+void keep_recent_messages(ClientThreadInfo* cti, char* topic) {
+    Topic* topicInfo = find_topic(cti->server->topics, topic);
+    if (topicInfo) {
+        pthread_mutex_lock(&topicInfo->history.lock);
+        keep_history(&topicInfo->history);
+        pthread_mutex_unlock(&topicInfo->history.lock);
+    }
+}
+
+/* name_client()
+ * -------------
+ * Gives the client its name and sets up its rate limit
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client being named
+ *
+ * name: the name of the client
+ */
+void name_client(ClientThreadInfo* cti, char* name) {
+    Client* client = cti->client;
+    client->name = strdup(name);
+    client->hasName = true;
+
+    RateRule* rule = find_rate_rule(cti->server->params->rateRules, name);
+    if (rule) {
+        client->bucket = init_bucket(rule);
+    }
+}
+
+/* throttle_client()
+ * -----------------
+ * Defers reading from a rate limited client until it is allowed to publish
+ * again, and records the time spent waiting
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ */
+void throttle_client(ClientThreadInfo* cti) {
+    Client* client = cti->client;
+    if (!client->bucket) {
+        return;
+    }
+
+    double wait = bucket_wait_time(client->bucket);
+    if (wait <= 0) {
+        return;
+    }
+    struct timespec delay;
+    delay.tv_sec = (time_t) wait;
+    delay.tv_nsec = (long) ((wait - delay.tv_sec) * NANOSECONDS);
+    nanosleep(&delay, NULL);
+
+    pthread_mutex_lock(cti->server->stats->lockStat);
+    client->throttledTime += wait;
+    pthread_mutex_unlock(cti->server->stats->lockStat);
+}
+
+/* clean_up_client()
+ * -----------------
+ * Performs freeing, and closing of IO streams for the client. Also 
+ * unsubscribes them from all their topics and removes them from any groups
+ * they are a member of, so the remaining group members take over their share
+ * of messages. The client is only freed once no publisher can still be
+ * delivering to it.
+ * 
+ * cti: a pointer to the ClientThreadInfo struct that holds info on
+ * client to be cleaned up
+ */
+void clean_up_client(ClientThreadInfo* cti) {
+    lock_subscriptions(cti);
+
+    //Create list to unsubscribe from
+    TopicEntry* entry = NULL;
+    char** unsubList = malloc(sizeof(char*) * INITIAL_LIST_SIZE);
+    int count = 0;
+    int size = INITIAL_LIST_SIZE;
+
+    while ((entry = iterate_topics(cti->server->topics, entry))) {
+        if (count == size) {
+            size *= 2;
+            unsubList = realloc(unsubList, size * sizeof(char*));
+        }
+        unsubList[count] = strdup(entry->name);
+        count++;
+    }
+
+    //Unsubscribe from list and leave every group on those topics
+    for (int i = 0; i < count; i++) {
+        Topic* topic = find_topic(cti->server->topics, unsubList[i]);
+        Group* group = topic->groups;
+        while (group) {
+            Group* next = group->next;
+            leave_group(topic, group, cti->client);
+            group = next;
+        }
+        if (remove_subscriber(topic, cti->client)) {
+            __atomic_add_fetch(&cti->server->stats->unsubCount, 1, 
+                    __ATOMIC_RELAXED);
+        }
+        //Leaving the last group can empty the topic as well
+        remove_empty_topic(cti, unsubList[i], topic);
+        free(unsubList[i]);
+    }
+    free(unsubList);
     
-    Node* node = stringmap_search(cti->map, topic);
-    if (node) {
-        do {
-            fprintf(node->client->out, "%s:%s:%s\n", cti->client->name, 
-                    topic, value);    
-            fflush(node->client->out);
-        } while (node = node->next, node);
+    //Update stats and client allowance
+    pthread_mutex_lock(cti->server->stats->lockStat);
+    cti->server->stats->currentClientCount--;
+    cti->server->stats->completedClients++;
+    cti->server->stats->clients = remove_from_list(
+            cti->server->stats->clients, cti->client);
+    if (cti->server->stats->maxClients != 0) {
+        sem_post(cti->server->stats->guard);
+    }
+    pthread_mutex_unlock(cti->server->stats->lockStat);
+    unlock_subscriptions(cti);
+
+    //Wait for publishes that may have loaded the client before it was 
+    //unsubscribed, then clean up client struct once the sender has let go of
+    //it. A reader loop's epoch record and trace ring stay with the loop.
+    HandoffState* handoff = cti->server->handoff;
+    ReaderLoop* loop = cti->loop;
+    if (loop) {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, cti->client->fd, NULL);
+    } else {
+        unregister_reader(cti->server->epoch, cti->reader);
+        unregister_tracer(cti->tracer);
+    }
+    synchronize_epoch(cti->server->epoch);
+    unschedule_client(cti->server->sender, cti->client);
+    free_queue(&cti->client->queue);
+    free(cti->client->name);
+    free(cti->client->bucket);
+    free_line_reader(&cti->client->reader);
+    close(cti->client->fd);
+    free(cti->client);
+    free(cti);
+    if (loop) {
+        return;
+    }
+
+    //Let a handoff waiting on this thread know it has gone
+    pthread_mutex_lock(&handoff->lock);
+    handoff->threads--;
+    pthread_cond_broadcast(&handoff->changed);
+    pthread_mutex_unlock(&handoff->lock);
+}
+
+/* count_args()
+ * ------------
+ * Counts the number of arguments in a string array.
+ *
+ * args: the string array to be counted
+ *
+ * Returns: the number of arguments in args
+ */
+int count_args(char** args) {
+    int count = 0;
+    while (args[count]) {
+        count++;
+    }
+    return count;
+}
+
+/* is_name()
+ * ---------
+ * Verifies if the input line argument is in the correct form of a name,
+ * which may be followed by DEFLATE_OPTION to ask for compressed messages
+ *
+ * line: the line to be checked for whether it is a name
+ *
+ * Returns: true if the line argument is a name and false otherwise.
+ */
+bool is_name(char* line) {
+    char* lineCopy = strdup(line); 
+    char** args = split_by_char(lineCopy, ' ', 0);
+    int count = count_args(args);
+    bool result = (count == 2 || (count == 3 && 
+            !strcmp(args[DEFLATE_POS], DEFLATE_OPTION))) && 
+            !strcmp(args[0], "name") && strlen(args[1]) != 0 && 
+            !strchr(args[1], ':');
+    free(args);
+    free(lineCopy);
+    return result;
+}
+
+/* validate_cmd()
+ * --------------
+ * Validates whether the cmd argument is a valid command from a client
+ *
+ * cmd: the command to be checked
+ *
+ * Returns: -1 if invalid and UNSUBSCRIBE (1) for unsub, SUBSCRIBE (0) for sub
+ * with or without options, PUBLISH (2) for pub, UNSUBSCRIBE_GROUP (5) for 
+ * unsub with a group, PUBLISH_DELAYED (6) for pubdelay, PUBLISH_TTL (7) for
+ * pubttl and IGNORE (3) for a name;
+ */
+int validate_cmd(char* cmd) {
+    //A publish is checked without copying or splitting its value, which may
+    //be long
+    size_t topicLen;
+    char* value;
+    if (!strncmp(cmd, PUB_PREFIX, strlen(PUB_PREFIX))) {
+        return parse_pub(cmd, &topicLen, &value) ? PUBLISH : INVALID_COMMAND;
+    }
+
+    char* cmdCopy = strdup(cmd);
+    char** args = split_by_char(cmdCopy, ' ', 0);
+    int count = count_args(args);
+    int result = INVALID_COMMAND;
+
+    //Name
+    if (count == 2 && !strcmp(args[0], "name") && is_name(args[1])) {
+        result = IGNORE;
+    }
+
+    //Subscribe, unsubscribe
+    if (count == 2 && strcmp(args[1], "") && !strchr(args[1], ':')) {
+        if (!strcmp(args[0], "sub")) {
+            result = SUBSCRIBE;
+        } else if (!strcmp(args[0], "unsub")) {
+            result = UNSUBSCRIBE;
+        } 
+    } 
+
+    //Subscribe with options
+    SubOptions options;
+    if (count > 2 && !strcmp(args[0], "sub") && strcmp(args[1], "") && 
+            !strchr(args[1], ':') && parse_sub_options(args, count, 
+            &options)) {
+        result = SUBSCRIBE;
+    }
+
+    //Unsubscribe as a member of a group
+    if (count == GROUP_ARG_COUNT && !strcmp(args[0], "unsub") && 
+            strcmp(args[1], "") && !strchr(args[1], ':') && 
+            !strcmp(args[GROUP_KEYWORD_POS], "group") && 
+            strcmp(args[GROUP_POS], "") && !strchr(args[GROUP_POS], ':')) {
+        result = UNSUBSCRIBE_GROUP;
+    }
+
+    //Publish with a delivery delay or a time to live
+    if (count >= TIMED_PUB_FIELD_COUNT && 
+            is_non_neg_int(args[TIMED_PUB_DELAY_POS]) && 
+            !strchr(args[TIMED_PUB_TOPIC_POS], ':') && 
+            !strchr(args[TIMED_PUB_VALUE_POS], ':') && 
+            strcmp(args[TIMED_PUB_TOPIC_POS], "") && 
+            strcmp(args[TIMED_PUB_VALUE_POS], "")) {
+        if (!strcmp(args[0], "pubdelay")) {
+            result = PUBLISH_DELAYED;
+        } else if (!strcmp(args[0], "pubttl")) {
+            result = PUBLISH_TTL;
+        }
+    }
+    free(args);
+    free(cmdCopy);
+    return result;
+}
+
+/* parse_pub()
+ * -----------
+ * Finds the topic and value of a pub command in place. Neither the topic nor
+ * the first word of the value may be empty or contain a colon.
+ *
+ * line: the command
+ *
+ * topicLen: set to the length of the topic, which starts after PUB_PREFIX
+ *
+ * value: set to the start of the value, which runs to the end of the line
+ *
+ * Returns: true if the command is a valid pub and false otherwise
+ */
+bool parse_pub(char* line, size_t* topicLen, char** value) {
+    if (strncmp(line, PUB_PREFIX, strlen(PUB_PREFIX))) {
+        return false;
+    }
+    char* topic = line + strlen(PUB_PREFIX);
+    char* topicEnd = strchr(topic, ' ');
+    if (!topicEnd) {
+        return false;
+    }
+    *topicLen = topicEnd - topic;
+    *value = topicEnd + 1;
+    size_t wordLen = strcspn(*value, " ");
+    return *topicLen && wordLen && !memchr(topic, ':', *topicLen) && 
+            !memchr(*value, ':', wordLen);
+}
+
+/* parse_sub_options()
+ * -------------------
+ * Reads the options following the topic of a sub command. The options are
+ * "group <name>" to join a shared subscription, "conflate" to only receive
+ * the newest unsent value of the topic, "seq" to have every message numbered
+ * "after <seq>" to also be sent the recent messages numbered after seq and
+ * "where" followed by a filter to only be sent values that pass it. A group
+ * cannot be combined with after or a filter, and neither can each other.
+ *
+ * args: the arguments of the sub command
+ *
+ * count: the number of arguments
+ *
+ * options: a pointer to the SubOptions struct to populate
+ *
+ * Returns: true if every option is valid and false otherwise
+ */
+bool parse_sub_options(char** args, int count, SubOptions* options) {
+    int used;
+    options->group = NULL;
+    options->conflate = false;
+    options->sequenced = false;
+    options->replay = false;
+    options->after = 0;
+    options->filtered = false;
+    for (int i = FIRST_SUB_OPTION_POS; i < count; i++) {
+        if (!strcmp(args[i], "group") && !options->group && i + 1 < count &&
+                strcmp(args[i + 1], "") && !strchr(args[i + 1], ':')) {
+            options->group = args[++i];
+        } else if (!strcmp(args[i], "conflate") && !options->conflate) {
+            options->conflate = true;
+        } else if (!strcmp(args[i], "seq") && !options->sequenced) {
+            options->sequenced = true;
+        } else if (!strcmp(args[i], "after") && !options->replay && 
+                i + 1 < count && is_non_neg_int(args[i + 1])) {
+            options->sequenced = true;
+            options->replay = true;
+            options->after = strtoull(args[++i], NULL, 10);
+        } else if (!strcmp(args[i], "where") && !options->filtered &&
+                (used = parse_filter(args + i + 1, count - i - 1, 
+                &options->filter))) {
+            options->filtered = true;
+            i += used;
+        } else {
+            return false;
+        }
+    }
+    return (options->group != NULL) + options->replay + options->filtered 
+            <= 1;
+}
+
+/* find_or_add_topic()
+ * -------------------
+ * Finds a topic in the table, creating it if it is not there yet
+ *
+ * cti: pointer to ClientThreadInfo struct that holds the table
+ *
+ * topic: the name of the topic
+ *
+ * Returns: the topic
+ */
+Topic* find_or_add_topic(ClientThreadInfo* cti, char* topic) {
+    Topic* topicInfo = find_topic(cti->server->topics, topic);
+    if (!topicInfo) {
+        //Topic not in table - create it and add to table
+        topicInfo = init_topic(cti->server->epoch, 
+                cti->server->params->history);
+        topicInfo->priority = find_priority(&cti->server->params->priorities,
+                topic);
+        add_topic(cti->server->topics, topic, topicInfo);
+    }
+    return topicInfo;
+}
+
+/* subscribe()
+ * -----------
+ * Performs a subcribe for the client on the given topic
+ * 
+ * cti: pointer to ClientThreadInfo struct that desccribes client doing the 
+ * sub
+ *
+ * topic: topic being subscribed to
+ *
+ * conflate: true if the client only wants the newest unsent value
+ */
+void subscribe(ClientThreadInfo* cti, char* topic, bool conflate) {
+    add_subscriber(find_or_add_topic(cti, topic), cti->client, conflate);
+}
+
+/* subscribe_after()
+ * -----------------
+ * Subscribes the client to the topic and sends it the recent messages it
+ * has not seen. Publishes to the topic wait while this happens, so the 
+ * client misses nothing and sees nothing twice. If some of the messages it
+ * has not seen are no longer held, the client is first sent a gap notice 
+ * with the numbers of the missing messages. A number beyond the newest 
+ * message means the topic's numbering has started again, so every held 
+ * message is sent.
+ *
+ * cti: pointer to ClientThreadInfo struct that describes client doing the 
+ * sub
+ *
+ * topic: topic being subscribed to
+ *
+ * conflate: true if the client only wants the newest unsent value
+ *
+ * after: the number of the last message the client has seen
+ */
+void subscribe_after(ClientThreadInfo* cti, char* topic, bool conflate,
+        uint64_t after) {
+    Server* server = cti->server;
+    Topic* topicInfo = find_or_add_topic(cti, topic);
+    History* history = &topicInfo->history;
+    pthread_mutex_lock(&history->lock);
+    add_subscriber(topicInfo, cti->client, conflate);
+
+    uint64_t from = after < history->next ? after + 1 : 1;
+    if (from < history->first) {
+        size_t size = strlen(topic) + GAP_EXTRA_CHARS;
+        char* data = malloc(size);
+        int len = snprintf(data, size, ":gap %s %" PRIu64 " %" PRIu64 "\n",
+                topic, from, history->first - 1);
+        Payload* gap = init_payload(NULL, data, len);
+        gap->priority = topicInfo->priority;
+        deliver(server, cti->client, gap, false);
+        release_payload(gap);
+        from = history->first;
+    }
+    for (uint64_t seq = from; seq < history->next; seq++) {
+        Payload* payload = find_history(history, seq);
+        if (!is_expired(payload)) {
+            deliver(server, cti->client, payload, conflate);
+        }
     }
+    pthread_mutex_unlock(&history->lock);
 }
 
+/* subscribe_filtered()
+ * --------------------
+ * Subscribes the client to the topic so that it is only sent the values that
+ * pass a filter. Subscribers with the same filter share it, so it is tested
+ * once per message however many of them there are.
+ *
+ * cti: pointer to ClientThreadInfo struct that describes client doing the 
+ * sub
+ *
+ * topic: topic being subscribed to
+ *
+ * filter: the filter, which is copied if no subscriber has asked for it yet
+ *
+ * conflate: true if the client only wants the newest unsent value
+ */
+void subscribe_filtered(ClientThreadInfo* cti, char* topic, Filter* filter,
+        bool conflate) {
+    add_filtered_subscriber(find_or_add_topic(cti, topic), cti->client,
+            filter, conflate);
+}
+
+/* unsubscribe()
+ * -------------
+ * Unsubcribes client from the given topic
+ * 
+ * cti: a pointer to a ClientThreadStruct describing the client who is 
+ * unsubscribing
+ *
+ * topic: the topic being unsubscribed to
+ */
+void unsubscribe(ClientThreadInfo* cti, char* topic) {
+    Topic* topicInfo = find_topic(cti->server->topics, topic); 
+    //Do nothing if topic does not exist or client not subbed to topic
+    if (!topicInfo || !remove_subscriber(topicInfo, cti->client)) {
+        return;
+    }
+    remove_empty_topic(cti, topic, topicInfo);
+
+    //Update stats
+    __atomic_add_fetch(&cti->server->stats->unsubCount, 1, __ATOMIC_RELAXED);
+}
+
+/* subscribe_group()
+ * -----------------
+ * Adds the client to a group on the given topic. Each message published to
+ * the topic goes to only one member of the group.
+ *
+ * cti: pointer to ClientThreadInfo struct that describes client joining the
+ * group
+ *
+ * topic: the topic the group subscribes to
+ *
+ * group: the name of the group
+ *
+ * conflate: true if a new group should only be sent the newest unsent value
+ */
+void subscribe_group(ClientThreadInfo* cti, char* topic, char* group, 
+        bool conflate) {
+    join_group(find_or_add_topic(cti, topic), group, cti->client, conflate);
+}
+
+/* unsubscribe_group()
+ * -------------------
+ * Removes the client from a group on the given topic
+ *
+ * cti: pointer to ClientThreadInfo struct that describes client leaving the
+ * group
+ *
+ * topic: the topic the group subscribes to
+ *
+ * group: the name of the group
+ */
+void unsubscribe_group(ClientThreadInfo* cti, char* topic, char* group) {
+    Topic* topicInfo = find_topic(cti->server->topics, topic);
+    Group* groupInfo = topicInfo ? find_group(topicInfo, group) : NULL;
+    //Do nothing if group does not exist or client is not a member
+    if (!groupInfo || !leave_group(topicInfo, groupInfo, cti->client)) {
+        return;
+    }
+    remove_empty_topic(cti, topic, topicInfo);
+    __atomic_add_fetch(&cti->server->stats->unsubCount, 1, __ATOMIC_RELAXED);
+}
+
+/* remove_empty_topic()
+ * --------------------
+ * Removes a topic from the table once it has no subscribers or groups left.
+ * The topic is freed once no publisher can still be using it. A topic
+ * holding recent messages is kept for TOPIC_RETENTION milliseconds first, so
+ * that a client that reconnects can still catch up on them.
+ *
+ * cti: pointer to ClientThreadInfo struct that holds the table
+ *
+ * topic: the name of the topic
+ *
+ * topicInfo: the topic stored in the table under that name
+ */
+void remove_empty_topic(ClientThreadInfo* cti, char* topic, Topic* topicInfo) {
+    if (!is_empty_topic(topicInfo)) {
+        return;
+    }
+    if (topicInfo->history.first != topicInfo->history.next) {
+        retain_topic(cti->server, topic, topicInfo, 0);
+        return;
+    }
+    remove_topic(cti->server->topics, topic);
+    retire_topic(topicInfo);
+}
+
+/* retain_topic()
+ * --------------
+ * Keeps an empty topic for TOPIC_RETENTION milliseconds from now, after which
+ * it is removed if it is still empty. A topic has at most one timer waiting,
+ * which puts itself back if the topic was emptied again since it was set.
+ * The subscription lock must be held.
+ *
+ * server: the server holding the topic
+ *
+ * topic: the name of the topic
+ *
+ * topicInfo: the topic stored in the table under that name
+ *
+ * emptyFor: how long the topic has already been empty, in nanoseconds
+ */
+void retain_topic(Server* server, char* topic, Topic* topicInfo,
+        uint64_t emptyFor) {
+    topicInfo->emptySince = now_nanos() - emptyFor;
+    if (topicInfo->retained) {
+        return;
+    }
+    uint64_t empty = emptyFor / NANOS_PER_MILLI;
+    topicInfo->retained = true;
+    Retention* retention = malloc(sizeof(Retention));
+    retention->timer.fire = fire_retention;
+    retention->timer.arg = retention;
+    retention->server = server;
+    retention->topic = strdup(topic);
+    add_timer(server->wheel, &retention->timer,
+            empty < TOPIC_RETENTION ? TOPIC_RETENTION - empty : 0);
+}
+
+/* fire_retention()
+ * ----------------
+ * Removes a retained topic that has now been empty for TOPIC_RETENTION
+ * milliseconds, waits again for one that was emptied again later, and lets
+ * go of one that has subscribers again
+ *
+ * arg: a pointer to the Retention struct, which is freed unless the timer is
+ * set again
+ */
+void fire_retention(void* arg) {
+    Retention* retention = arg;
+    Server* server = retention->server;
+    fair_lock(server->lock);
+    Topic* topic = find_topic(server->topics, retention->topic);
+    if (topic && is_empty_topic(topic)) {
+        uint64_t empty = (now_nanos() - topic->emptySince) / NANOS_PER_MILLI;
+        if (empty < TOPIC_RETENTION) {
+            add_timer(server->wheel, &retention->timer,
+                    TOPIC_RETENTION - empty);
+            fair_unlock(server->lock);
+            return;
+        }
+        remove_topic(server->topics, retention->topic);
+        retire_topic(topic);
+    } else if (topic) {
+        topic->retained = false;
+    }
+    fair_unlock(server->lock);
+    free(retention->topic);
+    free(retention);
+}
+
+/* publish()
+ * ---------
+ * Publishes the text that the client sends for a specific topic
+ *
+ * cti: a pointer to a ClientThreadInfo struct that describes the client
+ * sending the text
+ *
+ * buffer: the string containing the text that the client sent
+ */
+void publish(ClientThreadInfo* cti, char* buffer) {
+    size_t topicLen;
+    char* value;
+    parse_pub(buffer, &topicLen, &value);
+    char* topic = buffer + strlen(PUB_PREFIX);
+    topic[topicLen] = '\0';
+    publish_message(cti->server, cti->reader, cti->client->name, topic, 
+            value, 0);
+}
+
+/* publish_timed()
+ * ---------------
+ * Handles a pubdelay or pubttl command. A delayed publish is held on the 
+ * timer wheel until it is due, while a publish with a time to live is sent
+ * straight away and dropped from any queue it is still waiting in once the
+ * time is up.
+ *
+ * cti: a pointer to a ClientThreadInfo struct that describes the client
+ * sending the text
+ *
+ * buffer: the string containing the text that the client sent
+ *
+ * delayed: true for pubdelay and false for pubttl
+ */
+void publish_timed(ClientThreadInfo* cti, char* buffer, bool delayed) {
+    char** args = split_by_char(buffer, ' ', TIMED_PUB_FIELD_COUNT);
+    uint64_t millis = strtoull(args[TIMED_PUB_DELAY_POS], NULL, 10);
+    if (!delayed) {
+        publish_message(cti->server, cti->reader, cti->client->name, 
+                args[TIMED_PUB_TOPIC_POS], args[TIMED_PUB_VALUE_POS], millis);
+        free(args);
+        return;
+    }
+
+    DelayedPublish* delayedPub = malloc(sizeof(DelayedPublish));
+    delayedPub->server = cti->server;
+    delayedPub->name = strdup(cti->client->name);
+    delayedPub->topic = strdup(args[TIMED_PUB_TOPIC_POS]);
+    delayedPub->value = strdup(args[TIMED_PUB_VALUE_POS]);
+    delayedPub->timer.fire = fire_delayed_publish;
+    delayedPub->timer.arg = delayedPub;
+    add_timer(cti->server->wheel, &delayedPub->timer, millis);
+    free(args);
+}
+
+/* fire_delayed_publish()
+ * ----------------------
+ * Publishes a delayed message once it is due. Runs on the timer wheel's
+ * thread.
+ *
+ * arg: a pointer to the DelayedPublish struct
+ */
+void fire_delayed_publish(void* arg) {
+    DelayedPublish* delayedPub = arg;
+    Server* server = delayedPub->server;
+    publish_message(server, server->timerReader, delayedPub->name, 
+            delayedPub->topic, delayedPub->value, 0);
+
+    free(delayedPub->name);
+    free(delayedPub->topic);
+    free(delayedPub->value);
+    free(delayedPub);
+}
+
+/* fire_expiry()
+ * -------------
+ * Marks a message as expired once its time to live is up so that the sender
+ * drops it from any queue it is still waiting in. Runs on the timer wheel's
+ * thread.
+ *
+ * arg: a pointer to the Expiry struct
+ */
+void fire_expiry(void* arg) {
+    Expiry* expiry = arg;
+    for (int i = 0; i < MESSAGE_FORMS; i++) {
+        if (expiry->forms[i]) {
+            expire_payload(expiry->forms[i]);
+            release_payload(expiry->forms[i]);
+        }
+    }
+    free(expiry);
+}
+
+/* expire_later()
+ * --------------
+ * Sets a timer that marks a message restored from a handoff as expired once
+ * the rest of its time to live is up
+ *
+ * server: a pointer to the Server struct
+ *
+ * payload: the message, which the timer takes its own reference to
+ *
+ * ttl: the number of milliseconds the message has left
+ */
+void expire_later(Server* server, Payload* payload, uint64_t ttl) {
+    Expiry* expiry = malloc(sizeof(Expiry));
+    memset(expiry->forms, 0, sizeof(expiry->forms));
+    hold_payload(payload);
+    expiry->forms[FORM_PLAIN] = payload;
+    expiry->timer.fire = fire_expiry;
+    expiry->timer.arg = expiry;
+    add_timer(server->wheel, &expiry->timer, ttl);
+}
+
+/* publish_message()
+ * -----------------
+ * Publishes a message to a topic. Every direct subscriber receives the 
+ * message, and so does one member of each group. Each distinct filter is
+ * tested once and the message goes to every subscriber of the filters it
+ * passes, so subscribers that would drop it cost nothing to skip. The 
+ * message is formatted once and shared by every queue it is added to. A 
+ * copy stamped with its number is made for sequenced clients if there are
+ * any, or up front if the topic keeps its history. Large subscriber lists
+ * are shared out over the delivery pool. The topic and its snapshot of 
+ * subscribers are read inside a read-side section of the epoch domain. 
+ * Only the topic's history lock and the topic's stripe of the hot topic 
+ * tracker are taken, so publishes to different topics only wait for each 
+ * other briefly when their stripes are the same. The topic's traffic is 
+ * counted once the message is delivered.
+ *
+ * server: a pointer to the Server struct
+ *
+ * reader: the epoch record of the calling thread
+ *
+ * name: the name of the publishing client
+ *
+ * topic: the topic being published to
+ *
+ * value: the value being published
+ *
+ * ttl: the number of milliseconds before the message expires, or 0 if it
+ * never expires
+ */
+void publish_message(Server* server, EpochRecord* reader, char* name, 
+        char* topic, char* value, uint64_t ttl) {
+    size_t valueLen = strlen(value);
+    count_hot_topic(server->stats->hot, topic, valueLen);
+    epoch_enter(server->epoch, reader);
+    Topic* topicInfo = find_topic(server->topics, topic);
+    if (!topicInfo) {
+        epoch_exit(reader);
+        return;
+    }
+    size_t size = strlen(name) + strlen(topic) + valueLen +
+            MESSAGE_EXTRA_CHARS;
+    char* data = malloc(size);
+    int len = snprintf(data, size, "%s:%s:%s\n", name, topic, value);
+    Payload* payload = init_payload(topic, data, len);
+    payload->priority = topicInfo->priority;
+    if (ttl) {
+        payload->expires = payload->created + ttl * NANOS_PER_MILLI;
+    }
+
+    //Messages are numbered, kept and delivered one at a time so subscribers
+    //see them in order and subscribe_after() can slot in between two
+    History* history = &topicInfo->history;
+    pthread_mutex_lock(&history->lock);
+    DeliveryJob job = {.server = server, .forms = {payload, NULL, NULL, NULL},
+            .seq = history->next, .conflate = false};
+    if (history->kept) {
+        job.forms[FORM_SEQUENCED] = stamp_payload(payload, job.seq);
+    }
+    add_history(history, job.forms[FORM_SEQUENCED]);
+    Subscribers* subscribers = get_subscribers(topicInfo);
+    pthread_mutex_init(&job.lock, NULL);
+    fan_out(server->pool, subscribers->clients, subscribers->clientCount, 
+            deliver_job, &job);
+    job.conflate = true;
+    fan_out(server->pool, subscribers->conflated, 
+            subscribers->conflatedCount, deliver_job, &job);
+    for (int i = 0; i < subscribers->groupCount; i++) {
+        GroupView* group = &subscribers->groups[i];
+        job.conflate = group->conflate;
+        deliver_job(next_group_member(group), &job);
+    }
+    int deliveries = subscribers->clientCount + subscribers->conflatedCount +
+            subscribers->groupCount;
+    for (int i = 0; i < subscribers->filteredCount; i++) {
+        FilteredView* filtered = &subscribers->filtered[i];
+        if (!match_filter(filtered->filter, value, valueLen)) {
+            continue;
+        }
+        job.conflate = false;
+        fan_out(server->pool, filtered->clients, filtered->clientCount,
+                deliver_job, &job);
+        job.conflate = true;
+        fan_out(server->pool, filtered->conflated, 
+                filtered->conflatedCount, deliver_job, &job);
+        deliveries += filtered->clientCount + filtered->conflatedCount;
+    }
+    TopicTraffic* traffic = &topicInfo->traffic;
+    __atomic_add_fetch(&traffic->publishes, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&traffic->bytes, valueLen, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&traffic->deliveries, deliveries, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&history->lock);
+    epoch_exit(reader);
+    pthread_mutex_destroy(&job.lock);
+
+    if (ttl) {
+        //The expiry timer keeps the references until the message expires
+        Expiry* expiry = malloc(sizeof(Expiry));
+        memcpy(expiry->forms, job.forms, sizeof(job.forms));
+        expiry->timer.fire = fire_expiry;
+        expiry->timer.arg = expiry;
+        add_timer(server->wheel, &expiry->timer, ttl);
+        return;
+    }
+    for (int i = 0; i < MESSAGE_FORMS; i++) {
+        if (job.forms[i]) {
+            release_payload(job.forms[i]);
+        }
+    }
+}
+
+/* stamp_payload()
+ * ---------------
+ * Makes a copy of a message with its number in front, as ":<seq>:message"
+ *
+ * payload: the message
+ *
+ * seq: the number of the message within its topic
+ *
+ * Returns: the numbered copy, with one reference held by the caller
+ */
+Payload* stamp_payload(Payload* payload, uint64_t seq) {
+    size_t size = payload->len + SEQUENCE_EXTRA_CHARS;
+    char* data = malloc(size);
+    int len = snprintf(data, size, ":%" PRIu64 ":%.*s", seq, 
+            (int) payload->len, payload->data);
+    Payload* stamped = init_payload(payload->topic, data, len);
+    stamped->priority = payload->priority;
+    stamped->expires = payload->expires;
+    return stamped;
+}
+
+/* deflate_payload()
+ * -----------------
+ * Makes a compressed copy of a message for clients that asked for
+ * compression
+ *
+ * payload: the message
+ *
+ * Returns: the compressed copy, or the message itself if it is too short to
+ * be worth compressing, with one reference held by the caller
+ */
+Payload* deflate_payload(Payload* payload) {
+    size_t len;
+    char* frame = deflate_frame(payload->data, payload->len, &len);
+    if (!frame) {
+        hold_payload(payload);
+        return payload;
+    }
+    Payload* deflated = init_payload(payload->topic, frame, len);
+    deflated->priority = payload->priority;
+    deflated->expires = payload->expires;
+    return deflated;
+}
+
+/* get_form()
+ * ----------
+ * Finds the form of a fan-out's message that a subscriber is sent, making 
+ * it if no subscriber has needed it yet. Each form is made only once however
+ * many subscribers share it.
+ *
+ * job: the DeliveryJob struct of the fan-out
+ *
+ * form: the form wanted, made up of FORM_SEQUENCED and FORM_DEFLATE
+ *
+ * Returns: the message in that form
+ */
+Payload* get_form(DeliveryJob* job, int form) {
+    Payload* payload = __atomic_load_n(&job->forms[form], __ATOMIC_ACQUIRE);
+    if (payload) {
+        return payload;
+    }
+    pthread_mutex_lock(&job->lock);
+    if ((form & FORM_SEQUENCED) && !job->forms[FORM_SEQUENCED]) {
+        __atomic_store_n(&job->forms[FORM_SEQUENCED], 
+                stamp_payload(job->forms[FORM_PLAIN], job->seq), 
+                __ATOMIC_RELEASE);
+    }
+    payload = job->forms[form];
+    if (!payload) {
+        payload = deflate_payload(job->forms[form & ~FORM_DEFLATE]);
+        __atomic_store_n(&job->forms[form], payload, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return payload;
+}
+
+/* deliver()
+ * ---------
+ * Adds a message to a client's queue and lets the sender know it is there
+ *
+ * server: a pointer to the Server struct
+ *
+ * client: the client receiving the message
+ *
+ * payload: the message
+ *
+ * conflate: true if the message may replace an unsent message for the same
+ * topic
+ */
+void deliver(Server* server, Client* client, Payload* payload, 
+        bool conflate) {
+    if (enqueue(&client->queue, payload, conflate)) {
+        __atomic_add_fetch(&server->stats->conflatedCount, 1, 
+                __ATOMIC_RELAXED);
+    }
+    schedule_client(server->sender, client);
+}
+
+/* deliver_job()
+ * -------------
+ * Delivers the message of a fan-out to one of its subscribers, numbered if
+ * the subscriber is sequenced and compressed if it asked for compression.
+ * May be run by any of the delivery workers.
+ *
+ * client: the subscriber
+ *
+ * arg: a pointer to the DeliveryJob struct of the fan-out
+ */
+void deliver_job(Client* client, void* arg) {
+    DeliveryJob* job = arg;
+    int form = FORM_PLAIN;
+    if (__atomic_load_n(&client->sequenced, __ATOMIC_RELAXED)) {
+        form |= FORM_SEQUENCED;
+    }
+    if (client->deflate) {
+        form |= FORM_DEFLATE;
+    }
+    deliver(job->server, client, get_form(job, form), job->conflate);
+}
+
+/* reply()
+ * -------
+ * Sends a line of text back to the client that sent a command
+ *
+ * cti: a pointer to the ClientThreadInfo struct of the client
+ *
+ * text: the line to send, including the trailing newline
+ */
+void reply(ClientThreadInfo* cti, char* text) {
+    Payload* payload = init_payload(NULL, strdup(text), strlen(text));
+    enqueue(&cti->client->queue, payload, false);
+    release_payload(payload);
+    schedule_client(cti->server->sender, cti->client);
+}
+
+/* interrupt_handler()
+ * -------------------
+ * Does nothing. HANDOFF_SIGNAL is only sent to interrupt a thread that is
+ * blocked in a system call so that it notices the server is being handed
+ * over.
+ *
+ * sig: the signal received
+ */
+void interrupt_handler(int sig) {
+}
+
+/* now_nanos()
+ * -----------
+ * Returns: the current value of the monotonic clock in nanoseconds. The clock
+ * is shared by every process on the machine.
+ */
+uint64_t now_nanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * NANOSECONDS + now.tv_nsec;
+}
+
+/* wait_for_handoff()
+ * ------------------
+ * Stands the calling thread still while the server is frozen for a handoff.
+ * If the handoff succeeds the process exits while the thread is waiting.
+ *
+ * server: a pointer to the Server struct
+ *
+ * Returns: true if the thread waited for a handoff that did not go ahead and
+ * false if no handoff was in progress
+ */
+bool wait_for_handoff(Server* server) {
+    HandoffState* handoff = server->handoff;
+    pthread_mutex_lock(&handoff->lock);
+    bool waited = handoff->frozen;
+    if (waited) {
+        handoff->parked++;
+        pthread_cond_broadcast(&handoff->changed);
+        while (handoff->frozen) {
+            pthread_cond_wait(&handoff->changed, &handoff->lock);
+        }
+        handoff->parked--;
+    }
+    pthread_mutex_unlock(&handoff->lock);
+    return waited;
+}
+
+/* freeze_server()
+ * ---------------
+ * Stops every client thread or reader loop and the accepting thread, waiting
+ * until they are all standing still. Threads blocked reading are interrupted
+ * with HANDOFF_SIGNAL, which is sent again until every thread has stopped in
+ * case it arrived just before a thread blocked.
+ *
+ * server: a pointer to the Server struct
+ */
+void freeze_server(Server* server) {
+    HandoffState* handoff = server->handoff;
+    Stats* stats = server->stats;
+    pthread_mutex_lock(&handoff->lock);
+    __atomic_store_n(&handoff->frozen, true, __ATOMIC_RELEASE);
+    while (handoff->parked < handoff->threads) {
+        pthread_mutex_unlock(&handoff->lock);
+        if (server->loops) {
+            for (int i = 0; i < server->params->readers; i++) {
+                pthread_kill(server->loops[i].thread, HANDOFF_SIGNAL);
+            }
+        } else {
+            pthread_mutex_lock(stats->lockStat);
+            for (Node* node = stats->clients; node; node = node->next) {
+                pthread_kill(node->client->thread, HANDOFF_SIGNAL);
+            }
+            pthread_mutex_unlock(stats->lockStat);
+        }
+        pthread_kill(handoff->acceptThread, HANDOFF_SIGNAL);
+
+        pthread_mutex_lock(&handoff->lock);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += HANDOFF_RETRY_NANOS;
+        if (deadline.tv_nsec >= NANOSECONDS) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= NANOSECONDS;
+        }
+        pthread_cond_timedwait(&handoff->changed, &handoff->lock, &deadline);
+    }
+    pthread_mutex_unlock(&handoff->lock);
+}
+
+/* thaw_server()
+ * -------------
+ * Lets the threads stopped by freeze_server() carry on
+ *
+ * server: a pointer to the Server struct
+ */
+void thaw_server(Server* server) {
+    HandoffState* handoff = server->handoff;
+    pthread_mutex_lock(&handoff->lock);
+    __atomic_store_n(&handoff->frozen, false, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&handoff->changed);
+    pthread_mutex_unlock(&handoff->lock);
+}
+
+/* handoff_thread()
+ * ----------------
+ * Waits for a new server to connect to the handoff socket and hands the
+ * listening socket, every client and the server's state over to it. The
+ * process exits once the new server has everything.
+ *
+ * arg: a pointer to the Server struct
+ */
+void* handoff_thread(void* arg) {
+    Server* server = arg;
+    int listenFd = listen_handoff(server->params->handoffPath);
+    if (listenFd < 0) {
+        fprintf(stderr, "psserver: unable to listen for handoff\n");
+        return NULL;
+    }
+    while (true) {
+        int sock = accept(listenFd, NULL, NULL);
+        if (sock < 0) {
+            continue;
+        }
+        if (hand_over(server, sock)) {
+            exit(0);
+        }
+        close(sock);
+    }
+}
+
+/* hand_over()
+ * -----------
+ * Freezes the server and sends its state and sockets to a new server. If
+ * the new server does not confirm it has everything, the server carries on
+ * as if nothing happened.
+ *
+ * server: a pointer to the Server struct
+ *
+ * sock: the socket connected to the new server
+ *
+ * Returns: true if the new server has taken over and false otherwise. On
+ * success the server stays frozen.
+ */
+bool hand_over(Server* server, int sock) {
+    uint64_t frozenAt = now_nanos();
+    freeze_server(server);
+    pause_timer_wheel(server->wheel);
+    fair_lock(server->lock);
+    pause_sender(server->sender);
+
+    Snapshot snapshot;
+    int* fds;
+    int count;
+    save_state(server, &snapshot, &fds, &count, frozenAt);
+    char ack = 0;
+    bool done = send_snapshot(sock, &snapshot, fds, count) && 
+            read(sock, &ack, 1) == 1 && ack == HANDOFF_ACK;
+    free_snapshot(&snapshot);
+    free(fds);
+    if (done) {
+        return true;
+    }
+
+    resume_sender(server->sender);
+    fair_unlock(server->lock);
+    resume_timer_wheel(server->wheel);
+    thaw_server(server);
+    return false;
+}
+
+/* compare_clients()
+ * -----------------
+ * qsort() and bsearch() comparison function for client pointers
+ */
+int compare_clients(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t) *(Client* const*) a;
+    uintptr_t y = (uintptr_t) *(Client* const*) b;
+    return (x > y) - (x < y);
+}
+
+/* save_state()
+ * ------------
+ * Writes the stats, the clients, the topics and the pending delayed 
+ * publishes to a snapshot. Clients are referred to by their position in the
+ * snapshot, and the socket of each client follows the listening socket in
+ * fds. The server must be frozen.
+ *
+ * server: a pointer to the Server struct
+ *
+ * snapshot: set up and filled with the server's state
+ *
+ * fds: set to a newly allocated array of the sockets to send
+ *
+ * count: set to the number of sockets
+ *
+ * frozenAt: the time the server was frozen, in nanoseconds
+ */
+void save_state(Server* server, Snapshot* snapshot, int** fds, int* count,
+        uint64_t frozenAt) {
+    Stats* stats = server->stats;
+    init_snapshot(snapshot);
+    put_u32(snapshot, HANDOFF_MAGIC);
+    put_u64(snapshot, frozenAt);
+
+    pthread_mutex_lock(stats->lockStat);
+    put_u32(snapshot, stats->completedClients);
+    put_u32(snapshot, stats->pubCount);
+    put_u32(snapshot, stats->subCount);
+    put_u32(snapshot, stats->unsubCount);
+    put_u32(snapshot, stats->conflatedCount);
+
+    //Sort the clients so topics can find each client's position quickly
+    int clientCount = 0;
+    for (Node* node = stats->clients; node; node = node->next) {
+        clientCount++;
+    }
+    Client** clients = malloc(sizeof(Client*) * (clientCount + 1));
+    int i = 0;
+    for (Node* node = stats->clients; node; node = node->next) {
+        clients[i++] = node->client;
+    }
+    qsort(clients, clientCount, sizeof(Client*), compare_clients);
+
+    *count = clientCount + 1;
+    *fds = malloc(sizeof(int) * *count);
+    (*fds)[0] = server->handoff->listenFd;
+    put_u32(snapshot, clientCount);
+    for (i = 0; i < clientCount; i++) {
+        (*fds)[i + 1] = clients[i]->fd;
+        save_client(snapshot, clients[i]);
+    }
+    pthread_mutex_unlock(stats->lockStat);
+
+    size_t topicCount = reserve_u32(snapshot);
+    int topics = 0;
+    TopicEntry* entry = NULL;
+    while ((entry = iterate_topics(server->topics, entry))) {
+        save_topic(snapshot, entry, clients, clientCount);
+        topics++;
+    }
+    patch_u32(snapshot, topicCount, topics);
+    free(clients);
+
+    size_t delayedCount = reserve_u32(snapshot);
+    int delayed[2] = {0, 0};
+    void* visitArgs[2] = {snapshot, delayed};
+    visit_timers(server->wheel, save_delayed_publish, visitArgs);
+    patch_u32(snapshot, delayedCount, delayed[0]);
+}
+
+/* save_client()
+ * -------------
+ * Writes a client's name, the input it has sent that has not been handled
+ * yet, whether the rest of a line that is too long is being thrown away, and
+ * the output waiting to be sent to it
+ *
+ * snapshot: the snapshot to write to
+ *
+ * client: the client to save
+ */
+void save_client(Snapshot* snapshot, Client* client) {
+    put_u32(snapshot, client->hasName);
+    if (client->hasName) {
+        put_string(snapshot, client->name);
+    }
+    LineReader* reader = &client->reader;
+    put_bytes(snapshot, reader->buffer + reader->start, 
+            reader->end - reader->start);
+    put_u32(snapshot, reader->discarding);
+
+    save_queue(snapshot, &client->queue);
+    put_u64(snapshot, client->throttledTime * MILLISECONDS);
+    put_u32(snapshot, client->sequenced);
+    put_u32(snapshot, client->deflate);
+}
+
+/* save_queue()
+ * ------------
+ * Writes each message waiting in a client's outgoing queue with its topic,
+ * priority, whether it is conflated and how long it has left to live. 
+ * Messages that have expired are left out unless they are already partly 
+ * sent. The rest of a partly sent message is saved as a reply that never
+ * expires, so it is finished before anything else is written.
+ *
+ * snapshot: the snapshot to write to
+ *
+ * queue: the queue to save
+ */
+void save_queue(Snapshot* snapshot, OutQueue* queue) {
+    //Staged messages are saved first and then each lane in turn, which 
+    //keeps every lane's messages in order
+    pthread_mutex_lock(&queue->lock);
+    stage_entries(queue, NULL, queue->length);
+    size_t entryCount = reserve_u32(snapshot);
+    int entries = 0;
+    for (QueueEntry* entry = queue->head; entry; entry = entry->next) {
+        Payload* payload = entry->payload;
+        size_t skip = entry == queue->head ? queue->sent : 0;
+        if (skip) {
+            put_string(snapshot, "");
+            put_u32(snapshot, CONTROL_PRIORITY);
+            put_u32(snapshot, false);
+            put_u64(snapshot, 0);
+        } else if (is_expired(payload)) {
+            continue;
+        } else {
+            put_string(snapshot, payload->topic ? payload->topic : "");
+            put_u32(snapshot, payload->priority);
+            put_u32(snapshot, entry->conflate);
+            put_u64(snapshot, time_to_live(payload));
+        }
+        put_bytes(snapshot, payload->data + skip, payload->len - skip);
+        entries++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    patch_u32(snapshot, entryCount, entries);
+}
+
+/* save_client_list()
+ * ------------------
+ * Writes the number of clients in a list followed by the position of each
+ *
+ * snapshot: the snapshot to write to
+ *
+ * list: the first node of the list
+ *
+ * clients: every client, sorted by address
+ *
+ * count: the number of clients
+ */
+void save_client_list(Snapshot* snapshot, Node* list, Client** clients,
+        int count) {
+    size_t listCount = reserve_u32(snapshot);
+    int saved = 0;
+    for (Node* node = list; node; node = node->next) {
+        Client** found = bsearch(&node->client, clients, count, 
+                sizeof(Client*), compare_clients);
+        put_u32(snapshot, found - clients);
+        saved++;
+    }
+    patch_u32(snapshot, listCount, saved);
+}
+
+/* save_topic()
+ * ------------
+ * Writes a topic's name, its direct and conflated subscribers, its groups,
+ * its filtered subscribers, its recent messages with how long each has left
+ * to live, and how long it has been empty if it is being retained. The fair
+ * lock must be held and nothing may be publishing.
+ *
+ * snapshot: the snapshot to write to
+ *
+ * entry: the entry of the topic in the topic table
+ *
+ * clients: every client, sorted by address
+ *
+ * count: the number of clients
+ */
+void save_topic(Snapshot* snapshot, TopicEntry* entry, Client** clients,
+        int count) {
+    Topic* topic = entry->topic;
+    put_string(snapshot, entry->name);
+    save_client_list(snapshot, topic->clients, clients, count);
+    save_client_list(snapshot, topic->conflated, clients, count);
+
+    size_t groupCount = reserve_u32(snapshot);
+    int groups = 0;
+    for (Group* group = topic->groups; group; group = group->next) {
+        put_string(snapshot, group->name);
+        put_u32(snapshot, group->conflate);
+        put_u32(snapshot, group->cursor);
+        save_client_list(snapshot, group->members, clients, count);
+        groups++;
+    }
+    patch_u32(snapshot, groupCount, groups);
+
+    size_t filteredCount = reserve_u32(snapshot);
+    int filteredSets = 0;
+    for (Filtered* set = topic->filtered; set; set = set->next) {
+        put_u32(snapshot, set->filter->kind);
+        put_string(snapshot, set->filter->text);
+        put_string(snapshot, set->filter->name ? set->filter->name : "");
+        save_client_list(snapshot, set->clients, clients, count);
+        save_client_list(snapshot, set->conflated, clients, count);
+        filteredSets++;
+    }
+    patch_u32(snapshot, filteredCount, filteredSets);
+
+    History* history = &topic->history;
+    put_u32(snapshot, history->kept);
+    put_u64(snapshot, history->first);
+    put_u64(snapshot, history->next);
+    for (uint64_t seq = history->first; seq < history->next; seq++) {
+        Payload* payload = find_history(history, seq);
+        put_u32(snapshot, is_expired(payload));
+        put_u64(snapshot, time_to_live(payload));
+        put_bytes(snapshot, payload->data, payload->len);
+    }
+    put_u64(snapshot, topic->retained && is_empty_topic(topic) ?
+            now_nanos() - topic->emptySince : 0);
+}
+
+/* save_delayed_publish()
+ * ----------------------
+ * Writes a pending timer to the snapshot if it is a delayed publish. Message
+ * expiry timers are left out. Called for each timer by visit_timers().
+ *
+ * timer: the pending timer
+ *
+ * delay: the number of milliseconds until the timer is due
+ *
+ * arg: an array holding the snapshot and the number of delayed publishes
+ * written so far
+ */
+void save_delayed_publish(Timer* timer, uint64_t delay, void* arg) {
+    void** visitArgs = arg;
+    Snapshot* snapshot = visitArgs[0];
+    int* delayed = visitArgs[1];
+    if (timer->fire != fire_delayed_publish) {
+        return;
+    }
+    DelayedPublish* delayedPub = timer->arg;
+    put_u64(snapshot, delay);
+    put_string(snapshot, delayedPub->name);
+    put_string(snapshot, delayedPub->topic);
+    put_string(snapshot, delayedPub->value);
+    (*delayed)++;
+}
+
+/* take_over()
+ * -----------
+ * Receives the state and sockets of a running server, rebuilds its clients,
+ * topics and delayed publishes and starts serving its clients. Prints the
+ * listening port and then how long the clients were paused for.
+ *
+ * server: a pointer to the Server struct
+ *
+ * sock: the socket connected to the running server
+ *
+ * Returns: true if the server has taken over and false if the running 
+ * server's state could not be received
+ */
+bool take_over(Server* server, int sock) {
+    Snapshot snapshot;
+    int* fds;
+    int count;
+    ClientThreadInfo** ctis = NULL;
+    uint64_t frozenAt = 0;
+    char ack = HANDOFF_ACK;
+    bool done = receive_snapshot(sock, &snapshot, &fds, &count) && 
+            count > 0 && 
+            restore_state(server, &snapshot, fds, count, &ctis, &frozenAt) &&
+            write(sock, &ack, 1) == 1;
+    close(sock);
+    free_snapshot(&snapshot);
+    if (!done) {
+        //The running server keeps its sockets, so the copies received are
+        //closed
+        for (int i = 0; i < count; i++) {
+            close(fds[i]);
+        }
+        free(ctis);
+        free(fds);
+        return false;
+    }
+
+    server->handoff->listenFd = fds[0];
+    print_listen_port(fds[0]);
+    Stats* stats = server->stats;
+    for (int i = 0; i < count - 1; i++) {
+        if (stats->maxClients != 0) {
+            sem_trywait(stats->guard);
+        }
+        start_client(ctis[i]);
+        if (ctis[i]->client->queue.length) {
+            schedule_client(server->sender, ctis[i]->client);
+        }
+    }
+    fprintf(stderr, "handoff clients:%d\n", count - 1);
+    fprintf(stderr, "handoff pause:%.3fms\n", 
+            (now_nanos() - frozenAt) / NANOS_PER_MILLI);
+    fflush(stderr);
+    free(ctis);
+    free(fds);
+    return true;
+}
+
+/* restore_state()
+ * ---------------
+ * Rebuilds the stats, clients, topics and delayed publishes written by 
+ * save_state(). The client threads are not started.
+ *
+ * server: a pointer to the Server struct
+ *
+ * snapshot: the snapshot received
+ *
+ * fds: the listening socket followed by the socket of each client
+ *
+ * count: the number of sockets
+ *
+ * ctis: set to a newly allocated array of the ClientThreadInfo structs of the
+ * clients, in the order of the snapshot
+ *
+ * frozenAt: set to the time the old server was frozen, in nanoseconds
+ *
+ * Returns: true if the snapshot was valid and false otherwise
+ */
+bool restore_state(Server* server, Snapshot* snapshot, int* fds, int count,
+        ClientThreadInfo*** ctis, uint64_t* frozenAt) {
+    Stats* stats = server->stats;
+    if (get_u32(snapshot) != HANDOFF_MAGIC) {
+        return false;
+    }
+    *frozenAt = get_u64(snapshot);
+    stats->completedClients = get_u32(snapshot);
+    stats->pubCount = get_u32(snapshot);
+    stats->subCount = get_u32(snapshot);
+    stats->unsubCount = get_u32(snapshot);
+    stats->conflatedCount = get_u32(snapshot);
+
+    int clientCount = get_u32(snapshot);
+    if (clientCount != count - 1) {
+        return false;
+    }
+    *ctis = malloc(sizeof(ClientThreadInfo*) * (clientCount + 1));
+    for (int i = 0; i < clientCount; i++) {
+        ClientThreadInfo* cti = init_client(server, fds[i + 1]);
+        (*ctis)[i] = cti;
+        if (get_u32(snapshot)) {
+            char* name = get_string(snapshot);
+            if (!name) {
+                return false;
+            }
+            name_client(cti, name);
+            free(name);
+        }
+
+        size_t len;
+        char* input = get_bytes(snapshot, &len);
+        if (input && len) {
+            push_input(&cti->client->reader, input, len);
+        }
+        cti->client->reader.discarding = get_u32(snapshot);
+        if (!restore_queue(server, snapshot, &cti->client->queue)) {
+            return false;
+        }
+        cti->client->throttledTime = get_u64(snapshot) / 
+                (double) MILLISECONDS;
+        cti->client->sequenced = get_u32(snapshot);
+        cti->client->deflate = get_u32(snapshot);
+    }
+
+    int topics = get_u32(snapshot);
+    for (int i = 0; i < topics && snapshot->valid; i++) {
+        if (!restore_topic(server, snapshot, *ctis, clientCount)) {
+            return false;
+        }
+    }
+
+    int delayed = get_u32(snapshot);
+    for (int i = 0; i < delayed && snapshot->valid; i++) {
+        uint64_t delay = get_u64(snapshot);
+        DelayedPublish* delayedPub = malloc(sizeof(DelayedPublish));
+        delayedPub->server = server;
+        delayedPub->name = get_string(snapshot);
+        delayedPub->topic = get_string(snapshot);
+        delayedPub->value = get_string(snapshot);
+        if (!snapshot->valid) {
+            return false;
+        }
+        delayedPub->timer.fire = fire_delayed_publish;
+        delayedPub->timer.arg = delayedPub;
+        add_timer(server->wheel, &delayedPub->timer, delay);
+    }
+    return snapshot->valid;
+}
+
+/* restore_queue()
+ * ---------------
+ * Refills a client's outgoing queue from the messages written by 
+ * save_queue(), each in the lane for its priority and conflated as before,
+ * and sets a timer for each one that expires
+ *
+ * server: a pointer to the Server struct
+ *
+ * snapshot: the snapshot to read from
+ *
+ * queue: the queue to fill
+ *
+ * Returns: true if the messages were valid and false otherwise
+ */
+bool restore_queue(Server* server, Snapshot* snapshot, OutQueue* queue) {
+    int entries = get_u32(snapshot);
+    for (int i = 0; i < entries && snapshot->valid; i++) {
+        char* topic = get_string(snapshot);
+        unsigned int priority = get_u32(snapshot);
+        bool conflate = get_u32(snapshot);
+        uint64_t ttl = get_u64(snapshot);
+        size_t len;
+        char* bytes = get_bytes(snapshot, &len);
+        if (!topic || !bytes || priority >= PRIORITY_CLASSES ||
+                (conflate && !*topic)) {
+            free(topic);
+            return false;
+        }
+        char* data = malloc(len);
+        memcpy(data, bytes, len);
+        Payload* payload = init_payload(*topic ? topic : NULL, data, len);
+        payload->priority = priority;
+        if (ttl) {
+            payload->expires = payload->created + ttl * NANOS_PER_MILLI;
+            expire_later(server, payload, ttl);
+        }
+        enqueue(queue, payload, conflate);
+        release_payload(payload);
+        free(topic);
+    }
+    return snapshot->valid;
+}
+
+/* restore_client_list()
+ * ---------------------
+ * Reads a list written by save_client_list()
+ *
+ * snapshot: the snapshot to read from
+ *
+ * ctis: the ClientThreadInfo structs of the clients, in the order of the
+ * snapshot
+ *
+ * count: the number of clients
+ *
+ * listCount: set to the number of clients in the list
+ *
+ * Returns: a newly allocated array of the clients in the list, or NULL if 
+ * the list is not valid
+ */
+Client** restore_client_list(Snapshot* snapshot, ClientThreadInfo** ctis, 
+        uint32_t count, uint32_t* listCount) {
+    *listCount = get_u32(snapshot);
+    if (!snapshot->valid || *listCount > count) {
+        return NULL;
+    }
+    Client** clients = malloc(sizeof(Client*) * (*listCount + 1));
+    for (uint32_t i = 0; i < *listCount; i++) {
+        uint32_t position = get_u32(snapshot);
+        if (position >= count) {
+            free(clients);
+            return NULL;
+        }
+        clients[i] = ctis[position]->client;
+    }
+    return clients;
+}
+
+/* restore_filtered()
+ * ------------------
+ * Rebuilds one set of a topic's filtered subscribers written by 
+ * save_topic()
+ *
+ * snapshot: the snapshot to read from
+ *
+ * topic: the topic being rebuilt
+ *
+ * ctis: the ClientThreadInfo structs of the clients, in the order of the
+ * snapshot
+ *
+ * count: the number of clients
+ *
+ * Returns: true if the set was valid and false otherwise
+ */
+bool restore_filtered(Snapshot* snapshot, Topic* topic, 
+        ClientThreadInfo** ctis, uint32_t count) {
+    Filter filter;
+    filter.kind = get_u32(snapshot);
+    filter.text = get_string(snapshot);
+    filter.name = get_string(snapshot);
+    bool valid = filter.text && filter.name && filter.kind <= FILTER_FIELD;
+    if (valid) {
+        filter.len = strlen(filter.text);
+        filter.nameLen = strlen(filter.name);
+    }
+    for (int conflate = 0; conflate < 2 && valid; conflate++) {
+        uint32_t listCount;
+        Client** clients = restore_client_list(snapshot, ctis, count,
+                &listCount);
+        if (!clients) {
+            valid = false;
+            break;
+        }
+        for (uint32_t i = 0; i < listCount; i++) {
+            add_filtered_subscriber(topic, clients[i], &filter, conflate);
+        }
+        free(clients);
+    }
+    free(filter.text);
+    free(filter.name);
+    return valid;
+}
+
+/* restore_topic()
+ * ---------------
+ * Rebuilds one topic written by save_topic()
+ *
+ * server: a pointer to the Server struct
+ *
+ * snapshot: the snapshot to read from
+ *
+ * ctis: the ClientThreadInfo structs of the clients, in the order of the
+ * snapshot
+ *
+ * count: the number of clients
+ *
+ * Returns: true if the topic was valid and false otherwise
+ */
+bool restore_topic(Server* server, Snapshot* snapshot, 
+        ClientThreadInfo** ctis, uint32_t count) {
+    char* name = get_string(snapshot);
+    if (!name) {
+        return false;
+    }
+    Topic* topic = init_topic(server->epoch, server->params->history);
+    topic->priority = find_priority(&server->params->priorities, name);
+    add_topic(server->topics, name, topic);
+
+    for (int conflate = 0; conflate < 2; conflate++) {
+        uint32_t listCount;
+        Client** clients = restore_client_list(snapshot, ctis, count,
+                &listCount);
+        if (!clients) {
+            free(name);
+            return false;
+        }
+        load_subscribers(topic, clients, listCount, conflate);
+        free(clients);
+    }
+
+    int groups = get_u32(snapshot);
+    for (int i = 0; i < groups && snapshot->valid; i++) {
+        char* group = get_string(snapshot);
+        bool conflate = get_u32(snapshot);
+        unsigned int cursor = get_u32(snapshot);
+        uint32_t listCount;
+        Client** clients = restore_client_list(snapshot, ctis, count,
+                &listCount);
+        if (!group || !clients) {
+            free(group);
+            free(name);
+            return false;
+        }
+        for (uint32_t j = 0; j < listCount; j++) {
+            join_group(topic, group, clients[j], conflate);
+        }
+        Group* groupInfo = find_group(topic, group);
+        if (groupInfo) {
+            groupInfo->cursor = cursor;
+        }
+        free(group);
+        free(clients);
+    }
+
+    int filteredSets = get_u32(snapshot);
+    for (int i = 0; i < filteredSets && snapshot->valid; i++) {
+        if (!restore_filtered(snapshot, topic, ctis, count)) {
+            free(name);
+            return false;
+        }
+    }
+
+    //Carry on numbering where the old server left off
+    History* history = &topic->history;
+    if (get_u32(snapshot)) {
+        keep_history(history);
+    }
+    history->first = get_u64(snapshot);
+    history->next = history->first;
+    uint64_t next = get_u64(snapshot);
+    while (history->next < next && snapshot->valid) {
+        bool expired = get_u32(snapshot);
+        uint64_t ttl = get_u64(snapshot);
+        size_t len;
+        char* bytes = get_bytes(snapshot, &len);
+        if (!bytes) {
+            break;
+        }
+        char* data = malloc(len);
+        memcpy(data, bytes, len);
+        Payload* payload = init_payload(name, data, len);
+        payload->priority = topic->priority;
+        if (expired) {
+            expire_payload(payload);
+        } else if (ttl) {
+            payload->expires = payload->created + ttl * NANOS_PER_MILLI;
+            expire_later(server, payload, ttl);
+        }
+        add_history(history, payload);
+        release_payload(payload);
+    }
+
+    //An empty topic is only kept for what is left of its retention
+    uint64_t emptyFor = get_u64(snapshot);
+    if (is_empty_topic(topic) && snapshot->valid) {
+        retain_topic(server, name, topic, emptyFor);
+    }
+    free(name);
+    return snapshot->valid;
+}
@@ -72,6 +72,7 @@ int stringmap_add(StringMap* sm, char* key, void* item) {
     if (!sm->firstNode) {
         //Map is empty
         sm->firstNode = newNode;
+        newNode->next = NULL;
 
     } else {
         //Map has node
@@ -0,0 +1,279 @@
+#include <stdbool.h>
+#include <time.h>
+#include "timerWheel.h"
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE (1ULL << (WHEEL_BITS * WHEEL_LEVELS))
+#define MILLISECONDS 1000
+#define NANOS_PER_MILLI 1000000
+
+void* timer_thread(void* arg);
+
+/* now_millis()
+ * ------------
+ * Returns: the current value of the monotonic clock in milliseconds
+ */
+uint64_t now_millis(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * MILLISECONDS + now.tv_nsec / 
+            NANOS_PER_MILLI;
+}
+
+/* place_timer()
+ * -------------
+ * Puts a timer in the slot it belongs in given the wheel's current time. The
+ * wheel lock must be held.
+ *
+ * wheel: the wheel
+ *
+ * timer: the timer to place
+ */
+void place_timer(TimerWheel* wheel, Timer* timer) {
+    if (timer->expires <= wheel->now) {
+        timer->expires = wheel->now + 1;
+    }
+    uint64_t delta = timer->expires - wheel->now;
+    if (delta >= WHEEL_RANGE) {
+        delta = WHEEL_RANGE - 1;
+        timer->expires = wheel->now + delta;
+    }
+
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && 
+            delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    int slot = (timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    timer->next = wheel->slots[level][slot];
+    wheel->slots[level][slot] = timer;
+    wheel->counts[level]++;
+}
+
+/* take_slot()
+ * -----------
+ * Removes every timer from a slot. The wheel lock must be held.
+ *
+ * wheel: the wheel
+ *
+ * level: the level of the slot
+ *
+ * slot: the index of the slot
+ *
+ * Returns: the timers that were in the slot
+ */
+Timer* take_slot(TimerWheel* wheel, int level, int slot) {
+    Timer* timers = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    for (Timer* timer = timers; timer; timer = timer->next) {
+        wheel->counts[level]--;
+    }
+    return timers;
+}
+
+/* next_busy_tick()
+ * ----------------
+ * Finds the first tick after the wheel's current time at which a timer
+ * expires or a slot holding timers on a higher level is moved down. Nothing
+ * happens on the ticks before it. The wheel lock must be held.
+ *
+ * wheel: the wheel
+ *
+ * Returns: the tick, or UINT64_MAX if no timers are pending
+ */
+uint64_t next_busy_tick(TimerWheel* wheel) {
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        if (!wheel->counts[level]) {
+            continue;
+        }
+        //Every timer on a level is reached within one turn of the level
+        int shift = WHEEL_BITS * level;
+        for (uint64_t turn = 1; turn <= WHEEL_SLOTS; turn++) {
+            uint64_t tick = ((wheel->now >> shift) + turn) << shift;
+            if (tick >= next) {
+                break;
+            }
+            if (wheel->slots[level][(tick >> shift) & WHEEL_MASK]) {
+                next = tick;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+/* advance_wheel()
+ * ---------------
+ * Moves the wheel forward up to the given time, skipping straight over ticks
+ * with nothing to do. Timers on higher levels are moved down a level each
+ * time the level below completes a turn. The wheel lock must be held.
+ *
+ * wheel: the wheel
+ *
+ * target: the tick to advance to
+ *
+ * Returns: the timers that have expired
+ */
+Timer* advance_wheel(TimerWheel* wheel, uint64_t target) {
+    Timer* expired = NULL;
+    while (wheel->now < target) {
+        uint64_t busy = next_busy_tick(wheel);
+        if (busy > target) {
+            wheel->now = target;
+            break;
+        }
+        wheel->now = busy;
+        uint64_t tick = busy;
+        for (int level = 1; level < WHEEL_LEVELS; level++) {
+            if (tick & ((1ULL << (WHEEL_BITS * level)) - 1)) {
+                break;
+            }
+            Timer* timer = take_slot(wheel, level, 
+                    (tick >> (WHEEL_BITS * level)) & WHEEL_MASK);
+            while (timer) {
+                Timer* next = timer->next;
+                place_timer(wheel, timer);
+                timer = next;
+            }
+        }
+
+        Timer* timer = take_slot(wheel, 0, tick & WHEEL_MASK);
+        while (timer) {
+            Timer* next = timer->next;
+            timer->next = expired;
+            expired = timer;
+            wheel->pending--;
+            timer = next;
+        }
+    }
+    return expired;
+}
+
+void init_timer_wheel(TimerWheel* wheel) {
+    pthread_mutex_init(&wheel->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wheel->added, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&wheel->idle, NULL);
+    wheel->paused = false;
+    wheel->firing = false;
+    wheel->start = now_millis();
+    wheel->now = 0;
+    wheel->due = 0;
+    wheel->pending = 0;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        wheel->counts[level] = 0;
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            wheel->slots[level][slot] = NULL;
+        }
+    }
+
+    pthread_t threadId;
+    pthread_create(&threadId, NULL, timer_thread, wheel);
+    pthread_detach(threadId);
+}
+
+void add_timer(TimerWheel* wheel, Timer* timer, uint64_t delay) {
+    pthread_mutex_lock(&wheel->lock);
+    uint64_t now = now_millis() - wheel->start;
+    if (!wheel->pending) {
+        //Nothing is waiting so the wheel can jump straight to now
+        wheel->now = now;
+    }
+    timer->expires = now + delay;
+    place_timer(wheel, timer);
+    wheel->pending++;
+    if (timer->expires < wheel->due) {
+        pthread_cond_signal(&wheel->added);
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+int get_wheel_occupancy(TimerWheel* wheel, int* counts) {
+    pthread_mutex_lock(&wheel->lock);
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        counts[level] = wheel->counts[level];
+    }
+    int pending = wheel->pending;
+    pthread_mutex_unlock(&wheel->lock);
+    return pending;
+}
+
+void pause_timer_wheel(TimerWheel* wheel) {
+    pthread_mutex_lock(&wheel->lock);
+    wheel->paused = true;
+    while (wheel->firing) {
+        pthread_cond_wait(&wheel->idle, &wheel->lock);
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+void resume_timer_wheel(TimerWheel* wheel) {
+    pthread_mutex_lock(&wheel->lock);
+    wheel->paused = false;
+    pthread_cond_signal(&wheel->added);
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+void visit_timers(TimerWheel* wheel, 
+        void (*visit)(Timer* timer, uint64_t delay, void* arg), void* arg) {
+    pthread_mutex_lock(&wheel->lock);
+    uint64_t now = now_millis() - wheel->start;
+    for (int level = 0; level < WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+            for (Timer* timer = wheel->slots[level][slot]; timer; 
+                    timer = timer->next) {
+                visit(timer, timer->expires > now ? timer->expires - now : 0,
+                        arg);
+            }
+        }
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+/* timer_thread()
+ * --------------
+ * Advances the wheel while timers are pending and the wheel is not paused,
+ * and fires the timers that expire. Between expiries the thread sleeps
+ * until the next tick with anything to do rather than waking every tick.
+ * Timers are fired without the wheel lock held so they may add new timers.
+ *
+ * arg: a pointer to the TimerWheel struct
+ */
+void* timer_thread(void* arg) {
+    TimerWheel* wheel = arg;
+
+    pthread_mutex_lock(&wheel->lock);
+    while (true) {
+        while (!wheel->pending || wheel->paused) {
+            wheel->due = UINT64_MAX;
+            pthread_cond_wait(&wheel->added, &wheel->lock);
+        }
+        wheel->due = 0;
+        Timer* expired = advance_wheel(wheel, now_millis() - wheel->start);
+        if (!expired) {
+            wheel->due = next_busy_tick(wheel);
+            uint64_t millis = wheel->start + wheel->due;
+            struct timespec until;
+            until.tv_sec = millis / MILLISECONDS;
+            until.tv_nsec = (millis % MILLISECONDS) * NANOS_PER_MILLI;
+            pthread_cond_timedwait(&wheel->added, &wheel->lock, &until);
+            continue;
+        }
+        wheel->firing = true;
+        pthread_mutex_unlock(&wheel->lock);
+
+        while (expired) {
+            Timer* next = expired->next;
+            expired->fire(expired->arg);
+            expired = next;
+        }
+        pthread_mutex_lock(&wheel->lock);
+        wheel->firing = false;
+        pthread_cond_broadcast(&wheel->idle);
+    }
+    return NULL;
+}
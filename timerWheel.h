@@ -0,0 +1,107 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define WHEEL_LEVELS 5
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+//A timer that runs fire(arg) on the wheel's thread once it expires. Timers
+//are embedded in the struct that owns them and are not freed by the wheel.
+struct Timer {
+    uint64_t expires;
+    void (*fire)(void* arg);
+    void* arg;
+    struct Timer* next;
+};
+
+typedef struct Timer Timer;
+
+//A hierarchical timing wheel with a tick of one millisecond. Each level has
+//WHEEL_SLOTS slots and each slot of a level spans a whole turn of the level
+//below it, so adding and expiring a timer take constant time however many
+//timers are pending. firing is true while the wheel's thread is running
+//expired timers, and no timers expire while paused is true. The thread
+//sleeps until the next tick with anything to do, which is kept in due so
+//that adding an earlier timer wakes it, and due is 0 while it is awake.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t added;
+    pthread_cond_t idle;
+    bool paused;
+    bool firing;
+    uint64_t now;
+    uint64_t start;
+    uint64_t due;
+    Timer* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    int counts[WHEEL_LEVELS];
+    int pending;
+} TimerWheel;
+
+/* init_timer_wheel()
+ * ------------------
+ * Sets up an empty timer wheel and starts the thread that expires its timers
+ *
+ * wheel: the wheel to set up
+ */
+void init_timer_wheel(TimerWheel* wheel);
+
+/* add_timer()
+ * -----------
+ * Schedules a timer to fire after a delay
+ *
+ * wheel: the wheel to add the timer to
+ *
+ * timer: the timer, with fire and arg already set
+ *
+ * delay: the number of milliseconds until the timer fires
+ */
+void add_timer(TimerWheel* wheel, Timer* timer, uint64_t delay);
+
+/* get_wheel_occupancy()
+ * ---------------------
+ * Reports how many timers are waiting on each level of the wheel
+ *
+ * wheel: the wheel
+ *
+ * counts: an array of WHEEL_LEVELS ints to populate
+ *
+ * Returns: the total number of pending timers
+ */
+int get_wheel_occupancy(TimerWheel* wheel, int* counts);
+
+/* pause_timer_wheel()
+ * -------------------
+ * Stops timers from expiring, waiting for any timers already expiring to
+ * finish firing. Timers may still be added while the wheel is paused.
+ *
+ * wheel: the wheel to pause
+ */
+void pause_timer_wheel(TimerWheel* wheel);
+
+/* resume_timer_wheel()
+ * --------------------
+ * Lets timers expire again after pause_timer_wheel(). Timers that fell due
+ * while the wheel was paused fire straight away.
+ *
+ * wheel: the wheel to resume
+ */
+void resume_timer_wheel(TimerWheel* wheel);
+
+/* visit_timers()
+ * --------------
+ * Calls visit for every pending timer. The timers stay on the wheel.
+ *
+ * wheel: the wheel
+ *
+ * visit: called with each timer, the number of milliseconds until it is due
+ * and arg
+ *
+ * arg: passed to visit along with each timer
+ */
+void visit_timers(TimerWheel* wheel, 
+        void (*visit)(Timer* timer, uint64_t delay, void* arg), void* arg);
+#endif
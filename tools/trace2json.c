@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../trace.h"
+
+#define USAGE_EXIT 1
+#define READ_ERROR_EXIT 2
+#define NANOS_PER_MICRO 1000.0
+#define COMMAND_COUNT 8
+
+//The names of the commands recorded in TRACE_COMMAND_END events, indexed by
+//the command codes returned by validate_cmd() in server.c
+const char* commandNames[COMMAND_COUNT] = {"sub", "unsub", "pub", "name", 
+        "", "unsub group", "pubdelay", "pubttl"};
+
+/* print_event()
+ * -------------
+ * Prints one trace event as Chrome trace events. Spans are printed as
+ * begin and end events on the thread that recorded them.
+ *
+ * event: the event
+ *
+ * first: true if no event has been printed yet
+ *
+ * Returns: false, so the next event knows one has been printed
+ */
+bool print_event(TraceEvent* event, bool first) {
+    double time = event->time / NANOS_PER_MICRO;
+    const char* format = "%s{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,"
+            "\"pid\":1,\"tid\":%u,\"args\":{\"fd\":%u,\"%s\":%u}}\n";
+    const char* separator = first ? "" : ",";
+    switch (event->type) {
+        case TRACE_ACCEPT_BEGIN:
+        case TRACE_ACCEPT_END:
+            printf(format, separator, "accept", 
+                    event->type == TRACE_ACCEPT_BEGIN ? "B" : "E", time, 
+                    event->tid, event->arg, "value", event->value);
+            break;
+        case TRACE_COMMAND_BEGIN:
+            printf(format, separator, "command", "B", time, event->tid, 
+                    event->arg, "value", event->value);
+            break;
+        case TRACE_COMMAND_END:
+            printf("%s{\"name\":\"command\",\"ph\":\"E\",\"ts\":%.3f,"
+                    "\"pid\":1,\"tid\":%u,\"args\":{\"fd\":%u,"
+                    "\"command\":\"%s\"}}\n", separator, time, event->tid,
+                    event->arg, event->value < COMMAND_COUNT ? 
+                    commandNames[event->value] : "invalid");
+            break;
+        case TRACE_LOCK_WAIT:
+            printf(format, separator, "lock wait", "B", time, event->tid,
+                    event->arg, "value", event->value);
+            break;
+        case TRACE_LOCK_ACQUIRED:
+            printf(format, separator, "lock wait", "E", time, event->tid,
+                    event->arg, "value", event->value);
+            printf(format, ",", "lock held", "B", time, event->tid,
+                    event->arg, "value", event->value);
+            break;
+        case TRACE_LOCK_RELEASED:
+            printf(format, separator, "lock held", "E", time, event->tid,
+                    event->arg, "value", event->value);
+            break;
+        case TRACE_WRITE_BEGIN:
+        case TRACE_WRITE_END:
+            printf(format, separator, "write", 
+                    event->type == TRACE_WRITE_BEGIN ? "B" : "E", time, 
+                    event->tid, event->arg, "bytes", event->value);
+            break;
+        default:
+            return first;
+    }
+    return false;
+}
+
+/* main()
+ * ------
+ * Converts a trace file dumped by psserver into the JSON trace event format
+ * read by chrome://tracing and Perfetto, printed to stdout
+ *
+ * Errors: exits with USAGE_EXIT (1) if no file is given and READ_ERROR_EXIT
+ * (2) if the file cannot be read or is not a trace file
+ */
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: trace2json tracefile\n");
+        return USAGE_EXIT;
+    }
+    FILE* file = fopen(argv[1], "r");
+    TraceHeader header;
+    if (!file || fread(&header, sizeof(header), 1, file) != 1 || 
+            header.magic != TRACE_MAGIC || header.version != TRACE_VERSION) {
+        fprintf(stderr, "trace2json: unable to read %s\n", argv[1]);
+        return READ_ERROR_EXIT;
+    }
+
+    printf("{\"traceEvents\":[\n");
+    bool first = true;
+    for (uint32_t i = 0; i < header.threadCount; i++) {
+        TraceThread thread;
+        if (fread(&thread, sizeof(thread), 1, file) != 1) {
+            fprintf(stderr, "trace2json: %s is cut short\n", argv[1]);
+            return READ_ERROR_EXIT;
+        }
+        thread.name[TRACE_NAME_SIZE - 1] = '\0';
+        printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%u,\"args\":{\"name\":\"%s\"}}\n", 
+                first ? "" : ",", thread.tid, thread.name);
+        first = false;
+    }
+    for (uint32_t i = 0; i < header.eventCount; i++) {
+        TraceEvent event;
+        if (fread(&event, sizeof(event), 1, file) != 1) {
+            fprintf(stderr, "trace2json: %s is cut short\n", argv[1]);
+            return READ_ERROR_EXIT;
+        }
+        first = print_event(&event, first);
+    }
+    printf("]}\n");
+    fclose(file);
+    return 0;
+}
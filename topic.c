@@ -0,0 +1,428 @@
+#include <string.h>
+#include "topic.h"
+
+/* free_list()
+ * -----------
+ * Frees every node in a client list
+ *
+ * node: the first node in the list
+ */
+void free_list(Node* node) {
+    while (node) {
+        Node* next = node->next;
+        free(node);
+        node = next;
+    }
+}
+
+/* count_list()
+ * ------------
+ * Counts the clients in a client list
+ *
+ * node: the first node in the list
+ *
+ * Returns: the number of clients in the list
+ */
+int count_list(Node* node) {
+    int count = 0;
+    for (; node; node = node->next) {
+        count++;
+    }
+    return count;
+}
+
+/* copy_list()
+ * -----------
+ * Copies the clients of a client list into a new array
+ *
+ * node: the first node in the list
+ *
+ * count: set to the number of clients in the list
+ *
+ * Returns: the array of clients, or NULL if the list is empty
+ */
+Client** copy_list(Node* node, int* count) {
+    *count = count_list(node);
+    if (!*count) {
+        return NULL;
+    }
+    Client** clients = malloc(sizeof(Client*) * *count);
+    for (int i = 0; node; node = node->next) {
+        clients[i++] = node->client;
+    }
+    return clients;
+}
+
+/* free_subscribers()
+ * ------------------
+ * Frees a snapshot of a topic's subscribers
+ *
+ * arg: the Subscribers struct to free
+ */
+void free_subscribers(void* arg) {
+    Subscribers* subscribers = arg;
+    free(subscribers->clients);
+    free(subscribers->conflated);
+    for (int i = 0; i < subscribers->groupCount; i++) {
+        free(subscribers->groups[i].members);
+    }
+    free(subscribers->groups);
+    for (int i = 0; i < subscribers->filteredCount; i++) {
+        free(subscribers->filtered[i].clients);
+        free(subscribers->filtered[i].conflated);
+    }
+    free(subscribers->filtered);
+    free(subscribers);
+}
+
+/* free_group()
+ * ------------
+ * Frees a group that has no members left
+ *
+ * arg: the Group struct to free
+ */
+void free_group(void* arg) {
+    Group* group = arg;
+    free(group->name);
+    free(group);
+}
+
+/* free_filtered()
+ * ---------------
+ * Frees a set of filtered subscribers that has no subscribers left
+ *
+ * arg: the Filtered struct to free
+ */
+void free_filtered(void* arg) {
+    Filtered* filtered = arg;
+    free_filter(filtered->filter);
+    free(filtered);
+}
+
+/* update_subscribers()
+ * --------------------
+ * Builds a new snapshot from the topic's lists, groups and filtered sets,
+ * swaps it in for publishers and retires the old one
+ *
+ * topic: the topic that has changed
+ */
+void update_subscribers(Topic* topic) {
+    Subscribers* subscribers = malloc(sizeof(Subscribers));
+    subscribers->clients = copy_list(topic->clients,
+            &subscribers->clientCount);
+    subscribers->conflated = copy_list(topic->conflated,
+            &subscribers->conflatedCount);
+
+    subscribers->groupCount = 0;
+    for (Group* group = topic->groups; group; group = group->next) {
+        subscribers->groupCount++;
+    }
+    subscribers->groups = malloc(sizeof(GroupView) *
+            (subscribers->groupCount ? subscribers->groupCount : 1));
+    GroupView* view = subscribers->groups;
+    for (Group* group = topic->groups; group; group = group->next, view++) {
+        view->members = copy_list(group->members, &view->memberCount);
+        view->cursor = &group->cursor;
+        view->conflate = group->conflate;
+    }
+
+    subscribers->filteredCount = 0;
+    for (Filtered* set = topic->filtered; set; set = set->next) {
+        subscribers->filteredCount++;
+    }
+    subscribers->filtered = malloc(sizeof(FilteredView) *
+            (subscribers->filteredCount ? subscribers->filteredCount : 1));
+    FilteredView* filteredView = subscribers->filtered;
+    for (Filtered* set = topic->filtered; set; 
+            set = set->next, filteredView++) {
+        filteredView->filter = set->filter;
+        filteredView->clients = copy_list(set->clients, 
+                &filteredView->clientCount);
+        filteredView->conflated = copy_list(set->conflated, 
+                &filteredView->conflatedCount);
+    }
+
+    Subscribers* old = topic->subscribers;
+    __atomic_store_n(&topic->subscribers, subscribers, __ATOMIC_RELEASE);
+    if (old) {
+        retire(topic->epoch, old, free_subscribers);
+    }
+}
+
+/* free_topic()
+ * ------------
+ * Frees a topic along with all of its client lists, groups, filtered sets and
+ * its snapshot. The clients themselves are not freed.
+ *
+ * arg: the Topic struct to free
+ */
+void free_topic(void* arg) {
+    Topic* topic = arg;
+    free_list(topic->clients);
+    free_list(topic->conflated);
+    Group* group = topic->groups;
+    while (group) {
+        Group* next = group->next;
+        free_list(group->members);
+        free_group(group);
+        group = next;
+    }
+    Filtered* filtered = topic->filtered;
+    while (filtered) {
+        Filtered* next = filtered->next;
+        free_list(filtered->clients);
+        free_list(filtered->conflated);
+        free_filtered(filtered);
+        filtered = next;
+    }
+    free_subscribers(topic->subscribers);
+    free_history(&topic->history);
+    free(topic);
+}
+
+Topic* init_topic(EpochDomain* epoch, int historySize) {
+    Topic* topic = malloc(sizeof(Topic));
+    topic->clients = NULL;
+    topic->conflated = NULL;
+    topic->groups = NULL;
+    topic->filtered = NULL;
+    topic->subscribers = NULL;
+    topic->epoch = epoch;
+    init_history(&topic->history, historySize);
+    memset(&topic->traffic, 0, sizeof(TopicTraffic));
+    topic->priority = DEFAULT_PRIORITY;
+    topic->emptySince = 0;
+    topic->retained = false;
+    update_subscribers(topic);
+    return topic;
+}
+
+void retire_topic(Topic* topic) {
+    retire(topic->epoch, topic, free_topic);
+}
+
+Subscribers* get_subscribers(Topic* topic) {
+    return __atomic_load_n(&topic->subscribers, __ATOMIC_ACQUIRE);
+}
+
+int count_subscribers(Topic* topic) {
+    Subscribers* subscribers = get_subscribers(topic);
+    int count = subscribers->clientCount + subscribers->conflatedCount;
+    for (int i = 0; i < subscribers->groupCount; i++) {
+        count += subscribers->groups[i].memberCount;
+    }
+    for (int i = 0; i < subscribers->filteredCount; i++) {
+        count += subscribers->filtered[i].clientCount +
+                subscribers->filtered[i].conflatedCount;
+    }
+    return count;
+}
+
+bool is_empty_topic(Topic* topic) {
+    return !topic->clients && !topic->conflated && !topic->groups &&
+            !topic->filtered;
+}
+
+/* remove_from_topic_list()
+ * ------------------------
+ * Removes a client from one of a topic's subscriber lists
+ *
+ * list: a pointer to the first node of the list
+ *
+ * client: the client to be removed
+ *
+ * Returns: true if the client was in the list and false otherwise
+ */
+bool remove_from_topic_list(Node** list, Client* client) {
+    if (!*list || !in_list(*list, client)) {
+        return false;
+    }
+    *list = remove_from_list(*list, client);
+    return true;
+}
+
+/* leave_filtered()
+ * ----------------
+ * Removes a client from whichever set of filtered subscribers on the topic it
+ * is in. A set left with no subscribers is unlinked from the topic, but must
+ * only be retired once a snapshot without it has been published.
+ *
+ * topic: the topic
+ *
+ * client: the client leaving
+ *
+ * keep: a set that is not unlinked even if it is left empty, as the client
+ * is about to rejoin it, or NULL
+ *
+ * emptied: set to the set that was unlinked, or NULL if none was
+ *
+ * Returns: true if the client was in a set and false otherwise
+ */
+bool leave_filtered(Topic* topic, Client* client, Filtered* keep,
+        Filtered** emptied) {
+    *emptied = NULL;
+    for (Filtered** link = &topic->filtered; *link; 
+            link = &(*link)->next) {
+        Filtered* set = *link;
+        if (!remove_from_topic_list(&set->clients, client) &&
+                !remove_from_topic_list(&set->conflated, client)) {
+            continue;
+        }
+        if (!set->clients && !set->conflated && set != keep) {
+            *link = set->next;
+            *emptied = set;
+        }
+        return true;
+    }
+    return false;
+}
+
+/* retire_filtered()
+ * -----------------
+ * Frees an unlinked set of filtered subscribers once publishers are done 
+ * with its filter
+ *
+ * topic: the topic the set belonged to
+ *
+ * filtered: the set, or NULL if there is nothing to retire
+ */
+void retire_filtered(Topic* topic, Filtered* filtered) {
+    if (filtered) {
+        retire(topic->epoch, filtered, free_filtered);
+    }
+}
+
+/* add_to_topic_list()
+ * -------------------
+ * Adds a client to one of a topic's subscriber lists if it is not already
+ * there
+ *
+ * list: a pointer to the first node of the list
+ *
+ * client: the client to be added
+ */
+void add_to_topic_list(Node** list, Client* client) {
+    if (!*list) {
+        *list = init_client_list(client);
+    } else if (!in_list(*list, client)) {
+        add_client(*list, client);
+    }
+}
+
+void add_subscriber(Topic* topic, Client* client, bool conflate) {
+    Node** list = &topic->clients;
+    if (conflate) {
+        list = &topic->conflated;
+        remove_from_topic_list(&topic->clients, client);
+    } else {
+        remove_from_topic_list(&topic->conflated, client);
+    }
+    Filtered* emptied;
+    leave_filtered(topic, client, NULL, &emptied);
+
+    add_to_topic_list(list, client);
+    update_subscribers(topic);
+    retire_filtered(topic, emptied);
+}
+
+void add_filtered_subscriber(Topic* topic, Client* client, Filter* filter,
+        bool conflate) {
+    remove_from_topic_list(&topic->clients, client);
+    remove_from_topic_list(&topic->conflated, client);
+    Filtered* set = topic->filtered;
+    while (set && !same_filter(set->filter, filter)) {
+        set = set->next;
+    }
+    if (!set) {
+        set = malloc(sizeof(Filtered));
+        set->filter = copy_filter(filter);
+        set->clients = NULL;
+        set->conflated = NULL;
+        set->next = topic->filtered;
+        topic->filtered = set;
+    }
+    Filtered* emptied;
+    leave_filtered(topic, client, set, &emptied);
+
+    add_to_topic_list(conflate ? &set->conflated : &set->clients, client);
+    update_subscribers(topic);
+    retire_filtered(topic, emptied);
+}
+
+void load_subscribers(Topic* topic, Client** clients, int count, 
+        bool conflate) {
+    Node** list = conflate ? &topic->conflated : &topic->clients;
+    for (int i = 0; i < count; i++) {
+        Node* node = init_client_list(clients[i]);
+        node->next = *list;
+        *list = node;
+    }
+    update_subscribers(topic);
+}
+
+bool remove_subscriber(Topic* topic, Client* client) {
+    Filtered* emptied = NULL;
+    if (!remove_from_topic_list(&topic->clients, client) &&
+            !remove_from_topic_list(&topic->conflated, client) &&
+            !leave_filtered(topic, client, NULL, &emptied)) {
+        return false;
+    }
+    update_subscribers(topic);
+    retire_filtered(topic, emptied);
+    return true;
+}
+
+Group* find_group(Topic* topic, char* name) {
+    for (Group* group = topic->groups; group; group = group->next) {
+        if (!strcmp(group->name, name)) {
+            return group;
+        }
+    }
+    return NULL;
+}
+
+void join_group(Topic* topic, char* name, Client* client, bool conflate) {
+    Group* group = find_group(topic, name);
+    if (!group) {
+        group = malloc(sizeof(Group));
+        group->name = strdup(name);
+        group->members = init_client_list(client);
+        group->cursor = 0;
+        group->conflate = conflate;
+        group->next = topic->groups;
+        topic->groups = group;
+    } else if (!in_list(group->members, client)) {
+        add_client(group->members, client);
+    } else {
+        return;
+    }
+    update_subscribers(topic);
+}
+
+bool leave_group(Topic* topic, Group* group, Client* client) {
+    if (!in_list(group->members, client)) {
+        return false;
+    }
+
+    group->members = remove_from_list(group->members, client);
+    if (!group->members) {
+        //Last member left - delete the group once publishers are done with
+        //its cursor
+        Group** link = &topic->groups;
+        while (*link != group) {
+            link = &(*link)->next;
+        }
+        *link = group->next;
+        update_subscribers(topic);
+        retire(topic->epoch, group, free_group);
+        return true;
+    }
+    update_subscribers(topic);
+    return true;
+}
+
+Client* next_group_member(GroupView* group) {
+    unsigned int turn = __atomic_fetch_add(group->cursor, 1, 
+            __ATOMIC_RELAXED);
+    return group->members[turn % group->memberCount];
+}
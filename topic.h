@@ -0,0 +1,278 @@
+#ifndef TOPIC_H
+#define TOPIC_H
+
+#include <stdbool.h>
+#include "clientList.h"
+#include "epoch.h"
+#include "filter.h"
+#include "history.h"
+
+//A named group of clients sharing one subscription to a topic. Each message
+//published to the topic is delivered to exactly one member of the group.
+//cursor counts the messages delivered to the group and picks the next member.
+struct Group {
+    char* name;
+    Node* members;
+    unsigned int cursor;
+    bool conflate;
+    struct Group* next;
+};
+
+typedef struct Group Group;
+
+//A group as publishers see it in a Subscribers snapshot
+typedef struct {
+    Client** members;
+    int memberCount;
+    unsigned int* cursor;
+    bool conflate;
+} GroupView;
+
+//The subscribers of a topic that asked for the same filter. The filter is
+//tested once per message for all of them.
+struct Filtered {
+    Filter* filter;
+    Node* clients;
+    Node* conflated;
+    struct Filtered* next;
+};
+
+typedef struct Filtered Filtered;
+
+//A set of filtered subscribers as publishers see it in a Subscribers
+//snapshot
+typedef struct {
+    Filter* filter;
+    Client** clients;
+    int clientCount;
+    Client** conflated;
+    int conflatedCount;
+} FilteredView;
+
+//An immutable copy of a topic's subscribers. Publishers read it without
+//taking a lock, and every change to the topic builds a new copy, swaps it in
+//and retires the old one.
+typedef struct {
+    Client** clients;
+    int clientCount;
+    Client** conflated;
+    int conflatedCount;
+    GroupView* groups;
+    int groupCount;
+    FilteredView* filtered;
+    int filteredCount;
+} Subscribers;
+
+//Traffic through one topic, counted by publishers without a lock
+typedef struct {
+    uint64_t publishes;
+    uint64_t bytes;
+    uint64_t deliveries;
+} TopicTraffic;
+
+//Struct that stores the subscribers of a single topic. The lists and groups
+//are only used by writers, which take turns, while publishers only use the
+//snapshot in subscribers. Subscribers that only want the newest value are
+//kept in their own list, and subscribers with a filter are kept in a set
+//for each distinct filter. history numbers the topic's messages and, once a
+//sequenced client has subscribed, holds the most recent ones for clients
+//that reconnect. traffic counts what has been published to the topic.
+//priority is the class its messages are sent in. A topic that loses its
+//last subscriber while holding messages is kept for a while, with 
+//emptySince the time it last became empty and retained set while a timer is
+//waiting to remove it.
+typedef struct {
+    Node* clients;
+    Node* conflated;
+    Group* groups;
+    Filtered* filtered;
+    Subscribers* subscribers;
+    EpochDomain* epoch;
+    History history;
+    TopicTraffic traffic;
+    int priority;
+    uint64_t emptySince;
+    bool retained;
+} Topic;
+
+/* init_topic()
+ * ------------
+ * Creates a topic with no subscribers, no groups and no messages, whose
+ * messages are sent in DEFAULT_PRIORITY
+ *
+ * epoch: the epoch domain that old snapshots of the topic are retired to
+ *
+ * historySize: the number of recent messages the topic holds
+ *
+ * Returns: a pointer to the new topic
+ */
+Topic* init_topic(EpochDomain* epoch, int historySize);
+
+/* retire_topic()
+ * --------------
+ * Retires a topic that has been removed from the topic table. The topic
+ * along with its lists, groups, filters and snapshot is freed once no
+ * publisher can still be using it. The clients themselves are not freed.
+ *
+ * topic: the topic to be retired
+ */
+void retire_topic(Topic* topic);
+
+/* get_subscribers()
+ * -----------------
+ * Loads the current snapshot of a topic's subscribers. Must be called from
+ * inside a read-side section of the topic's epoch domain, and the snapshot
+ * must not be used once the section ends.
+ *
+ * topic: the topic
+ *
+ * Returns: the snapshot
+ */
+Subscribers* get_subscribers(Topic* topic);
+
+/* count_subscribers()
+ * -------------------
+ * Counts the clients subscribed to a topic, including group members and
+ * filtered subscribers, from its current snapshot. Must be called from within
+ * a read-side section of the topic's epoch domain.
+ *
+ * topic: the topic
+ *
+ * Returns: the number of subscribers
+ */
+int count_subscribers(Topic* topic);
+
+/* is_empty_topic()
+ * ----------------
+ * Determines if a topic has no subscribers and no groups left. Recent
+ * messages it holds are not counted, so that a topic nobody is subscribed to
+ * is not kept forever.
+ *
+ * topic: the topic being checked
+ *
+ * Returns: true if the topic has nobody left and false otherwise
+ */
+bool is_empty_topic(Topic* topic);
+
+/* add_subscriber()
+ * ----------------
+ * Subscribes a client directly to the topic and publishes a new snapshot. If
+ * the client is already subscribed, only whether the subscription is 
+ * conflated is updated, and a filter it subscribed with is dropped.
+ *
+ * topic: the topic being subscribed to
+ *
+ * client: the client subscribing
+ *
+ * conflate: true if the client only wants the newest unsent value
+ */
+void add_subscriber(Topic* topic, Client* client, bool conflate);
+
+/* add_filtered_subscriber()
+ * ---------------------------
+ * Subscribes a client to the topic with a filter and publishes a new
+ * snapshot. The client joins the set of subscribers with the same filter,
+ * which is created if no subscriber has asked for it yet. A direct
+ * subscription or different filter the client already had is replaced.
+ *
+ * topic: the topic being subscribed to
+ *
+ * client: the client subscribing
+ *
+ * filter: the filter, which is copied if a new set is created
+ *
+ * conflate: true if the client only wants the newest unsent value
+ */
+void add_filtered_subscriber(Topic* topic, Client* client, Filter* filter,
+        bool conflate);
+
+/* load_subscribers()
+ * ------------------
+ * Subscribes many clients directly to the topic at once and publishes a
+ * single new snapshot for all of them. Used when a topic is rebuilt, so the
+ * clients must not already be subscribed.
+ *
+ * topic: the topic being subscribed to
+ *
+ * clients: the clients subscribing
+ *
+ * count: the number of clients
+ *
+ * conflate: true if the clients only want the newest unsent value
+ */
+void load_subscribers(Topic* topic, Client** clients, int count, 
+        bool conflate);
+
+/* remove_subscriber()
+ * -------------------
+ * Removes a direct or filtered subscription of a client from the topic and
+ * publishes a new snapshot. A set of filtered subscribers is deleted once
+ * its last subscriber leaves.
+ *
+ * topic: the topic being unsubscribed from
+ *
+ * client: the client unsubscribing
+ *
+ * Returns: true if the client was subscribed and has been removed and false
+ * otherwise
+ */
+bool remove_subscriber(Topic* topic, Client* client);
+
+/* find_group()
+ * ------------
+ * Finds the group with the given name on the topic
+ *
+ * topic: the topic to search
+ *
+ * name: the name of the group
+ *
+ * Returns: the group if it exists and NULL otherwise
+ */
+Group* find_group(Topic* topic, char* name);
+
+/* join_group()
+ * ------------
+ * Adds a client to the named group on the topic, creating the group if it
+ * does not yet exist, and publishes a new snapshot. Does nothing if the
+ * client is already a member.
+ *
+ * topic: the topic the group belongs to
+ *
+ * name: the name of the group
+ *
+ * client: the client joining the group
+ *
+ * conflate: true if the group is created as a conflated group. Ignored if the
+ * group already exists.
+ */
+void join_group(Topic* topic, char* name, Client* client, bool conflate);
+
+/* leave_group()
+ * -------------
+ * Removes a client from a group and publishes a new snapshot. Messages that
+ * would have gone to the client are rebalanced over the remaining members,
+ * and the group is deleted once it has no members left.
+ *
+ * topic: the topic the group belongs to
+ *
+ * group: the group being left
+ *
+ * client: the client leaving
+ *
+ * Returns: true if the client was a member and has been removed and false
+ * otherwise
+ */
+bool leave_group(Topic* topic, Group* group, Client* client);
+
+/* next_group_member()
+ * -------------------
+ * Chooses the member of a group that should receive the next message. Members
+ * are chosen in round-robin order. Safe to call from any number of
+ * publishers at once.
+ *
+ * group: the group to choose from, as seen in a snapshot
+ *
+ * Returns: the client that should receive the next message
+ */
+Client* next_group_member(GroupView* group);
+#endif
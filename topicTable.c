@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include "topicTable.h"
+
+#define INITIAL_TABLE_SIZE 64
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+unsigned int hash_name(char* name) {
+    unsigned int hash = FNV_OFFSET;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char) *name) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/* init_buckets()
+ * --------------
+ * Creates a bucket array with every bucket empty
+ *
+ * size: the number of buckets
+ *
+ * Returns: the new bucket array
+ */
+TopicBuckets* init_buckets(int size) {
+    TopicBuckets* buckets = malloc(sizeof(TopicBuckets));
+    buckets->size = size;
+    buckets->buckets = calloc(size, sizeof(TopicEntry*));
+    return buckets;
+}
+
+/* free_entry()
+ * ------------
+ * Frees an entry that has been unlinked from the table
+ *
+ * arg: the TopicEntry struct to free
+ */
+void free_entry(void* arg) {
+    TopicEntry* entry = arg;
+    free(entry->name);
+    free(entry);
+}
+
+/* free_buckets()
+ * --------------
+ * Frees a bucket array that has been replaced, along with the entries it
+ * holds. The topics are not freed as they have moved to the new array.
+ *
+ * arg: the TopicBuckets struct to free
+ */
+void free_buckets(void* arg) {
+    TopicBuckets* buckets = arg;
+    for (int i = 0; i < buckets->size; i++) {
+        TopicEntry* entry = buckets->buckets[i];
+        while (entry) {
+            TopicEntry* next = entry->next;
+            free_entry(entry);
+            entry = next;
+        }
+    }
+    free(buckets->buckets);
+    free(buckets);
+}
+
+/* push_entry()
+ * ------------
+ * Publishes a new entry at the front of its bucket
+ *
+ * buckets: the bucket array
+ *
+ * name: the name of the topic, which is copied
+ *
+ * topic: the topic
+ */
+void push_entry(TopicBuckets* buckets, char* name, Topic* topic) {
+    TopicEntry* entry = malloc(sizeof(TopicEntry));
+    entry->name = strdup(name);
+    entry->topic = topic;
+    TopicEntry** bucket = &buckets->buckets[hash_name(name) % buckets->size];
+    entry->next = *bucket;
+    __atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
+}
+
+/* grow_table()
+ * ------------
+ * Doubles the number of buckets. The entries are copied into a new array
+ * that is swapped in whole, so readers see either the old table or the new
+ * one and never a half moved bucket.
+ *
+ * table: the topic table
+ */
+void grow_table(TopicTable* table) {
+    TopicBuckets* old = table->buckets;
+    TopicBuckets* buckets = init_buckets(old->size * 2);
+    for (int i = 0; i < old->size; i++) {
+        for (TopicEntry* entry = old->buckets[i]; entry;
+                entry = entry->next) {
+            push_entry(buckets, entry->name, entry->topic);
+        }
+    }
+    __atomic_store_n(&table->buckets, buckets, __ATOMIC_RELEASE);
+    retire(table->epoch, old, free_buckets);
+}
+
+void init_topic_table(TopicTable* table, EpochDomain* epoch) {
+    table->buckets = init_buckets(INITIAL_TABLE_SIZE);
+    table->count = 0;
+    table->epoch = epoch;
+}
+
+Topic* find_topic(TopicTable* table, char* name) {
+    TopicBuckets* buckets = __atomic_load_n(&table->buckets,
+            __ATOMIC_ACQUIRE);
+    TopicEntry* entry = __atomic_load_n(
+            &buckets->buckets[hash_name(name) % buckets->size],
+            __ATOMIC_ACQUIRE);
+    for (; entry; entry = __atomic_load_n(&entry->next, __ATOMIC_ACQUIRE)) {
+        if (!strcmp(entry->name, name)) {
+            return entry->topic;
+        }
+    }
+    return NULL;
+}
+
+void add_topic(TopicTable* table, char* name, Topic* topic) {
+    if (table->count == table->buckets->size) {
+        grow_table(table);
+    }
+    push_entry(table->buckets, name, topic);
+    table->count++;
+}
+
+void remove_topic(TopicTable* table, char* name) {
+    TopicBuckets* buckets = table->buckets;
+    TopicEntry** link = &buckets->buckets[hash_name(name) % buckets->size];
+    for (; *link; link = &(*link)->next) {
+        TopicEntry* entry = *link;
+        if (!strcmp(entry->name, name)) {
+            __atomic_store_n(link, entry->next, __ATOMIC_RELEASE);
+            retire(table->epoch, entry, free_entry);
+            table->count--;
+            return;
+        }
+    }
+}
+
+TopicEntry* iterate_topics(TopicTable* table, TopicEntry* entry) {
+    TopicBuckets* buckets = table->buckets;
+    int bucket = 0;
+    if (entry) {
+        if (entry->next) {
+            return entry->next;
+        }
+        bucket = hash_name(entry->name) % buckets->size + 1;
+    }
+    for (; bucket < buckets->size; bucket++) {
+        if (buckets->buckets[bucket]) {
+            return buckets->buckets[bucket];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,99 @@
+#ifndef TOPICTABLE_H
+#define TOPICTABLE_H
+
+#include "topic.h"
+#include "epoch.h"
+
+//One topic in a bucket of the table. Entries are never changed once they are
+//visible to readers, only unlinked and retired.
+struct TopicEntry {
+    char* name;
+    Topic* topic;
+    struct TopicEntry* next;
+};
+
+typedef struct TopicEntry TopicEntry;
+
+//The bucket array of the table. The whole array is replaced when the table
+//grows.
+typedef struct {
+    int size;
+    TopicEntry** buckets;
+} TopicBuckets;
+
+//A hash table from topic names to topics. Lookups take no lock and may run
+//alongside a writer, while writers must take turns with each other.
+typedef struct {
+    TopicBuckets* buckets;
+    int count;
+    EpochDomain* epoch;
+} TopicTable;
+
+/* hash_name()
+ * -----------
+ * Hashes a topic name with FNV-1a
+ *
+ * name: the name to hash
+ *
+ * Returns: the hash of the name
+ */
+unsigned int hash_name(char* name);
+
+/* init_topic_table()
+ * ------------------
+ * Sets up an empty topic table
+ *
+ * table: the table to set up
+ *
+ * epoch: the epoch domain that unlinked entries are retired to
+ */
+void init_topic_table(TopicTable* table, EpochDomain* epoch);
+
+/* find_topic()
+ * ------------
+ * Looks up a topic by name. Readers must call this from inside a read-side
+ * section of the table's epoch domain and stop using the topic once the
+ * section ends.
+ *
+ * table: the topic table
+ *
+ * name: the name of the topic
+ *
+ * Returns: the topic if it exists and NULL otherwise
+ */
+Topic* find_topic(TopicTable* table, char* name);
+
+/* add_topic()
+ * -----------
+ * Adds a topic to the table. The name must not already be in the table.
+ *
+ * table: the topic table
+ *
+ * name: the name of the topic, which is copied
+ *
+ * topic: the topic to add
+ */
+void add_topic(TopicTable* table, char* name, Topic* topic);
+
+/* remove_topic()
+ * --------------
+ * Removes a topic from the table. The topic itself is not retired.
+ *
+ * table: the topic table
+ *
+ * name: the name of the topic
+ */
+void remove_topic(TopicTable* table, char* name);
+
+/* iterate_topics()
+ * ----------------
+ * Steps through every entry in the table. Only writers may iterate.
+ *
+ * table: the topic table
+ *
+ * entry: the previous entry returned, or NULL to start from the beginning
+ *
+ * Returns: the next entry, or NULL once every entry has been returned
+ */
+TopicEntry* iterate_topics(TopicTable* table, TopicEntry* entry);
+#endif
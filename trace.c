@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "trace.h"
+
+#define NANOSECONDS 1000000000UL
+#define TRACE_FILE_FORMAT "psserver-%d-%d.trace"
+
+void init_trace_log(TraceLog* log) {
+    log->rings = NULL;
+    log->dumps = 0;
+    pthread_mutex_init(&log->lock, NULL);
+}
+
+TraceRing* register_tracer(TraceLog* log, char* name) {
+    pthread_mutex_lock(&log->lock);
+    TraceRing* ring = log->rings;
+    while (ring && ring->inUse) {
+        ring = ring->next;
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(TraceRing));
+        ring->next = log->rings;
+        log->rings = ring;
+    }
+    ring->inUse = true;
+    ring->tid = syscall(SYS_gettid);
+    strncpy(ring->name, name, TRACE_NAME_SIZE - 1);
+    ring->name[TRACE_NAME_SIZE - 1] = '\0';
+    pthread_mutex_unlock(&log->lock);
+    return ring;
+}
+
+void unregister_tracer(TraceRing* ring) {
+    __atomic_store_n(&ring->inUse, false, __ATOMIC_RELEASE);
+}
+
+void trace_event(TraceRing* ring, uint32_t type, uint32_t arg, 
+        uint32_t value) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t head = ring->head;
+    TraceEvent* event = &ring->events[head % TRACE_RING_SIZE];
+    event->time = now.tv_sec * NANOSECONDS + now.tv_nsec;
+    event->tid = ring->tid;
+    event->type = type;
+    event->arg = arg;
+    event->value = value;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* copy_ring()
+ * -----------
+ * Copies the events of a ring that may still be recording. Events that the
+ * owner overwrote while they were being copied are dropped.
+ *
+ * ring: the ring to copy
+ *
+ * events: the array to copy into, with room for TRACE_RING_SIZE events
+ *
+ * Returns: the number of events copied, oldest first
+ */
+int copy_ring(TraceRing* ring, TraceEvent* events) {
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    for (uint64_t i = first; i < head; i++) {
+        events[i - first] = ring->events[i % TRACE_RING_SIZE];
+    }
+
+    //Anything more than a ring behind the new head has been overwritten
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    uint64_t newHead = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint64_t valid = newHead > TRACE_RING_SIZE ? newHead - TRACE_RING_SIZE : 0;
+    if (valid <= first) {
+        return head - first;
+    }
+    if (valid >= head) {
+        return 0;
+    }
+    memmove(events, events + (valid - first), 
+            sizeof(TraceEvent) * (head - valid));
+    return head - valid;
+}
+
+bool dump_traces(TraceLog* log, char* path, size_t pathSize) {
+    pthread_mutex_lock(&log->lock);
+    snprintf(path, pathSize, TRACE_FILE_FORMAT, getpid(), log->dumps++);
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        pthread_mutex_unlock(&log->lock);
+        return false;
+    }
+
+    //Count the rings so the header can be written first, then fill it in
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, 0, 0};
+    for (TraceRing* ring = log->rings; ring; ring = ring->next) {
+        header.threadCount++;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    for (TraceRing* ring = log->rings; ring; ring = ring->next) {
+        TraceThread thread;
+        memset(&thread, 0, sizeof(thread));
+        thread.tid = ring->tid;
+        memcpy(thread.name, ring->name, TRACE_NAME_SIZE);
+        fwrite(&thread, sizeof(thread), 1, file);
+    }
+
+    TraceEvent* events = malloc(sizeof(TraceEvent) * TRACE_RING_SIZE);
+    for (TraceRing* ring = log->rings; ring; ring = ring->next) {
+        int count = copy_ring(ring, events);
+        fwrite(events, sizeof(TraceEvent), count, file);
+        header.eventCount += count;
+    }
+    free(events);
+    pthread_mutex_unlock(&log->lock);
+
+    rewind(file);
+    fwrite(&header, sizeof(header), 1, file);
+    return !fclose(file);
+}
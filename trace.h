@@ -0,0 +1,134 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define TRACE_RING_SIZE 1024
+#define TRACE_NAME_SIZE 16
+#define TRACE_MAGIC 0x45435254
+#define TRACE_VERSION 1
+
+//The kinds of event recorded. Each _BEGIN event is followed by its _END
+//event on the same thread. A lock is waited for between TRACE_LOCK_WAIT and
+//TRACE_LOCK_ACQUIRED and held until TRACE_LOCK_RELEASED.
+#define TRACE_ACCEPT_BEGIN 0
+#define TRACE_ACCEPT_END 1
+#define TRACE_COMMAND_BEGIN 2
+#define TRACE_COMMAND_END 3
+#define TRACE_LOCK_WAIT 4
+#define TRACE_LOCK_ACQUIRED 5
+#define TRACE_LOCK_RELEASED 6
+#define TRACE_WRITE_BEGIN 7
+#define TRACE_WRITE_END 8
+
+//One timestamped event. time is in nanoseconds on the monotonic clock, and
+//the meaning of arg and value depends on the type of event.
+typedef struct {
+    uint64_t time;
+    uint32_t tid;
+    uint32_t type;
+    uint32_t arg;
+    uint32_t value;
+} TraceEvent;
+
+//The most recent events of one thread. Only the owning thread writes to
+//the ring, publishing each event by advancing head, so recording never
+//takes a lock. A ring is reused by a new thread once its owner has gone.
+struct TraceRing {
+    TraceEvent events[TRACE_RING_SIZE];
+    uint64_t head;
+    uint32_t tid;
+    char name[TRACE_NAME_SIZE];
+    bool inUse;
+    struct TraceRing* next;
+};
+
+typedef struct TraceRing TraceRing;
+
+//Every trace ring of the process. Rings are never freed, so the rings can
+//be dumped while their threads keep recording.
+typedef struct {
+    TraceRing* rings;
+    int dumps;
+    pthread_mutex_t lock;
+} TraceLog;
+
+//The header of a trace file. It is followed by threadCount TraceThread
+//records naming the threads and then eventCount TraceEvent records.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t threadCount;
+    uint32_t eventCount;
+} TraceHeader;
+
+//Names a thread in a trace file
+typedef struct {
+    uint32_t tid;
+    char name[TRACE_NAME_SIZE];
+} TraceThread;
+
+/* init_trace_log()
+ * ----------------
+ * Sets up a trace log with no rings
+ *
+ * log: the log to set up
+ */
+void init_trace_log(TraceLog* log);
+
+/* register_tracer()
+ * -----------------
+ * Gives the calling thread a ring to record its events in
+ *
+ * log: the trace log
+ *
+ * name: a short name for the kind of thread, shown in the trace
+ *
+ * Returns: the ring, which only the calling thread may record to
+ */
+TraceRing* register_tracer(TraceLog* log, char* name);
+
+/* unregister_tracer()
+ * -------------------
+ * Gives up a ring when its thread is finishing. Its events are kept until a
+ * new thread reusing the ring overwrites them.
+ *
+ * ring: the ring of the calling thread
+ */
+void unregister_tracer(TraceRing* ring);
+
+/* trace_event()
+ * -------------
+ * Records an event in the calling thread's ring, overwriting its oldest 
+ * event once the ring is full. Cheap enough to leave on all the time.
+ *
+ * ring: the ring of the calling thread
+ *
+ * type: the kind of event
+ *
+ * arg: the first detail of the event, such as a file descriptor
+ *
+ * value: the second detail of the event, such as a number of bytes
+ */
+void trace_event(TraceRing* ring, uint32_t type, uint32_t arg, 
+        uint32_t value);
+
+/* dump_traces()
+ * -------------
+ * Writes the events of every ring to a new trace file named after the 
+ * process and the number of dumps so far. Threads keep recording while 
+ * this happens, and events overwritten while being copied are left out.
+ *
+ * log: the trace log
+ *
+ * path: set to the name of the file, which must hold at least pathSize 
+ * characters
+ *
+ * pathSize: the size of path
+ *
+ * Returns: true if the file was written and false otherwise
+ */
+bool dump_traces(TraceLog* log, char* path, size_t pathSize);
+#endif